@@ -0,0 +1,104 @@
+// Microbenchmark for the ranked file queries of the show filter.
+//
+// Types queries one character at a time against synthetic relative paths, as a user in the
+// file list would, and reports the time per keystroke. Each keystroke is a full pass through
+// FuzzyMatcher::match() on one thread, prefilter, scoring and top-K selection. FilesList
+// scores in parallel chunks and only rescores the previous matches while a query grows, so
+// the app is faster than this. The target is 10 ms per keystroke on 500k paths.
+//
+// usage: fuzzy_benchmark [--paths N] [--query "mainwin;~mwh"]
+
+#include <QElapsedTimer>
+#include <QString>
+#include <QStringList>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+
+#include "FuzzyMatcher.hpp"
+#include "PathStore.hpp"
+
+namespace {
+
+constexpr double TargetMs = 10.0;
+constexpr qsizetype ResultLimit = 2000;
+
+PathStore syntheticPaths(qsizetype count) {
+    static const char *dirs[] = {"src", "include", "lib", "tests", "ui", "core", "widgets",
+                                 "net", "io",      "gui", "tools", "docs"};
+    static const char *names[] = {"MainWindow", "main",   "FileList", "codeEditor", "parser",
+                                  "lexer",      "Socket", "window",   "model",      "view",
+                                  "Highlighter", "util",  "config",   "widget_helper"};
+    static const char *exts[] = {".cpp", ".hpp", ".h", ".c", ".txt", ".md", ".json"};
+    auto store = PathStore();
+    auto seed = quint32(12345);
+    auto next = [&seed]() {
+        seed = seed * 1103515245u + 12345u;
+        return seed >> 8;
+    };
+    auto path = QString();
+    for (auto i = qsizetype(0); i < count; ++i) {
+        path.clear();
+        auto depth = 1 + next() % 5;
+        for (auto d = 0u; d < depth; ++d) {
+            if (next() % 4 == 0) {
+                path += QLatin1String(dirs[next() % std::size(dirs)]);
+            } else {
+                path += QStringLiteral("module_%1").arg(next() % 500);
+            }
+            path += '/';
+        }
+        path += QLatin1String(names[next() % std::size(names)]);
+        path += QString::number(next() % 1000);
+        path += QLatin1String(exts[next() % std::size(exts)]);
+        store.addFile(path);
+    }
+    return store;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    auto count = qsizetype(500000);
+    auto queryText = QStringLiteral("mainwin;~mwh;filelist.cpp;~cdedt");
+    for (auto i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--paths") == 0 && i + 1 < argc) {
+            count = std::atoll(argv[++i]);
+        } else if (std::strcmp(argv[i], "--query") == 0 && i + 1 < argc) {
+            queryText = QString::fromLocal8Bit(argv[++i]);
+        } else {
+            std::fprintf(stderr, "usage: %s [--paths N] [--query \"word;~fuzzy\"]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    auto paths = syntheticPaths(count);
+    QElapsedTimer timer;
+    timer.start();
+    auto matcher = FuzzyMatcher();
+    matcher.setPaths(paths);
+    std::printf("%lld paths, character masks built in %.2f ms\n",
+                static_cast<long long>(paths.size()), timer.nsecsElapsed() / 1e6);
+
+    auto worstMs = 0.0;
+    for (auto const &query : queryText.split(';', Qt::SkipEmptyParts)) {
+        std::printf("%s\n", qPrintable(query));
+        // The first keystroke of a fuzzy query is `~` and the character after it
+        auto first = query.startsWith('~') ? 2 : 1;
+        for (auto length = first; length <= query.size(); ++length) {
+            auto term = FuzzyMatcher::parseTerm(QStringView(query).first(length));
+            timer.restart();
+            auto matches = matcher.match(term, ResultLimit);
+            auto ms = timer.nsecsElapsed() / 1e6;
+            worstMs = std::max(worstMs, ms);
+            std::printf("  %-20s %8.2f ms %8lld shown\n", qPrintable(query.first(length)), ms,
+                        static_cast<long long>(matches.size()));
+        }
+    }
+    std::printf("worst keystroke %.2f ms, target %.0f ms %s\n", worstMs, TargetMs,
+                worstMs <= TargetMs ? "met" : "missed");
+    return 0;
+}
@@ -0,0 +1,144 @@
+// Microbenchmark for GlobMatcher.
+//
+// Compares the compiled matcher against the QRegularExpression based filter that
+// FilesList used before, on synthetic relative paths. Both must agree on every path.
+//
+// usage: glob_benchmark [--paths N] [--patterns "build;.vs;cbuild*"]
+
+#include <QElapsedTimer>
+#include <QList>
+#include <QRegularExpression>
+#include <QString>
+#include <QStringList>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+
+#include "GlobMatcher.hpp"
+
+// The glob to regex conversion FilesList used before GlobMatcher
+static QList<QRegularExpression> toRegexList(const QStringList &patterns) {
+    QList<QRegularExpression> list;
+    for (auto &pat : patterns) {
+        QString rx;
+        for (QChar ch : pat.trimmed()) {
+            if (ch == '*') {
+                rx += ".*";
+            } else if (ch == '?') {
+                rx += '.';
+            } else if (QString("[](){}.+^$|\\").contains(ch)) {
+                rx += '\\' + ch;
+            } else {
+                rx += ch;
+            }
+        }
+        if (!rx.isEmpty()) {
+            list << QRegularExpression("^" + rx + "$", QRegularExpression::CaseInsensitiveOption);
+        }
+    }
+    return list;
+}
+
+static bool regexMatchesAnySegment(const QList<QRegularExpression> &patterns, const QString &path) {
+    auto segments = path.split('/', Qt::SkipEmptyParts);
+    for (auto const &rx : patterns) {
+        for (auto const &segment : segments) {
+            if (rx.match(segment).hasMatch()) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+static QStringList syntheticPaths(qsizetype count) {
+    static const char *dirs[] = {"src",   "include", "lib",       "tests",  "build",
+                                 "docs",  "tools",   "cbuild-rel", "third",  "Build",
+                                 "core",  "ui",      ".vs",        "assets", "cbuild"};
+    static const char *exts[] = {".cpp", ".hpp", ".h", ".c", ".txt", ".md", ".o", ".json"};
+    auto paths = QStringList();
+    paths.reserve(count);
+    auto seed = quint32(12345);
+    auto next = [&seed]() {
+        seed = seed * 1103515245u + 12345u;
+        return seed >> 8;
+    };
+    for (auto i = qsizetype(0); i < count; ++i) {
+        auto path = QString();
+        auto depth = 1 + next() % 5;
+        for (auto d = 0u; d < depth; ++d) {
+            // Mostly neutral directory names, so the exclude set rarely matches
+            if (next() % 8 == 0) {
+                path += QLatin1String(dirs[next() % std::size(dirs)]);
+            } else {
+                path += QStringLiteral("module_%1").arg(next() % 500);
+            }
+            path += '/';
+        }
+        path += QStringLiteral("file_%1").arg(next() % 100000);
+        path += QLatin1String(exts[next() % std::size(exts)]);
+        paths << path;
+    }
+    return paths;
+}
+
+int main(int argc, char *argv[]) {
+    auto count = qsizetype(1000000);
+    auto patternText = QStringLiteral("build;.vs;cbuild*");
+    for (auto i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--paths") == 0 && i + 1 < argc) {
+            count = std::atoll(argv[++i]);
+        } else if (std::strcmp(argv[i], "--patterns") == 0 && i + 1 < argc) {
+            patternText = QString::fromLocal8Bit(argv[++i]);
+        } else {
+            std::fprintf(stderr, "usage: %s [--paths N] [--patterns \"a;b*\"]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    auto patterns = patternText.split(';', Qt::SkipEmptyParts);
+    auto paths = syntheticPaths(count);
+    std::printf("%lld paths, patterns \"%s\"\n", static_cast<long long>(paths.size()),
+                qPrintable(patternText));
+
+    QElapsedTimer timer;
+    timer.start();
+    auto regexes = toRegexList(patterns);
+    auto regexResults = QList<bool>();
+    regexResults.reserve(paths.size());
+    for (auto const &path : std::as_const(paths)) {
+        regexResults << regexMatchesAnySegment(regexes, path);
+    }
+    auto regexNs = timer.nsecsElapsed();
+
+    timer.restart();
+    auto matcher = GlobMatcher(patterns);
+    auto globResults = QList<bool>();
+    globResults.reserve(paths.size());
+    for (auto const &path : std::as_const(paths)) {
+        globResults << matcher.matchesAnySegment(path);
+    }
+    auto globNs = timer.nsecsElapsed();
+
+    auto matched = qsizetype(0);
+    auto mismatches = qsizetype(0);
+    for (auto i = qsizetype(0); i < paths.size(); ++i) {
+        matched += globResults[i] ? 1 : 0;
+        if (globResults[i] != regexResults[i]) {
+            if (mismatches++ < 10) {
+                std::printf("mismatch: %s regex=%d glob=%d\n", qPrintable(paths[i]),
+                            int(regexResults[i]), int(globResults[i]));
+            }
+        }
+    }
+
+    auto perPath = [&](qint64 ns) { return double(ns) / qMax<qsizetype>(1, paths.size()); };
+    std::printf("regex: %10.2f ms %8.1f ns/path\n", regexNs / 1e6, perPath(regexNs));
+    std::printf("glob:  %10.2f ms %8.1f ns/path\n", globNs / 1e6, perPath(globNs));
+    std::printf("speedup %.1fx, %lld paths matched, %lld mismatches\n",
+                double(regexNs) / qMax<qint64>(1, globNs), static_cast<long long>(matched),
+                static_cast<long long>(mismatches));
+    return mismatches == 0 ? 0 : 1;
+}
@@ -0,0 +1,191 @@
+// Benchmark of the LSP client stack against a replayed session (Linux only).
+//
+// Starts lsp_replay in place of clangd and drives LspClientImpl through it: opens
+// documents, then repeatedly edits each one and hovers in it, waiting for every answer.
+// As the server side only plays back, the numbers measure the client: the scheduler,
+// the connection, the reactor and the handlers. Without --session a synthetic session is
+// generated, so no clangd is needed. With --timed the recorded server delays are kept.
+//
+// usage: replay_benchmark [--session FILE] [--timed] [--documents N] [--iterations N]
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include "LatencyHistogram.hpp"
+#include "LspClientImpl.hpp"
+
+namespace {
+
+constexpr auto ReplyTimeout = std::chrono::seconds(5);
+constexpr int DocumentLines = 200;
+
+std::string documentText(int document) {
+    auto text = std::string();
+    for (auto line = 0; line < DocumentLines; ++line) {
+        text += "int value_" + std::to_string(document) + "_" + std::to_string(line) +
+                " = " + std::to_string(line) + ";\n";
+    }
+    return text;
+}
+
+// A session as clangd would answer the workload: incremental sync, a hover answer for
+// every hover and diagnostics after every change
+void writeSyntheticSession(const std::string &path, int documents, int iterations) {
+    auto out = std::ofstream(path);
+    auto time = 0LL;
+    auto id = 0;
+    auto line = [&](const char *dir, const std::string &message) {
+        out << "{\"t_us\":" << time << ",\"dir\":\"" << dir << "\",\"message\":" << message
+            << "}\n";
+    };
+    line("send", R"({"jsonrpc":"2.0","id":0,"method":"initialize","params":{}})");
+    time += 50000;
+    line("receive", R"({"jsonrpc":"2.0","id":0,"result":{"capabilities":)"
+                    R"({"textDocumentSync":2,"hoverProvider":true}}})");
+    for (auto i = 0; i < iterations * documents; ++i) {
+        auto uri = "\"file:///doc" + std::to_string(i % documents) + ".cpp\"";
+        time += 1000;
+        line("send", R"({"jsonrpc":"2.0","method":"textDocument/didChange","params":{}})");
+        time += 20000;
+        line("receive",
+             R"({"jsonrpc":"2.0","method":"textDocument/publishDiagnostics","params":{"uri":)" +
+                 uri +
+                 R"(,"diagnostics":[{"range":{"start":{"line":1,"character":0},"end":)"
+                 R"({"line":1,"character":5}},"severity":2,"message":"unused variable"}]}})");
+        time += 1000;
+        line("send", R"({"jsonrpc":"2.0","id":)" + std::to_string(++id) +
+                         R"(,"method":"textDocument/hover","params":{}})");
+        time += 2000;
+        line("receive", R"({"jsonrpc":"2.0","id":)" + std::to_string(id) +
+                            R"(,"result":{"contents":{"kind":"markdown","value":)"
+                            R"("### variable `value`\n\nType: `int`"},"range":)"
+                            R"({"start":{"line":1,"character":4},"end":)"
+                            R"({"line":1,"character":9}}}})");
+    }
+}
+
+double perSecond(int count, std::chrono::steady_clock::duration time) {
+    return count / std::max(std::chrono::duration<double>(time).count(), 1e-9);
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    auto session = std::string();
+    auto timed = false;
+    auto documents = 20;
+    auto iterations = 50;
+    for (auto i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--session") == 0 && i + 1 < argc) {
+            session = argv[++i];
+        } else if (std::strcmp(argv[i], "--timed") == 0) {
+            timed = true;
+        } else if (std::strcmp(argv[i], "--documents") == 0 && i + 1 < argc) {
+            documents = std::max(std::atoi(argv[++i]), 1);
+        } else if (std::strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) {
+            iterations = std::max(std::atoi(argv[++i]), 1);
+        } else {
+            std::fprintf(stderr,
+                         "usage: %s [--session FILE] [--timed] [--documents N] "
+                         "[--iterations N]\n",
+                         argv[0]);
+            return 1;
+        }
+    }
+
+    auto dir = std::filesystem::temp_directory_path() /
+               ("replay_benchmark-" + std::to_string(getpid()));
+    std::filesystem::create_directories(dir);
+    if (session.empty()) {
+        session = (dir / "session.jsonl").string();
+        writeSyntheticSession(session, documents, iterations);
+    }
+    auto paths = std::vector<std::string>();
+    auto texts = std::vector<std::string>();
+    for (auto i = 0; i < documents; ++i) {
+        paths.push_back((dir / ("doc" + std::to_string(i) + ".cpp")).string());
+        texts.push_back(documentText(i));
+    }
+
+    using Clock = std::chrono::steady_clock;
+    auto failures = 0;
+    auto diagnostics = std::atomic<int>(0);
+    auto hoverLatency = LatencyHistogram();
+    auto openTime = Clock::duration();
+    auto workloadTime = Clock::duration();
+    {
+        auto client = LspClientImpl();
+        auto command = std::vector<std::string>{LSP_REPLAY_PATH, session};
+        if (!timed) {
+            command.push_back("--fast");
+        }
+        client.setServerCommand(std::move(command));
+        client.onDiagnostics([&] { diagnostics += int(client.takeDiagnostics().size()); });
+        client.startClangd();
+        client.setDocumentRoot(dir.string());
+        auto deadline = Clock::now() + ReplyTimeout;
+        while (!client.incrementalSync() && Clock::now() < deadline) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        if (!client.incrementalSync()) {
+            std::fprintf(stderr, "The replayed server did not initialize\n");
+            std::filesystem::remove_all(dir);
+            return 1;
+        }
+
+        auto start = Clock::now();
+        for (auto i = 0; i < documents; ++i) {
+            client.openDocument(paths[i], texts[i]);
+        }
+        openTime = Clock::now() - start;
+
+        start = Clock::now();
+        for (auto iteration = 0; iteration < iterations; ++iteration) {
+            for (auto i = 0; i < documents; ++i) {
+                auto line = iteration % DocumentLines;
+                client.changeDocument(paths[i], {DocumentEdit{line, 0, line, 0, " "}});
+                auto answered = std::make_shared<std::promise<void>>();
+                auto future = answered->get_future();
+                auto sent = Clock::now();
+                client.hover(paths[i], line, 5, [answered](std::string &&) {
+                    answered->set_value();
+                });
+                if (future.wait_for(ReplyTimeout) == std::future_status::timeout) {
+                    ++failures;
+                    continue;
+                }
+                hoverLatency.record(Clock::now() - sent);
+            }
+        }
+        workloadTime = Clock::now() - start;
+        client.shutdownLspServer();
+        client.stopClangd();
+    }
+    std::filesystem::remove_all(dir);
+
+    auto operations = documents * iterations;
+    std::printf("%d documents, %d iterations%s\n", documents, iterations,
+                timed ? ", recorded delays" : "");
+    std::printf("open:          %10.0f documents/s\n", perSecond(documents, openTime));
+    std::printf("change+hover:  %10.0f round trips/s\n", perSecond(operations, workloadTime));
+    std::printf("hover latency: p50 %.3f ms, p95 %.3f ms, p99 %.3f ms, max %.3f ms\n",
+                hoverLatency.quantile(0.5).count() / 1000.0,
+                hoverLatency.quantile(0.95).count() / 1000.0,
+                hoverLatency.quantile(0.99).count() / 1000.0,
+                hoverLatency.max().count() / 1000.0);
+    std::printf("%d diagnostics received\n", diagnostics.load());
+    std::printf("%d failures\n", failures);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,122 @@
+// Headless benchmark for DirScanner.
+//
+// Builds a synthetic tree (or uses an existing one with --root) and reports how
+// many files per second the scanner delivers, for 1 thread and for the requested
+// thread count.
+//
+// usage: scan_benchmark [--depth N] [--width N] [--files N] [--threads N] [--runs N]
+//                       [--root DIR] [--keep]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <string_view>
+
+#include "DirScanner.hpp"
+
+namespace fs = std::filesystem;
+
+struct BenchOptions {
+    int depth = 4;
+    int width = 8;
+    int files = 20;
+    unsigned threads = 0;
+    int runs = 3;
+    std::string root;
+    bool keep = false;
+};
+
+static std::size_t createTree(const fs::path &dir, int depth, const BenchOptions &options) {
+    auto count = std::size_t(0);
+    fs::create_directories(dir);
+    for (auto i = 0; i < options.files; ++i) {
+        auto name = "file_" + std::to_string(i) + (i % 2 ? ".cpp" : ".hpp");
+        std::ofstream(dir / name).put('\n');
+        ++count;
+    }
+    if (depth > 0) {
+        for (auto i = 0; i < options.width; ++i) {
+            count += createTree(dir / ("dir_" + std::to_string(i)), depth - 1, options);
+        }
+    }
+    return count;
+}
+
+static DirScanner::Stats runOnce(const std::string &root, unsigned threads, double &seconds) {
+    auto options = DirScanner::Options{};
+    options.threads = threads;
+    auto scanner = DirScanner(options);
+    auto start = std::chrono::steady_clock::now();
+    auto stats = scanner.scan(root, [](std::vector<std::string> &&) {});
+    seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return stats;
+}
+
+static void report(const std::string &root, unsigned threads, int runs) {
+    auto best = 0.0;
+    auto stats = DirScanner::Stats{};
+    for (auto i = 0; i < runs; ++i) {
+        auto seconds = 0.0;
+        stats = runOnce(root, threads, seconds);
+        if (i == 0 || seconds < best) {
+            best = seconds;
+        }
+    }
+    std::printf("threads=%-3u files=%-9llu dirs=%-8llu steals=%-7llu best=%8.2f ms  %12.0f "
+                "files/sec\n",
+                stats.threads, static_cast<unsigned long long>(stats.files),
+                static_cast<unsigned long long>(stats.directories),
+                static_cast<unsigned long long>(stats.steals), best * 1000.0,
+                best > 0 ? stats.files / best : 0.0);
+}
+
+int main(int argc, char *argv[]) {
+    auto options = BenchOptions{};
+    for (auto i = 1; i < argc; ++i) {
+        auto arg = std::string_view(argv[i]);
+        auto next = [&]() { return i + 1 < argc ? argv[++i] : "0"; };
+        if (arg == "--depth") {
+            options.depth = std::atoi(next());
+        } else if (arg == "--width") {
+            options.width = std::atoi(next());
+        } else if (arg == "--files") {
+            options.files = std::atoi(next());
+        } else if (arg == "--threads") {
+            options.threads = static_cast<unsigned>(std::atoi(next()));
+        } else if (arg == "--runs") {
+            options.runs = std::max(1, std::atoi(next()));
+        } else if (arg == "--root") {
+            options.root = next();
+        } else if (arg == "--keep") {
+            options.keep = true;
+        } else {
+            std::fprintf(stderr,
+                         "usage: %s [--depth N] [--width N] [--files N] [--threads N] "
+                         "[--runs N] [--root DIR] [--keep]\n",
+                         argv[0]);
+            return 1;
+        }
+    }
+
+    auto synthetic = options.root.empty();
+    if (synthetic) {
+        auto dir = fs::temp_directory_path() / "lsp-demo-scan-benchmark";
+        fs::remove_all(dir);
+        auto created = createTree(dir, options.depth, options);
+        std::printf("created %zu files, depth=%d width=%d files/dir=%d in %s\n", created,
+                    options.depth, options.width, options.files, dir.string().c_str());
+        options.root = dir.string();
+    }
+
+    report(options.root, 1, options.runs);
+    report(options.root, options.threads, options.runs);
+
+    if (synthetic && !options.keep) {
+        fs::remove_all(options.root);
+    }
+    return 0;
+}
@@ -0,0 +1,259 @@
+// Stress test of the LSP client against lsp_mock (Linux only).
+//
+// Each scenario starts lsp_mock with its load and drives LspClientImpl from a thread running
+// a Qt event loop, as the app does. Answers reach that thread through runOnUiThread as in
+// MainWindow, here counting how many callbacks wait in the queue. Reported per scenario:
+// requests per second, the time from request to callback on the UI thread, the deepest the
+// UI queue got, and resident memory across the rounds.
+//
+// usage: stress_benchmark [--scenario NAME] [--rounds N]
+
+#include <QCoreApplication>
+#include <QEventLoop>
+#include <QTimer>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "LatencyHistogram.hpp"
+#include "LspClientImpl.hpp"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr auto StartTimeout = std::chrono::seconds(5);
+constexpr auto RoundTimeout = std::chrono::seconds(30);
+constexpr auto DrainTimeout = std::chrono::seconds(5);
+constexpr int DocumentLines = 50;
+
+struct Scenario {
+    const char *name;
+    std::vector<std::string> mockArguments;
+    int documents = 0;
+    bool hovers = false;
+    bool tokens = false;
+};
+
+const Scenario Scenarios[] = {
+    // Far more requests than the scheduler lets out at once
+    {"concurrent", {"--latency", "exponential", "--latency-ms", "2"}, 2000, true, false},
+    {"large", {"--response-bytes", "4194304"}, 8, false, true},
+    {"flood",
+     {"--notifications-per-second", "20000", "--diagnostics", "20", "--latency-ms", "1"},
+     1000,
+     true,
+     false},
+    // Only semantic tokens report failed requests to their callback
+    {"errors", {"--error-rate", "0.3", "--latency", "uniform", "--latency-ms", "1"}, 500, false,
+     true},
+};
+
+std::atomic<int> queueDepth{0};
+std::atomic<int> maxQueueDepth{0};
+
+template <typename Func> void runOnUiThread(Func &&func) {
+    auto depth = ++queueDepth;
+    auto max = maxQueueDepth.load();
+    while (depth > max && !maxQueueDepth.compare_exchange_weak(max, depth)) {
+    }
+    QMetaObject::invokeMethod(
+        qApp,
+        [func = std::forward<Func>(func)]() mutable {
+            --queueDepth;
+            func();
+        },
+        Qt::QueuedConnection);
+}
+
+std::size_t residentBytes() {
+    auto statm = std::ifstream("/proc/self/statm");
+    auto size = std::size_t(0);
+    auto resident = std::size_t(0);
+    statm >> size >> resident;
+    return resident * std::size_t(::sysconf(_SC_PAGESIZE));
+}
+
+double mib(std::size_t bytes) { return bytes / (1024.0 * 1024.0); }
+
+// Runs the event loop until done() holds, false if timeout passed first
+bool waitFor(const std::function<bool()> &done, Clock::duration timeout) {
+    auto deadline = Clock::now() + timeout;
+    auto loop = QEventLoop();
+    auto poll = QTimer();
+    QObject::connect(&poll, &QTimer::timeout, [&] {
+        if (done() || Clock::now() >= deadline) {
+            loop.quit();
+        }
+    });
+    poll.start(1);
+    if (!done()) {
+        loop.exec();
+    }
+    return done();
+}
+
+// Only touched on the UI thread, shared with callbacks that may come after a timeout
+struct Progress {
+    int answered = 0;
+    int failed = 0;
+    std::size_t diagnostics = 0;
+    int diagnosticBatches = 0;
+    LatencyHistogram latency;
+};
+
+// False if the client did not get through the scenario
+bool run(const Scenario &scenario, int rounds) {
+    auto root = std::filesystem::temp_directory_path() / "stress_benchmark";
+    auto paths = std::vector<std::string>();
+    for (auto i = 0; i < scenario.documents; ++i) {
+        paths.push_back((root / ("doc" + std::to_string(i) + ".cpp")).string());
+    }
+    auto text = std::string();
+    for (auto line = 0; line < DocumentLines; ++line) {
+        text += "int value_" + std::to_string(line) + " = " + std::to_string(line) + ";\n";
+    }
+
+    queueDepth = 0;
+    maxQueueDepth = 0;
+    auto progress = std::make_shared<Progress>();
+    auto before = residentBytes();
+    auto peak = before;
+    auto firstRound = std::size_t(0);
+    auto lastRound = std::size_t(0);
+    auto requests = 0;
+    auto elapsed = Clock::duration();
+    {
+        auto client = LspClientImpl();
+        auto command = std::vector<std::string>{LSP_MOCK_PATH};
+        command.insert(command.end(), scenario.mockArguments.begin(),
+                       scenario.mockArguments.end());
+        client.setServerCommand(std::move(command));
+        client.onDiagnostics([&client, progress] {
+            runOnUiThread([&client, progress] {
+                progress->diagnostics += client.takeDiagnostics().size();
+                ++progress->diagnosticBatches;
+            });
+        });
+        client.startClangd();
+        client.setDocumentRoot(root.string());
+        auto ready = [&client] {
+            return client.incrementalSync() && !client.semanticTokensLegend().tokenTypes.empty();
+        };
+        if (!waitFor(ready, StartTimeout)) {
+            std::fprintf(stderr, "%s: lsp_mock did not initialize\n", scenario.name);
+            client.stopClangd();
+            waitFor([] { return queueDepth == 0; }, DrainTimeout);
+            return false;
+        }
+        for (auto const &path : paths) {
+            client.openDocument(path, text);
+        }
+
+        auto start = Clock::now();
+        for (auto round = 0; round < rounds; ++round) {
+            for (auto const &path : paths) {
+                auto sent = Clock::now();
+                if (scenario.hovers) {
+                    ++requests;
+                    client.hover(path, round % DocumentLines, 4,
+                                 [progress, sent](std::string &&) {
+                                     runOnUiThread([progress, sent] {
+                                         ++progress->answered;
+                                         progress->latency.record(Clock::now() - sent);
+                                     });
+                                 });
+                }
+                if (scenario.tokens) {
+                    ++requests;
+                    client.semanticTokens(
+                        path, {}, [progress, sent](std::optional<SemanticTokensUpdate> &&update) {
+                            auto succeeded = update.has_value();
+                            runOnUiThread([progress, sent, succeeded] {
+                                ++progress->answered;
+                                if (succeeded) {
+                                    progress->latency.record(Clock::now() - sent);
+                                } else {
+                                    ++progress->failed;
+                                }
+                            });
+                        });
+                }
+            }
+            if (!waitFor([&] { return progress->answered == requests; }, RoundTimeout)) {
+                std::fprintf(stderr, "%s: %d requests unanswered after round %d\n",
+                             scenario.name, requests - progress->answered, round + 1);
+                break;
+            }
+            auto resident = residentBytes();
+            peak = std::max(peak, resident);
+            (round == 0 ? firstRound : lastRound) = resident;
+        }
+        elapsed = Clock::now() - start;
+
+        client.shutdownLspServer();
+        client.stopClangd();
+        // Queued callbacks still refer to the client
+        waitFor([] { return queueDepth == 0; }, DrainTimeout);
+    }
+    auto after = residentBytes();
+
+    auto seconds = std::max(std::chrono::duration<double>(elapsed).count(), 1e-9);
+    std::printf("%s: %d requests in %.2f s, %.0f requests/s, %d failed\n", scenario.name,
+                requests, seconds, progress->answered / seconds, progress->failed);
+    std::printf("  latency to UI thread: %s\n", progress->latency.summary().c_str());
+    std::printf("  UI queue: max depth %d\n", maxQueueDepth.load());
+    std::printf("  diagnostics: %zu documents in %d batches\n", progress->diagnostics,
+                progress->diagnosticBatches);
+    std::printf("  resident: %.1f MiB before, %.1f MiB peak, %+.1f MiB from first to last "
+                "round, %.1f MiB after\n",
+                mib(before), mib(peak), lastRound ? mib(lastRound) - mib(firstRound) : 0.0,
+                mib(after));
+    return progress->answered == requests;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    auto only = std::string();
+    auto rounds = 5;
+    for (auto i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--scenario") == 0 && i + 1 < argc) {
+            only = argv[++i];
+        } else if (std::strcmp(argv[i], "--rounds") == 0 && i + 1 < argc) {
+            rounds = std::max(std::atoi(argv[++i]), 1);
+        } else {
+            std::fprintf(stderr, "usage: %s [--scenario NAME] [--rounds N]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    // The client's callbacks are handed to this thread as in the app
+    QCoreApplication app(argc, argv);
+    auto succeeded = true;
+    auto ran = false;
+    for (auto const &scenario : Scenarios) {
+        if (!only.empty() && only != scenario.name) {
+            continue;
+        }
+        ran = true;
+        succeeded = run(scenario, rounds) && succeeded;
+    }
+    if (!ran) {
+        std::fprintf(stderr, "No scenario named %s\n", only.c_str());
+        return 1;
+    }
+    return succeeded ? 0 : 1;
+}
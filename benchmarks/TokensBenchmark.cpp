@@ -0,0 +1,162 @@
+// Microbenchmark for SemanticTokens.
+//
+// Simulates typing in a large file: every keystroke changes the tokens of one line, or
+// inserts or deletes a line and moves the tokens behind it, and the server sends either all
+// tokens or a delta. Measures applying both, and checks that the delta path ends with the
+// same tokens and reports the edited lines.
+//
+// usage: tokens_benchmark [--lines N] [--edits N]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <span>
+#include <vector>
+
+#include "SemanticTokens.hpp"
+
+struct SyntheticLine {
+    std::uint32_t type = 0;
+    int count = 0;
+};
+
+// A few tokens per line, all of a line with the type given for it
+static std::vector<std::uint32_t> syntheticTokens(const std::vector<SyntheticLine> &lines) {
+    auto data = std::vector<std::uint32_t>();
+    data.reserve(lines.size() * 4 * 5);
+    auto previousLine = 0;
+    for (auto line = 0; line < int(lines.size()); ++line) {
+        auto column = 0u;
+        for (auto i = 0; i < lines[line].count; ++i) {
+            auto deltaLine = std::uint32_t(line - previousLine);
+            auto start = 4u + std::uint32_t(i) * 8u;
+            data.insert(data.end(), {deltaLine, deltaLine > 0 ? start : start - column, 5,
+                                     lines[line].type, 0});
+            previousLine = line;
+            column = start;
+        }
+    }
+    return data;
+}
+
+static bool sameTokens(std::span<const SemanticTokens::Token> a,
+                       std::span<const SemanticTokens::Token> b) {
+    return std::equal(a.begin(), a.end(), b.begin(), b.end(), [](auto const &x, auto const &y) {
+        return x.line == y.line && x.start == y.start && x.length == y.length &&
+               x.type == y.type && x.modifiers == y.modifiers;
+    });
+}
+
+int main(int argc, char *argv[]) {
+    auto lines = 20000;
+    auto edits = 1000;
+    for (auto i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--lines") == 0 && i + 1 < argc) {
+            lines = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--edits") == 0 && i + 1 < argc) {
+            edits = std::atoi(argv[++i]);
+        } else {
+            std::fprintf(stderr, "usage: %s [--lines N] [--edits N]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (lines < 1) {
+        lines = 1;
+    }
+
+    using Clock = std::chrono::steady_clock;
+    auto full = SemanticTokens();
+    auto delta = SemanticTokens();
+    auto synthetic = std::vector<SyntheticLine>(std::size_t(lines));
+    for (auto line = 0; line < lines; ++line) {
+        synthetic[line] = {std::uint32_t(line % 7), 1 + line % 4};
+    }
+    auto previous = syntheticTokens(synthetic);
+    full.replace(previous);
+    delta.replace(previous);
+    full.takeChangedLines();
+    delta.takeChangedLines();
+
+    auto fullTime = Clock::duration();
+    auto deltaTime = Clock::duration();
+    auto fullLinesChanged = 0LL;
+    auto deltaLinesChanged = 0LL;
+    auto failures = 0;
+    for (auto i = 0; i < edits; ++i) {
+        auto editedLine = int((i * 7919LL) % synthetic.size());
+        auto type = 100 + std::uint32_t(i);
+        // A changed line, then a line break typed, then a line joined with the next one, so
+        // the file keeps its size
+        auto kind = i % 3;
+        if (kind == 0) {
+            synthetic[editedLine].type = type;
+        } else if (kind == 1) {
+            synthetic.insert(synthetic.begin() + editedLine, {type, 1 + i % 4});
+        } else if (synthetic.size() > 1) {
+            synthetic.erase(synthetic.begin() + editedLine);
+            editedLine = std::min(editedLine, int(synthetic.size()) - 1);
+        }
+        auto next = syntheticTokens(synthetic);
+
+        // What a server sends: the differing part of the array
+        auto prefix = std::size_t(0);
+        while (prefix < previous.size() && prefix < next.size() &&
+               previous[prefix] == next[prefix]) {
+            ++prefix;
+        }
+        prefix -= prefix % 5;
+        auto suffix = std::size_t(0);
+        while (suffix + prefix < previous.size() && suffix + prefix < next.size() &&
+               previous[previous.size() - 1 - suffix] == next[next.size() - 1 - suffix]) {
+            ++suffix;
+        }
+        suffix -= suffix % 5;
+        auto edit = SemanticTokens::Edit{
+            std::uint32_t(prefix), std::uint32_t(previous.size() - prefix - suffix),
+            std::vector<std::uint32_t>(next.begin() + std::ptrdiff_t(prefix),
+                                       next.end() - std::ptrdiff_t(suffix))};
+
+        auto start = Clock::now();
+        full.replace(next);
+        for (auto const &range : full.takeChangedLines()) {
+            fullLinesChanged += range.last - range.first + 1;
+        }
+        fullTime += Clock::now() - start;
+
+        start = Clock::now();
+        if (!delta.apply({edit})) {
+            ++failures;
+        }
+        auto reported = false;
+        for (auto const &range : delta.takeChangedLines()) {
+            deltaLinesChanged += range.last - range.first + 1;
+            reported = reported || (range.first <= editedLine && editedLine <= range.last);
+        }
+        deltaTime += Clock::now() - start;
+
+        // A deleted line only moves the tokens behind it, there may be nothing to report
+        failures += reported || kind == 2 ? 0 : 1;
+        auto tokens = delta.line(editedLine);
+        failures += kind != 2 && (tokens.empty() || tokens[0].type != type) ? 1 : 0;
+        failures += sameTokens(tokens, full.line(editedLine)) ? 0 : 1;
+        previous = std::move(next);
+    }
+    for (auto line = 0; line < int(synthetic.size()); ++line) {
+        failures += sameTokens(delta.line(line), full.line(line)) ? 0 : 1;
+    }
+    failures += full.size() != delta.size() ? 1 : 0;
+
+    auto perEdit = [&](Clock::duration time) {
+        return std::chrono::duration<double, std::micro>(time).count() / std::max(edits, 1);
+    };
+    std::printf("%d lines, %zu tokens, %d edits\n", lines, delta.size(), edits);
+    std::printf("full:  %8.1f us/edit, %lld lines reported\n", perEdit(fullTime),
+                fullLinesChanged);
+    std::printf("delta: %8.1f us/edit, %lld lines reported\n", perEdit(deltaTime),
+                deltaLinesChanged);
+    std::printf("%d failures\n", failures);
+    return failures == 0 ? 0 : 1;
+}
@@ -1,18 +1,48 @@
 #include "AppOutputRedirector.hpp"
-#include <QCoreApplication>
-#include <QThread>
+#include <QTimer>
+
+#include <cstring>
 #ifdef _WIN32
 #include <io.h>
 #include <fcntl.h>
-#include <QTimer>
 #else
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
 #include <unistd.h>
-#include <QSocketNotifier>
 #endif
 
+namespace {
+
+// Lines queued between two frames before further ones are dropped
+constexpr std::size_t RingLines = 16384;
+// The view is updated at most this often
+constexpr int FrameMs = 16;
+// A longer line without a newline is cut here
+constexpr qsizetype MaxLineBytes = 64 * 1024;
+constexpr std::size_t ReadBytes = 64 * 1024;
+
+#ifndef _WIN32
+bool openPipe(int fds[2])
+{
+    if (::pipe(fds) != 0) {
+        return false;
+    }
+    ::fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    ::fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+    return true;
+}
+#endif
+
+} // namespace
+
 AppOutputRedirector::AppOutputRedirector(QObject* parent)
-    : QObject(parent)
+    : QObject(parent), ring(RingLines)
 {
+    flushTimer = new QTimer(this);
+    flushTimer->setSingleShot(true);
+    flushTimer->setInterval(FrameMs);
+    connect(flushTimer, &QTimer::timeout, this, &AppOutputRedirector::flush);
     setup();
 }
 
@@ -24,71 +54,191 @@ AppOutputRedirector::~AppOutputRedirector()
 void AppOutputRedirector::setup()
 {
 #ifdef _WIN32
-    // stdout
-    if (_pipe(outPipe, 4096, _O_BINARY) == 0) {
-        _dup2(outPipe[1], _fileno(stdout));
-        outTimer = new QTimer(this);
-        connect(outTimer, &QTimer::timeout, this, [this]() {
-            char buf[4096];
-            int n = _read(outPipe[0], buf, sizeof(buf));
-            if (n > 0)
-                emit newStdout(QString::fromLocal8Bit(buf, n));
-        });
-        outTimer->start(100);
-    }
-    // stderr
-    if (_pipe(errPipe, 4096, _O_BINARY) == 0) {
-        _dup2(errPipe[1], _fileno(stderr));
-        errTimer = new QTimer(this);
-        connect(errTimer, &QTimer::timeout, this, [this]() {
-            char buf[4096];
-            int n = _read(errPipe[0], buf, sizeof(buf));
-            if (n > 0)
-                emit newStderr(QString::fromLocal8Bit(buf, n));
-        });
-        errTimer->start(100);
+    for (auto& pipe : pipes) {
+        if (redirect(pipe)) {
+            threads.emplace_back([this, &pipe] { drain(pipe); });
+        }
     }
 #else
-    // stdout
-    if (::pipe(outPipe) == 0) {
-        ::dup2(outPipe[1], STDOUT_FILENO);
-        outNotifier = new QSocketNotifier(outPipe[0], QSocketNotifier::Read, this);
-        connect(outNotifier, &QSocketNotifier::activated, this, [this](int) {
-            char buf[4096];
-            ssize_t n = ::read(outPipe[0], buf, sizeof(buf));
-            if (n > 0)
-                emit newStdout(QString::fromLocal8Bit(buf, n));
-        });
-    }
-    // stderr
-    if (::pipe(errPipe) == 0) {
-        ::dup2(errPipe[1], STDERR_FILENO);
-        errNotifier = new QSocketNotifier(errPipe[0], QSocketNotifier::Read, this);
-        connect(errNotifier, &QSocketNotifier::activated, this, [this](int) {
-            char buf[4096];
-            ssize_t n = ::read(errPipe[0], buf, sizeof(buf));
-            if (n > 0)
-                emit newStderr(QString::fromLocal8Bit(buf, n));
-        });
+    auto redirected = false;
+    for (auto& pipe : pipes) {
+        redirected = redirect(pipe) || redirected;
+    }
+    if (!redirected) {
+        return;
+    }
+    if (openPipe(wakePipe)) {
+        threads.emplace_back([this] { drain(); });
+    } else {
+        // Nobody would read the pipes
+        cleanup();
     }
 #endif
 }
 
 void AppOutputRedirector::cleanup()
 {
+    // Later output goes where it went before
+    for (auto& pipe : pipes) {
+        if (pipe.savedFd == -1) {
+            continue;
+        }
+        std::fflush(pipe.file);
 #ifdef _WIN32
-    if (outTimer) outTimer->stop();
-    if (errTimer) errTimer->stop();
-    if (outPipe[0] != -1) _close(outPipe[0]);
-    if (outPipe[1] != -1) _close(outPipe[1]);
-    if (errPipe[0] != -1) _close(errPipe[0]);
-    if (errPipe[1] != -1) _close(errPipe[1]);
+        _dup2(pipe.savedFd, _fileno(pipe.file));
+        _close(pipe.savedFd);
+        // The reader sees the end of the pipe once no write end is left
+        _close(pipe.fds[1]);
+        pipe.fds[1] = -1;
 #else
-    if (outNotifier) outNotifier->setEnabled(false);
-    if (errNotifier) errNotifier->setEnabled(false);
-    if (outPipe[0] != -1) ::close(outPipe[0]);
-    if (outPipe[1] != -1) ::close(outPipe[1]);
-    if (errPipe[0] != -1) ::close(errPipe[0]);
-    if (errPipe[1] != -1) ::close(errPipe[1]);
+        ::dup2(pipe.savedFd, fileno(pipe.file));
+        ::close(pipe.savedFd);
 #endif
+        pipe.savedFd = -1;
+    }
+#ifndef _WIN32
+    // A server that inherited stderr may still hold the pipe, so the thread is woken directly
+    if (wakePipe[1] != -1) {
+        char byte = 0;
+        (void)::write(wakePipe[1], &byte, 1);
+    }
+#endif
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    threads.clear();
+    for (auto& pipe : pipes) {
+        for (auto& fd : pipe.fds) {
+            if (fd != -1) {
+#ifdef _WIN32
+                _close(fd);
+#else
+                ::close(fd);
+#endif
+                fd = -1;
+            }
+        }
+    }
+#ifndef _WIN32
+    for (auto& fd : wakePipe) {
+        if (fd != -1) {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+#endif
+}
+
+bool AppOutputRedirector::redirect(Pipe& pipe)
+{
+    std::fflush(pipe.file);
+#ifdef _WIN32
+    if (_pipe(pipe.fds, int(ReadBytes), _O_BINARY) != 0) {
+        return false;
+    }
+    pipe.savedFd = _dup(_fileno(pipe.file));
+    _dup2(pipe.fds[1], _fileno(pipe.file));
+#else
+    // Only the redirected stream itself is inherited by child processes
+    if (!openPipe(pipe.fds)) {
+        return false;
+    }
+    pipe.savedFd = ::fcntl(fileno(pipe.file), F_DUPFD_CLOEXEC, 0);
+    ::dup2(pipe.fds[1], fileno(pipe.file));
+#endif
+    if (pipe.file == stdout) {
+        // A pipe would make it fully buffered
+        std::setvbuf(pipe.file, nullptr, _IOLBF, BUFSIZ);
+    }
+    return true;
+}
+
+#ifdef _WIN32
+void AppOutputRedirector::drain(Pipe& pipe)
+{
+    auto buffer = std::vector<char>(ReadBytes);
+    int n;
+    while ((n = _read(pipe.fds[0], buffer.data(), unsigned(buffer.size()))) > 0) {
+        std::lock_guard lock(pushMutex);
+        split(pipe, buffer.data(), n);
+        notify();
+    }
+}
+#else
+void AppOutputRedirector::drain()
+{
+    pollfd fds[] = {{pipes[0].fds[0], POLLIN, 0},
+                    {pipes[1].fds[0], POLLIN, 0},
+                    {wakePipe[0], POLLIN, 0}};
+    auto buffer = std::vector<char>(ReadBytes);
+    for (;;) {
+        if (::poll(fds, 3, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        if (fds[2].revents != 0) {
+            return;
+        }
+        for (auto i = 0; i < 2; ++i) {
+            if (fds[i].revents == 0) {
+                continue;
+            }
+            auto n = ::read(fds[i].fd, buffer.data(), buffer.size());
+            if (n > 0) {
+                split(pipes[i], buffer.data(), n);
+                notify();
+            } else if (n == 0 || errno != EINTR) {
+                // Negative descriptors are ignored by poll
+                fds[i].fd = -1;
+            }
+        }
+    }
+}
+#endif
+
+void AppOutputRedirector::split(Pipe& pipe, const char* data, qsizetype size)
+{
+    auto end = data + size;
+    while (data != end) {
+        auto newline = static_cast<const char*>(std::memchr(data, '\n', std::size_t(end - data)));
+        auto lineEnd = newline ? newline : end;
+        pipe.partial.append(data, lineEnd - data);
+        data = newline ? newline + 1 : end;
+        if (!newline && pipe.partial.size() < MaxLineBytes) {
+            continue;
+        }
+        if (pipe.partial.endsWith('\r')) {
+            pipe.partial.chop(1);
+        }
+        if (!ring.tryPush({pipe.stream, QString::fromLocal8Bit(pipe.partial)})) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+        }
+        pipe.partial.clear();
+    }
+}
+
+void AppOutputRedirector::notify()
+{
+    // One queued start per flush, whatever the number of reads in between
+    if (!flushQueued.exchange(true)) {
+        QMetaObject::invokeMethod(flushTimer, qOverload<>(&QTimer::start), Qt::QueuedConnection);
+    }
+}
+
+void AppOutputRedirector::flush()
+{
+    // Cleared first, so lines pushed while taking them queue another flush
+    flushQueued.store(false);
+    auto lines = QList<OutputLine>();
+    while (auto line = ring.tryPop()) {
+        lines.append(std::move(*line));
+    }
+    if (auto count = dropped.exchange(0)) {
+        lines.append(OutputLine{OutputLine::Stream::Stderr, tr("[%1 lines dropped]").arg(count)});
+    }
+    if (!lines.isEmpty()) {
+        emit linesReady(lines);
+    }
 }
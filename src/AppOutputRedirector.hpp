@@ -1,7 +1,27 @@
 #pragma once
+#include <QByteArray>
+#include <QList>
 #include <QObject>
 #include <QString>
 
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <thread>
+#include <vector>
+#ifdef _WIN32
+#include <mutex>
+#endif
+
+#include "OutputModel.hpp"
+#include "SpscRing.hpp"
+
+class QTimer;
+
+// Redirects stdout and stderr, which a spawned server inherits, into pipes drained by a
+// background thread. The output is split into lines there and queued in a bounded ring, the
+// UI thread takes the lines at most once per frame. If the UI falls behind, lines are
+// dropped and counted instead of blocking the writers.
 class AppOutputRedirector : public QObject {
     Q_OBJECT
 public:
@@ -9,21 +29,42 @@ public:
     ~AppOutputRedirector();
 
 signals:
-    void newStdout(const QString&);
-    void newStderr(const QString&);
+    // Everything written since the last time, oldest first
+    void linesReady(const QList<OutputLine>& lines);
 
 private:
+    struct Pipe {
+        OutputLine::Stream stream;
+        FILE* file;
+        int fds[2] = {-1, -1};
+        // The descriptor the stream had before, restored by cleanup()
+        int savedFd = -1;
+        QByteArray partial;
+    };
+
+    Pipe pipes[2] = {{OutputLine::Stream::Stdout, stdout}, {OutputLine::Stream::Stderr, stderr}};
+    SpscRing<OutputLine> ring;
+    std::atomic<std::uint64_t> dropped = 0;
+    std::atomic<bool> flushQueued = false;
+    QTimer* flushTimer = nullptr;
+    std::vector<std::thread> threads;
 #ifdef _WIN32
-    int outPipe[2] = {-1, -1};
-    int errPipe[2] = {-1, -1};
-    class QTimer* outTimer = nullptr;
-    class QTimer* errTimer = nullptr;
+    // One thread per pipe, their pushes into the ring are serialised
+    std::mutex pushMutex;
 #else
-    int outPipe[2] = {-1, -1};
-    int errPipe[2] = {-1, -1};
-    class QSocketNotifier* outNotifier = nullptr;
-    class QSocketNotifier* errNotifier = nullptr;
+    // Written to stop the thread
+    int wakePipe[2] = {-1, -1};
 #endif
+
     void setup();
     void cleanup();
+    bool redirect(Pipe& pipe);
+#ifdef _WIN32
+    void drain(Pipe& pipe);
+#else
+    void drain();
+#endif
+    void split(Pipe& pipe, const char* data, qsizetype size);
+    void notify();
+    void flush();
 };
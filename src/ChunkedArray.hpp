@@ -0,0 +1,31 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <memory>
+
+// Array that only grows, in chunks that are allocated once and never move.
+//
+// Elements below the size a reader was handed stay where they are and unchanged while a
+// writer appends behind them, so readers on other threads need no lock. Handing the size over
+// (a queued signal, a mutex) makes the elements below it visible.
+template <typename T, std::size_t ChunkSize, std::size_t MaxChunks> class ChunkedArray {
+  public:
+    static constexpr std::size_t capacity() { return ChunkSize * MaxChunks; }
+
+    const T &operator[](std::size_t index) const {
+        return chunks[index / ChunkSize][index % ChunkSize];
+    }
+    T &operator[](std::size_t index) { return chunks[index / ChunkSize][index % ChunkSize]; }
+
+    // Allocates the chunk of index, the writer calls it before writing there
+    void ensure(std::size_t index) {
+        auto &chunk = chunks[index / ChunkSize];
+        if (!chunk) {
+            chunk = std::make_unique<T[]>(ChunkSize);
+        }
+    }
+
+  private:
+    std::array<std::unique_ptr<T[]>, MaxChunks> chunks;
+};
@@ -1,12 +1,93 @@
 #include "CodeEditor.hpp"
+#include "DiagnosticStore.hpp"
 #include <QHelpEvent>
+#include <QTextBlock>
 #include <QTextCursor>
 #include <QToolTip>
 
+#include <algorithm>
+
+namespace {
+
+QColor severityColor(Diagnostic::Severity severity)
+{
+    switch (severity) {
+    case Diagnostic::Severity::Error:
+        return Qt::red;
+    case Diagnostic::Severity::Warning:
+        return QColor(0xe0, 0x90, 0x00);
+    case Diagnostic::Severity::Information:
+        return Qt::blue;
+    case Diagnostic::Severity::Hint:
+        break;
+    }
+    return Qt::gray;
+}
+
+} // namespace
+
 CodeEditor::CodeEditor(QWidget* parent)
     : QPlainTextEdit(parent)
 {
     setMouseTracking(true);
+    // Sent for scrolling, resizing and edits alike, nothing is done unless the visible lines
+    // changed
+    connect(this, &QPlainTextEdit::updateRequest, this,
+            [this](const QRect&, int) { updateDiagnosticSelections(false); });
+}
+
+void CodeEditor::setDiagnostics(std::shared_ptr<const DocumentDiagnostics> newDiagnostics)
+{
+    diagnostics = std::move(newDiagnostics);
+    updateDiagnosticSelections(true);
+}
+
+void CodeEditor::updateDiagnosticSelections(bool force)
+{
+    auto block = firstVisibleBlock();
+    auto firstLine = block.blockNumber();
+    auto lastLine = firstLine;
+    auto top = blockBoundingGeometry(block).translated(contentOffset()).top();
+    auto height = viewport()->height();
+    for (auto line = firstLine; block.isValid() && top <= height; ++line) {
+        lastLine = line;
+        top += blockBoundingRect(block).height();
+        block = block.next();
+    }
+    if (!force && firstLine == diagnosticsFirstLine && lastLine == diagnosticsLastLine) {
+        return;
+    }
+    diagnosticsFirstLine = firstLine;
+    diagnosticsLastLine = lastLine;
+
+    auto selections = QList<QTextEdit::ExtraSelection>();
+    if (diagnostics) {
+        auto doc = document();
+        auto position = [doc](int line, int column) {
+            auto block = doc->findBlockByNumber(line);
+            if (!block.isValid()) {
+                return doc->characterCount() - 1;
+            }
+            return block.position() + std::clamp(column, 0, block.length() - 1);
+        };
+        for (auto diagnostic : diagnostics->inLines(firstLine, lastLine)) {
+            auto selection = QTextEdit::ExtraSelection();
+            selection.cursor = QTextCursor(doc);
+            auto start = position(diagnostic->startLine, diagnostic->startColumn);
+            selection.cursor.setPosition(start);
+            selection.cursor.setPosition(position(diagnostic->endLine, diagnostic->endColumn),
+                                         QTextCursor::KeepAnchor);
+            if (!selection.cursor.hasSelection()) {
+                // Point diagnostics mark the character they point at
+                selection.cursor.movePosition(QTextCursor::NextCharacter, QTextCursor::KeepAnchor);
+            }
+            selection.format.setUnderlineStyle(QTextCharFormat::SpellCheckUnderline);
+            selection.format.setUnderlineColor(severityColor(diagnostic->severity));
+            selection.format.setToolTip(QString::fromStdString(diagnostic->message));
+            selections.append(selection);
+        }
+    }
+    setExtraSelections(selections);
 }
 
 bool CodeEditor::event(QEvent* e)
@@ -19,7 +100,9 @@ bool CodeEditor::event(QEvent* e)
         
         if (lastWordHovered != word) {
             auto line = cursor.blockNumber();
-            auto col = cursor.positionInBlock();
+            // The start of the word, the cursor is at its end and the server's range for
+            // the symbol ends before that
+            auto col = cursor.selectionStart() - cursor.block().position();
             lastWordHovered = word;
             emit hoveredWordTooltip(word, line, col, helpEvent->globalPos());
 /*    
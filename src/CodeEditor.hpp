@@ -2,15 +2,31 @@
 #include <QPlainTextEdit>
 #include <QString>
 
+#include <memory>
+
+class DocumentDiagnostics;
+
 class CodeEditor : public QPlainTextEdit {
     Q_OBJECT
 public:
     explicit CodeEditor(QWidget* parent = nullptr);
 
+    // Only the diagnostics on visible lines are turned into extra selections, again when
+    // the view scrolls
+    void setDiagnostics(std::shared_ptr<const DocumentDiagnostics> diagnostics);
+
 signals:
     void hoveredWordTooltip(const QString& word, int line, int column, const QPoint& globalPos);
 
 protected:
     bool event(QEvent* e) override;
     QString lastWordHovered;
+
+private:
+    void updateDiagnosticSelections(bool force);
+
+    std::shared_ptr<const DocumentDiagnostics> diagnostics;
+    // Lines the current selections were made for
+    int diagnosticsFirstLine = -1;
+    int diagnosticsLastLine = -1;
 };
@@ -0,0 +1,124 @@
+#include "CppLexer.hpp"
+
+#include <algorithm>
+#include <array>
+#include <string_view>
+
+namespace {
+
+// Sorted, for binary search
+constexpr auto Keywords = std::to_array<std::string_view>({
+    "alignas", "alignof", "auto", "bool", "break", "case", "catch", "char", "char16_t", "char32_t",
+    "char8_t", "class", "co_await", "co_return", "co_yield", "concept", "const", "const_cast",
+    "consteval", "constexpr", "constinit", "continue", "decltype", "default", "delete", "do",
+    "double", "dynamic_cast", "else", "enum", "explicit", "export", "extern", "false", "final",
+    "float", "for", "friend", "goto", "if", "inline", "int", "long", "mutable", "namespace", "new",
+    "noexcept", "nullptr", "operator", "override", "private", "protected", "public", "register",
+    "reinterpret_cast", "requires", "return", "short", "signed", "sizeof", "static",
+    "static_assert", "static_cast", "struct", "switch", "template", "this", "thread_local",
+    "throw", "true", "try", "typedef", "typeid", "typename", "union", "unsigned", "using",
+    "virtual", "void", "volatile", "wchar_t", "while",
+});
+
+constexpr qsizetype MaxKeywordLength = 16;
+
+inline bool isIdentifierStart(QChar c) { return c.isLetter() || c == '_'; }
+
+inline bool isIdentifierPart(QChar c) { return c.isLetterOrNumber() || c == '_'; }
+
+} // namespace
+
+bool CppLexer::isKeyword(QStringView word) {
+    if (word.size() > MaxKeywordLength) {
+        return false;
+    }
+    char latin[MaxKeywordLength];
+    for (auto i = 0; i < word.size(); ++i) {
+        if (word[i].unicode() > 0x7f) {
+            return false;
+        }
+        latin[i] = char(word[i].unicode());
+    }
+    return std::binary_search(Keywords.begin(), Keywords.end(),
+                              std::string_view(latin, std::size_t(word.size())));
+}
+
+CppLexer::State CppLexer::lexLine(QStringView line, State state, QList<Span> &spans) {
+    auto size = line.size();
+    auto i = qsizetype(0);
+    if (state == InComment) {
+        auto end = line.indexOf(u"*/");
+        if (end == -1) {
+            spans.append({0, size, Kind::Comment});
+            return InComment;
+        }
+        spans.append({0, end + 2, Kind::Comment});
+        i = end + 2;
+    }
+
+    // A directive is coloured as a whole, comments and strings in it are still found below
+    auto firstNonSpace = i;
+    while (firstNonSpace < size && line[firstNonSpace].isSpace()) {
+        ++firstNonSpace;
+    }
+    if (firstNonSpace < size && line[firstNonSpace] == '#') {
+        auto end = firstNonSpace + 1;
+        while (end < size && line[end].isSpace()) {
+            ++end;
+        }
+        while (end < size && isIdentifierPart(line[end])) {
+            ++end;
+        }
+        spans.append({firstNonSpace, end - firstNonSpace, Kind::Preprocessor});
+        i = end;
+    }
+
+    while (i < size) {
+        auto c = line[i];
+        if (c == '/' && i + 1 < size && line[i + 1] == '/') {
+            spans.append({i, size - i, Kind::Comment});
+            return Normal;
+        }
+        if (c == '/' && i + 1 < size && line[i + 1] == '*') {
+            auto end = line.indexOf(u"*/", i + 2);
+            if (end == -1) {
+                spans.append({i, size - i, Kind::Comment});
+                return InComment;
+            }
+            spans.append({i, end + 2 - i, Kind::Comment});
+            i = end + 2;
+        } else if (c == '"' || c == '\'') {
+            auto end = i + 1;
+            while (end < size && line[end] != c) {
+                end += line[end] == '\\' ? 2 : 1;
+            }
+            end = std::min(end + 1, size);
+            spans.append({i, end - i, Kind::String});
+            i = end;
+        } else if (c.isDigit() || (c == '.' && i + 1 < size && line[i + 1].isDigit())) {
+            auto end = i + 1;
+            // Covers hex, suffixes, separators and exponents well enough for colouring
+            while (end < size && (isIdentifierPart(line[end]) || line[end] == '.' ||
+                                  line[end] == '\'' ||
+                                  ((line[end] == '+' || line[end] == '-') &&
+                                   (line[end - 1] == 'e' || line[end - 1] == 'E' ||
+                                    line[end - 1] == 'p' || line[end - 1] == 'P')))) {
+                ++end;
+            }
+            spans.append({i, end - i, Kind::Number});
+            i = end;
+        } else if (isIdentifierStart(c)) {
+            auto end = i + 1;
+            while (end < size && isIdentifierPart(line[end])) {
+                ++end;
+            }
+            if (isKeyword(line.sliced(i, end - i))) {
+                spans.append({i, end - i, Kind::Keyword});
+            }
+            i = end;
+        } else {
+            ++i;
+        }
+    }
+    return Normal;
+}
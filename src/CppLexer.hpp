@@ -0,0 +1,29 @@
+#pragma once
+
+#include <QList>
+#include <QStringView>
+
+// A line based C/C++ lexer, used to highlight a document before the server sent semantic
+// tokens and for lines edited since.
+//
+// It only knows what can be told from the text alone: keywords, comments, string and
+// character literals, numbers and preprocessor directives. A line is lexed on its own, the
+// only state carried to the next line is whether a block comment is still open, so
+// re-lexing one line costs the same however long the document is.
+class CppLexer {
+  public:
+    enum class Kind { Keyword, Comment, String, Number, Preprocessor };
+
+    struct Span {
+        qsizetype start = 0;
+        qsizetype length = 0;
+        Kind kind = Kind::Keyword;
+    };
+
+    enum State { Normal = 0, InComment = 1 };
+
+    // Appends the spans of line to spans and returns the state at its end
+    static State lexLine(QStringView line, State state, QList<Span> &spans);
+
+    static bool isKeyword(QStringView word);
+};
@@ -0,0 +1,70 @@
+#include "DiagnosticStore.hpp"
+
+#include <algorithm>
+
+DocumentDiagnostics::DocumentDiagnostics(std::optional<int> version,
+                                         std::vector<Diagnostic> list)
+    : documentVersion(version), diagnostics(std::move(list)) {
+    std::stable_sort(diagnostics.begin(), diagnostics.end(),
+                     [](const Diagnostic &a, const Diagnostic &b) {
+                         return a.startLine < b.startLine ||
+                                (a.startLine == b.startLine && a.startColumn < b.startColumn);
+                     });
+    maxEndLine.reserve(diagnostics.size());
+    auto maxEnd = -1;
+    for (auto const &diagnostic : diagnostics) {
+        maxEnd = std::max(maxEnd, diagnostic.endLine);
+        maxEndLine.push_back(maxEnd);
+    }
+}
+
+std::size_t DocumentDiagnostics::count(Diagnostic::Severity severity) const {
+    return std::size_t(std::count_if(
+        diagnostics.begin(), diagnostics.end(),
+        [severity](const Diagnostic &diagnostic) { return diagnostic.severity == severity; }));
+}
+
+std::vector<const Diagnostic *> DocumentDiagnostics::inLines(int first, int last) const {
+    auto found = std::vector<const Diagnostic *>();
+    // Everything from here on starts below the range
+    auto end = std::upper_bound(diagnostics.begin(), diagnostics.end(), last,
+                                [](int line, const Diagnostic &diagnostic) {
+                                    return line < diagnostic.startLine;
+                                }) -
+               diagnostics.begin();
+    // Walking back, once no diagnostic before reaches the range none further back does
+    for (auto i = end - 1; i >= 0 && maxEndLine[std::size_t(i)] >= first; --i) {
+        if (diagnostics[std::size_t(i)].endLine >= first) {
+            found.push_back(&diagnostics[std::size_t(i)]);
+        }
+    }
+    std::reverse(found.begin(), found.end());
+    return found;
+}
+
+bool DiagnosticStore::publish(const std::string &fileName,
+                              std::shared_ptr<const DocumentDiagnostics> diagnostics) {
+    auto it = byFile.find(fileName);
+    if (it != byFile.end() && diagnostics->version() && it->second->version() &&
+        *diagnostics->version() < *it->second->version()) {
+        return false;
+    }
+    if (diagnostics->empty()) {
+        if (it != byFile.end()) {
+            byFile.erase(it);
+        }
+    } else if (it != byFile.end()) {
+        it->second = std::move(diagnostics);
+    } else {
+        byFile.emplace(fileName, std::move(diagnostics));
+    }
+    return true;
+}
+
+std::shared_ptr<const DocumentDiagnostics> DiagnosticStore::find(
+    const std::string &fileName) const {
+    auto it = byFile.find(fileName);
+    return it != byFile.end() ? it->second : nullptr;
+}
+
+void DiagnosticStore::clear() { byFile.clear(); }
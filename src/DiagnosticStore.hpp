@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// One diagnostic of a document. Lines and columns are zero based, columns count UTF-16 code
+// units as required by LSP.
+struct Diagnostic {
+    enum class Severity { Error = 1, Warning, Information, Hint };
+
+    int startLine = 0;
+    int startColumn = 0;
+    int endLine = 0;
+    int endColumn = 0;
+    Severity severity = Severity::Error;
+    std::string message;
+};
+
+// The diagnostics the server published for one version of a document.
+//
+// Immutable once built, so the reader thread builds it and the UI thread and every editor
+// of the document share it. The diagnostics are sorted by start line, next to the largest
+// end line among each prefix, which makes finding the ones touching a range of lines a
+// binary search plus a walk over the ones that can reach into it.
+class DocumentDiagnostics {
+  public:
+    DocumentDiagnostics(std::optional<int> version, std::vector<Diagnostic> diagnostics);
+
+    std::optional<int> version() const { return documentVersion; }
+    bool empty() const { return diagnostics.empty(); }
+    std::size_t size() const { return diagnostics.size(); }
+    std::size_t count(Diagnostic::Severity severity) const;
+
+    // Diagnostics touching any line from first to last, ordered by start
+    std::vector<const Diagnostic *> inLines(int first, int last) const;
+
+  private:
+    std::optional<int> documentVersion;
+    std::vector<Diagnostic> diagnostics;
+    std::vector<int> maxEndLine;
+};
+
+// The latest diagnostics of every document, keyed by file name. Not thread safe.
+class DiagnosticStore {
+  public:
+    // Keeps diagnostics unless they are for an older version than the ones stored. Empty
+    // diagnostics remove the document.
+    bool publish(const std::string &fileName,
+                 std::shared_ptr<const DocumentDiagnostics> diagnostics);
+    // Null if the document has none
+    std::shared_ptr<const DocumentDiagnostics> find(const std::string &fileName) const;
+    void clear();
+
+    std::size_t documents() const { return byFile.size(); }
+
+  private:
+    std::unordered_map<std::string, std::shared_ptr<const DocumentDiagnostics>> byFile;
+};
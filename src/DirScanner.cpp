@@ -0,0 +1,453 @@
+#include "DirScanner.hpp"
+#include "IgnoreRules.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <iterator>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+
+#if defined(__linux__)
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#else
+#include <filesystem>
+#endif
+
+ScanThrottle::ScanThrottle(std::size_t maxInFlight)
+    : maxInFlight(std::max<std::size_t>(1, maxInFlight)) {}
+
+bool ScanThrottle::acquire() {
+    auto lock = std::unique_lock(mutex);
+    cond.wait(lock, [this] { return inFlight < maxInFlight || isCancelled(); });
+    if (isCancelled()) {
+        return false;
+    }
+    ++inFlight;
+    return true;
+}
+
+void ScanThrottle::release() {
+    {
+        auto lock = std::lock_guard(mutex);
+        if (inFlight > 0) {
+            --inFlight;
+        }
+    }
+    cond.notify_one();
+}
+
+void ScanThrottle::cancel() {
+    {
+        auto lock = std::lock_guard(mutex);
+        cancelled = true;
+    }
+    cond.notify_all();
+}
+
+namespace {
+
+#if defined(__linux__)
+std::int64_t toNanoseconds(const struct timespec &ts) {
+    return static_cast<std::int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+#endif
+
+// A directory to list and the ignore rules in effect in its parent
+struct ScanItem {
+    std::string relDir;
+    std::shared_ptr<const IgnoreRules> rules;
+};
+
+struct WorkerQueue {
+    std::mutex mutex;
+    std::deque<ScanItem> dirs;
+};
+
+// State of a single DirScanner::scan() call. Each queued item holds the relative path of a
+// directory, either empty (the root) or ending with `/`, so children just append their name.
+class ScanRun {
+  public:
+    ScanRun(const std::string &rootDir, const DirScanner::Options &options,
+            const DirScanner::BatchSink &sink, const DirScanner &scanner)
+        : rootPrefix(rootDir), options(options), sink(sink), scanner(scanner) {
+        if (!rootPrefix.empty() && rootPrefix.back() != '/') {
+            rootPrefix.push_back('/');
+        }
+        auto threads = options.threads;
+        if (threads == 0) {
+            threads = std::clamp(std::thread::hardware_concurrency(), 1u, 8u);
+        }
+        queues = std::vector<WorkerQueue>(threads);
+    }
+
+    DirScanner::Stats run(std::vector<std::string> &&startDirs) {
+        for (auto &dir : startDirs) {
+            auto rules = options.respectIgnoreFiles ? parentRules(dir) : nullptr;
+            push(0, {std::move(dir), std::move(rules)});
+        }
+        if (pendingDirs.load() == 0) {
+            return {};
+        }
+        auto threads = std::vector<std::thread>();
+        for (auto i = 1u; i < queues.size(); ++i) {
+            threads.emplace_back(&ScanRun::workerMain, this, i);
+        }
+        workerMain(0);
+        for (auto &t : threads) {
+            t.join();
+        }
+        return {files.load(), directories.load(), steals.load(),
+                static_cast<unsigned>(queues.size())};
+    }
+
+  private:
+    bool stopped() const { return scanner.isCancelled() || done.load(std::memory_order_acquire); }
+
+    // Rules of all directories above relDir, for scans that start below the root
+    std::shared_ptr<const IgnoreRules> parentRules(const std::string &relDir) {
+        if (relDir.empty()) {
+            return IgnoreRules::forExcludeFile(rootPrefix);
+        }
+        auto parent = relDir.substr(0, relDir.rfind('/', relDir.size() - 2) + 1);
+        auto it = startRules.find(parent);
+        if (it == startRules.end()) {
+            auto rules = IgnoreRules::forChild(parentRules(parent), rootPrefix, parent);
+            it = startRules.emplace(parent, std::move(rules)).first;
+        }
+        return it->second;
+    }
+
+    void push(unsigned index, ScanItem &&item) {
+        pendingDirs.fetch_add(1, std::memory_order_relaxed);
+        {
+            auto lock = std::lock_guard(queues[index].mutex);
+            queues[index].dirs.push_back(std::move(item));
+        }
+        queuedDirs.fetch_add(1, std::memory_order_release);
+        {
+            // Pairs with the predicate check in workerMain() so wakeups are not lost
+            auto lock = std::lock_guard(idleMutex);
+        }
+        idleCond.notify_one();
+    }
+
+    bool pop(unsigned index, ScanItem &item) {
+        {
+            // Own queue is LIFO: stay depth first and keep the deque small
+            auto &own = queues[index];
+            auto lock = std::lock_guard(own.mutex);
+            if (!own.dirs.empty()) {
+                item = std::move(own.dirs.back());
+                own.dirs.pop_back();
+                queuedDirs.fetch_sub(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+        for (auto i = 1u; i < queues.size(); ++i) {
+            // Steal the oldest entries, those are closest to the root and have the most work
+            auto &victim = queues[(index + i) % queues.size()];
+            auto lock = std::lock_guard(victim.mutex);
+            if (!victim.dirs.empty()) {
+                item = std::move(victim.dirs.front());
+                victim.dirs.pop_front();
+                queuedDirs.fetch_sub(1, std::memory_order_relaxed);
+                steals.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void finishDir() {
+        if (pendingDirs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            {
+                auto lock = std::lock_guard(idleMutex);
+                done.store(true, std::memory_order_release);
+            }
+            idleCond.notify_all();
+        }
+    }
+
+    void workerMain(unsigned index) {
+        auto batch = std::vector<std::string>();
+        auto absPath = std::string();
+        auto item = ScanItem();
+        auto entries = std::vector<char>();
+        batch.reserve(options.batchSize);
+
+        while (!stopped()) {
+            if (pop(index, item)) {
+                listDirectory(index, item, absPath, entries, batch);
+                finishDir();
+                continue;
+            }
+            auto lock = std::unique_lock(idleMutex);
+            idleCond.wait(lock, [this] {
+                return queuedDirs.load(std::memory_order_acquire) > 0 || stopped();
+            });
+        }
+        if (!batch.empty() && !scanner.isCancelled()) {
+            flush(batch);
+        }
+        if (scanner.isCancelled()) {
+            {
+                auto lock = std::lock_guard(idleMutex);
+            }
+            idleCond.notify_all();
+        }
+    }
+
+    void flush(std::vector<std::string> &batch) {
+        if (options.throttle && !options.throttle->acquire()) {
+            batch.clear();
+            return;
+        }
+        files.fetch_add(batch.size(), std::memory_order_relaxed);
+        sink(std::move(batch));
+        batch = std::vector<std::string>();
+        batch.reserve(options.batchSize);
+    }
+
+    void addFile(const ScanItem &dir, const char *name, std::size_t length,
+                 std::vector<std::string> &batch) {
+        auto path = std::string();
+        path.reserve(dir.relDir.size() + length);
+        path.append(dir.relDir).append(name, length);
+        if (dir.rules && dir.rules->isIgnored(path, false)) {
+            return;
+        }
+        batch.push_back(std::move(path));
+        if (batch.size() >= options.batchSize) {
+            flush(batch);
+        }
+    }
+
+    void addDir(unsigned index, const ScanItem &dir, const char *name, std::size_t length) {
+        if (options.respectIgnoreFiles && std::string_view(name, length) == ".git") {
+            return;
+        }
+        auto path = std::string();
+        path.reserve(dir.relDir.size() + length + 1);
+        path.append(dir.relDir).append(name, length);
+        // Ignored directories are pruned here, nothing below them is ever listed
+        if (dir.rules && dir.rules->isIgnored(path, true)) {
+            return;
+        }
+        path.push_back('/');
+        if (options.descend && !options.descend(path)) {
+            return;
+        }
+        push(index, {std::move(path), dir.rules});
+    }
+
+    void reportDir(const std::string &relDir, std::int64_t mtime) {
+        if (options.dirSink) {
+            options.dirSink({relDir, mtime});
+        }
+    }
+
+    bool skipName(const char *name) const {
+        if (name[0] != '.') {
+            return false;
+        }
+        if (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')) {
+            return true;
+        }
+        return !options.includeHidden;
+    }
+
+#if defined(__linux__)
+    void listDirectory(unsigned index, ScanItem &item, std::string &absPath,
+                       std::vector<char> &entries, std::vector<std::string> &batch) {
+        auto const &relDir = item.relDir;
+        absPath.assign(rootPrefix).append(relDir);
+        auto fd = ::open(absPath.empty() ? "." : absPath.c_str(),
+                         O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd < 0) {
+            return;
+        }
+        directories.fetch_add(1, std::memory_order_relaxed);
+        if (options.dirSink) {
+            struct stat st;
+            auto mtime = ::fstat(fd, &st) == 0 ? toNanoseconds(st.st_mtim) : -1;
+            reportDir(relDir, mtime);
+        }
+
+        // The ignore files of a directory apply to all of its entries, so the whole
+        // directory is read before any entry is looked at
+        entries.clear();
+        alignas(struct dirent64) char buffer[32 * 1024];
+        while (!scanner.isCancelled()) {
+            auto bytes = ::syscall(SYS_getdents64, fd, buffer, sizeof(buffer));
+            if (bytes <= 0) {
+                break;
+            }
+            entries.insert(entries.end(), buffer, buffer + bytes);
+        }
+        if (options.respectIgnoreFiles) {
+            bool hasFile[std::size(IgnoreRules::FileNames)] = {};
+            forEachEntry(entries, [&](struct dirent64 *entry) {
+                for (auto i = std::size_t(0); i < std::size(hasFile); ++i) {
+                    hasFile[i] |= std::strcmp(entry->d_name, IgnoreRules::FileNames[i]) == 0;
+                }
+            });
+            item.rules = IgnoreRules::forChild(item.rules, rootPrefix, relDir, hasFile);
+        }
+
+        forEachEntry(entries, [&](struct dirent64 *entry) {
+            auto name = entry->d_name;
+            if (skipName(name)) {
+                return;
+            }
+            auto type = entry->d_type;
+            if (type == DT_UNKNOWN || type == DT_LNK) {
+                // Symlinks are listed when they point to files, but never followed
+                // into directories, which avoids walking in loops. Filesystems that do not
+                // fill in d_type get the same result from lstat.
+                struct stat st;
+                auto isLink = type == DT_LNK;
+                if (!isLink) {
+                    if (::fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+                        return;
+                    }
+                    isLink = S_ISLNK(st.st_mode);
+                }
+                if (isLink && ::fstatat(fd, name, &st, 0) != 0) {
+                    return;
+                }
+                if (S_ISREG(st.st_mode)) {
+                    type = DT_REG;
+                } else if (S_ISDIR(st.st_mode) && !isLink) {
+                    type = DT_DIR;
+                } else {
+                    return;
+                }
+            }
+            if (type == DT_DIR) {
+                addDir(index, item, name, std::strlen(name));
+            } else if (type == DT_REG) {
+                addFile(item, name, std::strlen(name), batch);
+            }
+        });
+        ::close(fd);
+    }
+
+    template <typename Visitor>
+    static void forEachEntry(std::vector<char> &entries, const Visitor &visit) {
+        for (auto offset = std::size_t(0); offset < entries.size();) {
+            auto entry = reinterpret_cast<struct dirent64 *>(entries.data() + offset);
+            offset += entry->d_reclen;
+            visit(entry);
+        }
+    }
+#else
+    void listDirectory(unsigned index, ScanItem &item, std::string &absPath,
+                       std::vector<char> &, std::vector<std::string> &batch) {
+        namespace fs = std::filesystem;
+        auto const &relDir = item.relDir;
+        absPath.assign(rootPrefix).append(relDir);
+        auto ec = std::error_code();
+        auto it = fs::directory_iterator(fs::u8path(absPath),
+                                         fs::directory_options::skip_permission_denied, ec);
+        if (ec) {
+            return;
+        }
+        directories.fetch_add(1, std::memory_order_relaxed);
+        if (options.dirSink) {
+            reportDir(relDir, DirScanner::directoryMtime(absPath));
+        }
+        if (options.respectIgnoreFiles) {
+            item.rules = IgnoreRules::forChild(item.rules, rootPrefix, relDir);
+        }
+        for (; it != fs::directory_iterator() && !scanner.isCancelled(); it.increment(ec)) {
+            if (ec) {
+                break;
+            }
+            auto u8name = it->path().filename().u8string();
+            auto name = std::string(u8name.begin(), u8name.end());
+            if (skipName(name.c_str())) {
+                continue;
+            }
+            if (it->is_directory(ec) && !it->is_symlink(ec)) {
+                addDir(index, item, name.data(), name.size());
+            } else if (it->is_regular_file(ec)) {
+                addFile(item, name.data(), name.size(), batch);
+            }
+        }
+    }
+#endif
+
+    std::string rootPrefix;
+    const DirScanner::Options &options;
+    const DirScanner::BatchSink &sink;
+    const DirScanner &scanner;
+
+    std::vector<WorkerQueue> queues;
+    // Only used before the workers start
+    std::unordered_map<std::string, std::shared_ptr<const IgnoreRules>> startRules;
+    std::mutex idleMutex;
+    std::condition_variable idleCond;
+    std::atomic<std::size_t> pendingDirs{0};
+    std::atomic<std::size_t> queuedDirs{0};
+    std::atomic_bool done{false};
+
+    std::atomic<std::uint64_t> files{0};
+    std::atomic<std::uint64_t> directories{0};
+    std::atomic<std::uint64_t> steals{0};
+};
+
+} // namespace
+
+DirScanner::DirScanner() : DirScanner(Options{}) {}
+
+DirScanner::DirScanner(Options options) : options(std::move(options)) {}
+
+DirScanner::Stats DirScanner::scan(const std::string &rootDir, const BatchSink &sink) {
+    return scan(rootDir, {std::string()}, sink);
+}
+
+DirScanner::Stats DirScanner::scan(const std::string &rootDir, std::vector<std::string> startDirs,
+                                   const BatchSink &sink) {
+    auto run = ScanRun(rootDir, options, sink, *this);
+    return run.run(std::move(startDirs));
+}
+
+void DirScanner::cancel() {
+    cancelled = true;
+    if (options.throttle) {
+        options.throttle->cancel();
+    }
+}
+
+bool DirScanner::isCancelled() const {
+    return cancelled.load(std::memory_order_relaxed) ||
+           (options.throttle && options.throttle->isCancelled());
+}
+
+std::int64_t DirScanner::directoryMtime(const std::string &path) {
+#if defined(__linux__)
+    struct stat st;
+    if (::stat(path.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) {
+        return -1;
+    }
+    return toNanoseconds(st.st_mtim);
+#else
+    namespace fs = std::filesystem;
+    auto ec = std::error_code();
+    auto p = fs::u8path(path);
+    if (!fs::is_directory(p, ec)) {
+        return -1;
+    }
+    auto time = fs::last_write_time(p, ec);
+    if (ec) {
+        return -1;
+    }
+    return static_cast<std::int64_t>(time.time_since_epoch().count());
+#endif
+}
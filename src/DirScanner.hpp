@@ -0,0 +1,88 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Limits how many result batches a scan may have in flight towards its consumer.
+// Scanner threads block in acquire() once the limit is reached, and the consumer
+// calls release() after each batch it processed. This paces the UI without sleeping.
+class ScanThrottle {
+  public:
+    explicit ScanThrottle(std::size_t maxInFlight = 8);
+
+    bool acquire();
+    void release();
+    void cancel();
+    bool isCancelled() const { return cancelled.load(std::memory_order_relaxed); }
+
+  private:
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::size_t maxInFlight;
+    std::size_t inFlight = 0;
+    std::atomic_bool cancelled{false};
+};
+
+// Parallel directory walker. Directories are distributed over a small pool of
+// threads with per-thread deques (work stealing). On Linux entries are read with
+// getdents64 and classified by d_type, so regular files never need a stat call.
+// Relative paths are built by appending the entry name to the parent prefix.
+class DirScanner {
+  public:
+    // Receives relative file paths (using `/`), may be called from any scanner thread
+    using BatchSink = std::function<void(std::vector<std::string> &&files)>;
+
+    // Called once per listed directory, relPath is empty for the root or ends with `/`.
+    // mtime is taken before the entries are read, see directoryMtime().
+    struct DirInfo {
+        std::string relPath;
+        std::int64_t mtime = 0;
+    };
+    using DirSink = std::function<void(DirInfo &&dir)>;
+
+    // Decides if a newly found sub directory is walked into, called from scanner threads
+    using DescendFilter = std::function<bool(const std::string &relDir)>;
+
+    struct Options {
+        unsigned threads = 0; // 0 - pick from hardware concurrency
+        std::size_t batchSize = 1000;
+        bool includeHidden = false;
+        // Honour .gitignore, .ignore and .git/info/exclude. Ignored directories are not
+        // walked into, and `.git` itself is always skipped.
+        bool respectIgnoreFiles = false;
+        std::shared_ptr<ScanThrottle> throttle;
+        DirSink dirSink;
+        DescendFilter descend;
+    };
+
+    struct Stats {
+        std::uint64_t files = 0;
+        std::uint64_t directories = 0;
+        std::uint64_t steals = 0;
+        unsigned threads = 0;
+    };
+
+    DirScanner();
+    explicit DirScanner(Options options);
+
+    // Blocks until the whole tree under rootDir has been delivered to sink
+    Stats scan(const std::string &rootDir, const BatchSink &sink);
+    // Same, but starts from the given relative directories instead of the root
+    Stats scan(const std::string &rootDir, std::vector<std::string> startDirs,
+               const BatchSink &sink);
+    void cancel();
+    bool isCancelled() const;
+
+    // Modification time of a directory in the same unit the scanner reports, -1 on error
+    static std::int64_t directoryMtime(const std::string &path);
+
+  private:
+    Options options;
+    std::atomic_bool cancelled{false};
+};
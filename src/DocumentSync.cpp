@@ -0,0 +1,163 @@
+#include "DocumentSync.hpp"
+
+#include <QDebug>
+#include <QTextBlock>
+#include <QTextCursor>
+#include <QTextDocument>
+#include <QTimer>
+
+#include <algorithm>
+
+namespace {
+
+// Edits made within this window go out as one didChange
+constexpr int FlushDelayMs = 50;
+
+// QTextDocument separates blocks with U+2029, the server expects `\n`
+QString toServerText(QString text) {
+    text.replace(QChar::ParagraphSeparator, u'\n');
+    return text;
+}
+
+} // namespace
+
+DocumentSync::DocumentSync(QTextDocument *document, QObject *parent)
+    : QObject(parent), document(document), text(toServerText(document->toRawText())) {
+    flushTimer = new QTimer(this);
+    flushTimer->setSingleShot(true);
+    flushTimer->setInterval(FlushDelayMs);
+    connect(flushTimer, &QTimer::timeout, this, &DocumentSync::flush);
+    connect(document, &QTextDocument::contentsChange, this, &DocumentSync::onContentsChange);
+}
+
+void DocumentSync::flush() {
+    flushTimer->stop();
+    if (needsFullText) {
+        needsFullText = false;
+        emit replaced(text);
+        return;
+    }
+
+    auto edits = QList<Edit>();
+    edits.reserve(pending.size());
+    for (auto const &change : std::as_const(pending)) {
+        if (change.removed.isEmpty() && change.inserted.isEmpty()) {
+            continue;
+        }
+        auto edit = Edit();
+        edit.startLine = change.line;
+        edit.startColumn = change.column;
+        auto newlines = int(change.removed.count(u'\n'));
+        edit.endLine = change.line + newlines;
+        edit.endColumn = newlines == 0
+                             ? change.column + int(change.removed.size())
+                             : int(change.removed.size() - change.removed.lastIndexOf(u'\n') - 1);
+        edit.text = change.inserted;
+        edits << edit;
+    }
+    pending.clear();
+    if (!edits.isEmpty()) {
+        emit edited(edits);
+    }
+}
+
+void DocumentSync::onContentsChange(int position, int charsRemoved, int charsAdded) {
+    // The document always ends with an implicit block separator that is not part of the text
+    auto length = document->characterCount() - 1;
+    if (position < 0 || position > text.size() || position > length) {
+        resync();
+        return;
+    }
+    // Qt sometimes reports more than what changed, up to the whole document, so clamp the
+    // counts and trim what the old and new text have in common
+    auto removedSize = std::min<qsizetype>(charsRemoved, text.size() - position);
+    auto addedSize = std::clamp(charsAdded, 0, length - position);
+    if (text.size() - removedSize + addedSize != length) {
+        resync();
+        return;
+    }
+    auto removed = QStringView(text).mid(position, removedSize);
+    auto inserted = documentText(position, addedSize);
+
+    auto prefix = qsizetype(0);
+    auto common = std::min(removed.size(), inserted.size());
+    while (prefix < common && removed[prefix] == inserted[prefix]) {
+        ++prefix;
+    }
+    auto suffix = qsizetype(0);
+    while (suffix < common - prefix &&
+           removed[removed.size() - 1 - suffix] == inserted[inserted.size() - 1 - suffix]) {
+        ++suffix;
+    }
+    if (prefix + suffix == removed.size() && prefix + suffix == inserted.size()) {
+        return;
+    }
+
+    auto edit = PendingEdit();
+    edit.position = int(position + prefix);
+    edit.removed = removed.mid(prefix, removed.size() - prefix - suffix).toString();
+    edit.inserted = inserted.mid(prefix, inserted.size() - prefix - suffix);
+    text.replace(position, removedSize, inserted);
+
+    // Text before the edit is unchanged, so the new document gives its old position too
+    auto block = document->findBlock(edit.position);
+    edit.line = block.blockNumber();
+    edit.column = edit.position - block.position();
+    if (!mergeWithLast(edit)) {
+        pending << edit;
+    }
+    if (!flushTimer->isActive()) {
+        flushTimer->start();
+    }
+}
+
+// Folds a keystroke into the previous edit: typing on, deleting forward or backspacing
+// over its end. Positions are offsets into the text as it was right before each edit.
+bool DocumentSync::mergeWithLast(const PendingEdit &edit) {
+    if (pending.isEmpty() || needsFullText) {
+        return false;
+    }
+    auto &last = pending.last();
+    auto lastEnd = last.position + int(last.inserted.size());
+    if (edit.position == lastEnd && edit.removed.isEmpty()) {
+        last.inserted += edit.inserted;
+        return true;
+    }
+    if (edit.position == lastEnd && edit.inserted.isEmpty()) {
+        last.removed += edit.removed;
+        return true;
+    }
+    if (edit.position + edit.removed.size() == lastEnd && edit.inserted.isEmpty()) {
+        auto fromInserted = std::min(edit.removed.size(), last.inserted.size());
+        last.inserted.chop(fromInserted);
+        auto before = edit.removed.size() - fromInserted;
+        if (before > 0) {
+            last.position = edit.position;
+            last.line = edit.line;
+            last.column = edit.column;
+            last.removed.prepend(edit.removed.left(before));
+        }
+        return true;
+    }
+    return false;
+}
+
+QString DocumentSync::documentText(int position, int length) const {
+    if (length == 0) {
+        return {};
+    }
+    auto cursor = QTextCursor(document);
+    cursor.setPosition(position);
+    cursor.setPosition(position + length, QTextCursor::KeepAnchor);
+    return toServerText(cursor.selectedText());
+}
+
+void DocumentSync::resync() {
+    qWarning() << "DocumentSync: lost track of the edits, sending the whole text";
+    text = toServerText(document->toRawText());
+    pending.clear();
+    needsFullText = true;
+    if (!flushTimer->isActive()) {
+        flushTimer->start();
+    }
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <QList>
+#include <QObject>
+#include <QString>
+
+class QTextDocument;
+class QTimer;
+
+// Turns the edits of a QTextDocument into incremental LSP content changes.
+//
+// contentsChange() only reports an edit after it happened, so a copy of the text is kept to
+// know what was removed. Edits are collected for a short window and runs of typing or
+// deleting are merged, so a burst of keystrokes becomes one change per window.
+// Lines are the document's blocks and columns count UTF-16 code units, as LSP expects.
+class DocumentSync : public QObject {
+    Q_OBJECT
+  public:
+    struct Edit {
+        int startLine = 0;
+        int startColumn = 0;
+        int endLine = 0;
+        int endColumn = 0;
+        QString text;
+    };
+
+    explicit DocumentSync(QTextDocument *document, QObject *parent = nullptr);
+
+    // The text as the server sees it after the edits sent so far and the pending ones
+    const QString &currentText() const { return text; }
+
+    // Sends the pending edits now, before a request that depends on the current text
+    void flush();
+
+  signals:
+    // Each edit's range refers to the text left by the previous one
+    void edited(const QList<DocumentSync::Edit> &edits);
+    // The edits could not be followed, the whole text has to be sent
+    void replaced(const QString &text);
+
+  private:
+    struct PendingEdit {
+        int position = 0;
+        int line = 0;
+        int column = 0;
+        QString removed;
+        QString inserted;
+    };
+
+    void onContentsChange(int position, int charsRemoved, int charsAdded);
+    bool mergeWithLast(const PendingEdit &edit);
+    QString documentText(int position, int length) const;
+    void resync();
+
+    QTextDocument *document;
+    QTimer *flushTimer;
+    QString text;
+    QList<PendingEdit> pending;
+    bool needsFullText = false;
+};
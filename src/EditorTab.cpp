@@ -0,0 +1,121 @@
+#include "EditorTab.hpp"
+#include "CodeEditor.hpp"
+#include "SpanTrace.hpp"
+
+#include <QScrollBar>
+#include <QTextCursor>
+#include <QTextDocument>
+#include <QTimer>
+#include <QVBoxLayout>
+
+#include <algorithm>
+
+namespace {
+
+// Per block cost of QTextDocument's block map and layout, measured roughly
+constexpr qsizetype BlockOverhead = 200;
+
+// Characters of a file inserted into the editor per event loop iteration while loading,
+// small enough to keep each step to a few milliseconds
+constexpr qsizetype LoadChunkChars = 128 * 1024;
+
+} // namespace
+
+EditorTab::EditorTab(const QString &filePath, QWidget *parent) : QWidget(parent), path(filePath) {
+    layout = new QVBoxLayout(this);
+    layout->setContentsMargins(0, 0, 0, 0);
+}
+
+EditorTab::~EditorTab() = default;
+
+void EditorTab::setText(const QString &text) {
+    if (codeEditor) {
+        codeEditor->setPlainText(text);
+        return;
+    }
+    codeEditor = new CodeEditor(this);
+    codeEditor->setPlainText(text);
+    codeEditor->setReadOnly(false);
+    layout->addWidget(codeEditor);
+    emit editorCreated(codeEditor);
+}
+
+void EditorTab::load(QString text) {
+    if (codeEditor) {
+        return;
+    }
+    pendingText = std::move(text);
+    loadedChars = 0;
+    loading = true;
+    codeEditor = new CodeEditor(this);
+    codeEditor->setReadOnly(true);
+    // The chunks are not edits the user could undo
+    codeEditor->document()->setUndoRedoEnabled(false);
+    layout->addWidget(codeEditor);
+    loadChunk();
+}
+
+void EditorTab::loadChunk() {
+    auto span = ScopedSpan("EditorTab::loadChunk");
+    auto end = std::min(loadedChars + LoadChunkChars, pendingText.size());
+    if (end < pendingText.size()) {
+        // Ending after a newline never splits a surrogate pair or a line
+        auto newline = pendingText.lastIndexOf('\n', end - 1);
+        if (newline >= loadedChars) {
+            end = newline + 1;
+        } else {
+            newline = pendingText.indexOf('\n', end);
+            end = newline >= 0 ? newline + 1 : pendingText.size();
+        }
+    }
+    auto cursor = QTextCursor(codeEditor->document());
+    cursor.movePosition(QTextCursor::End);
+    cursor.insertText(QStringView(pendingText).sliced(loadedChars, end - loadedChars).toString());
+    loadedChars = end;
+
+    if (loadedChars < pendingText.size()) {
+        QTimer::singleShot(0, this, &EditorTab::loadChunk);
+        return;
+    }
+    pendingText = QString();
+    loading = false;
+    codeEditor->document()->setUndoRedoEnabled(true);
+    codeEditor->setReadOnly(false);
+    emit loaded(codeEditor);
+}
+
+void EditorTab::hibernate() {
+    // A partly loaded document cannot be saved
+    if (!codeEditor || isLoading()) {
+        return;
+    }
+    emit aboutToHibernate(codeEditor);
+    cursorPosition = codeEditor->textCursor().position();
+    scrollPosition = codeEditor->verticalScrollBar()->value();
+    compressedText = qCompress(codeEditor->toPlainText().toUtf8());
+    delete codeEditor;
+    codeEditor = nullptr;
+}
+
+void EditorTab::wake() {
+    if (codeEditor) {
+        return;
+    }
+    setText(QString::fromUtf8(qUncompress(compressedText)));
+    compressedText.clear();
+
+    auto cursor = codeEditor->textCursor();
+    cursor.setPosition(std::min(cursorPosition, codeEditor->document()->characterCount() - 1));
+    codeEditor->setTextCursor(cursor);
+    codeEditor->verticalScrollBar()->setValue(scrollPosition);
+}
+
+qsizetype EditorTab::memoryEstimate() const {
+    if (!codeEditor) {
+        return 0;
+    }
+    auto document = codeEditor->document();
+    // The document's text, plus the copy DocumentSync keeps
+    return 2 * document->characterCount() * qsizetype(sizeof(QChar)) +
+           document->blockCount() * BlockOverhead;
+}
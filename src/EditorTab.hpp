@@ -0,0 +1,61 @@
+#pragma once
+
+#include <QByteArray>
+#include <QString>
+#include <QWidget>
+
+class CodeEditor;
+class QVBoxLayout;
+
+// One tab of the editor area.
+//
+// While awake the tab owns a CodeEditor. A hibernated tab frees the editor and its
+// QTextDocument and keeps only the compressed text with the cursor and scroll position,
+// wake() brings it back as it was. The owner is told through signals, so it can open and
+// close the document on the language server.
+class EditorTab : public QWidget {
+    Q_OBJECT
+  public:
+    explicit EditorTab(const QString &filePath, QWidget *parent = nullptr);
+    ~EditorTab() override;
+
+    const QString &filePath() const { return path; }
+    // Null while hibernated
+    CodeEditor *editor() const { return codeEditor; }
+    bool isHibernated() const { return !codeEditor; }
+
+    // Creates the editor showing text
+    void setText(const QString &text);
+    // Creates a read-only editor and fills it with text a chunk per event loop iteration,
+    // so a large file does not block the window. loaded() is emitted once all of it is
+    // shown and it can be edited.
+    void load(QString text);
+    bool isLoading() const { return loading; }
+    void hibernate();
+    void wake();
+
+    // Rough memory held by the editor, its document and the text kept for the server
+    qsizetype memoryEstimate() const;
+    qsizetype hibernatedSize() const { return compressedText.size(); }
+
+  signals:
+    void editorCreated(CodeEditor *editor);
+    void loaded(CodeEditor *editor);
+    // The editor is still alive when this is emitted
+    void aboutToHibernate(CodeEditor *editor);
+
+  private:
+    void loadChunk();
+
+    QString path;
+    QVBoxLayout *layout;
+    CodeEditor *codeEditor = nullptr;
+
+    QString pendingText;
+    qsizetype loadedChars = 0;
+    bool loading = false;
+
+    QByteArray compressedText;
+    int cursorPosition = 0;
+    int scrollPosition = 0;
+};
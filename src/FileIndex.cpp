@@ -0,0 +1,252 @@
+#include "FileIndex.hpp"
+#include "DirScanner.hpp"
+
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QSet>
+#include <QStandardPaths>
+
+#include <cstring>
+
+namespace {
+
+constexpr char IndexMagic[8] = {'L', 'S', 'P', 'F', 'I', 'D', 'X', '\0'};
+constexpr quint32 IndexVersion = 3;
+
+struct IndexHeader {
+    char magic[8];
+    quint32 version;
+    // The first storeDirCount directories are those of the path store in id order
+    quint32 dirCount;
+    quint32 storeDirCount;
+    quint32 fileCount;
+    // UTF-16 units in each of the two name arenas
+    quint32 nameArenaSize;
+    quint32 stringsSize;
+    quint32 rootOffset;
+    quint32 rootSize;
+};
+
+struct IndexDir {
+    // NotIndexed for directories of the path store that were never listed
+    qint64 mtime;
+    quint32 pathOffset;
+    quint32 pathSize;
+};
+
+constexpr qint64 NotIndexed = -1;
+
+static_assert(sizeof(IndexHeader) == 40);
+static_assert(sizeof(IndexDir) == 16);
+static_assert(sizeof(PathStore::Entry) == 12);
+
+} // namespace
+
+QString FileIndex::defaultLocation(const QString &rootDir) {
+    auto base = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+    auto hash = QCryptographicHash::hash(rootDir.toUtf8(), QCryptographicHash::Sha1).toHex();
+    return base + "/file-index/" + QString::fromLatin1(hash) + ".idx";
+}
+
+bool FileIndex::load(const QString &indexFile, const QString &rootDir) {
+    root.clear();
+    fileList = PathStore();
+    dirs.clear();
+
+    QFile file(indexFile);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    auto size = file.size();
+    if (size < qint64(sizeof(IndexHeader))) {
+        return false;
+    }
+    auto data = file.map(0, size);
+    if (!data) {
+        return false;
+    }
+
+    auto header = IndexHeader{};
+    std::memcpy(&header, data, sizeof(header));
+    auto expectedSize = qint64(sizeof(IndexHeader)) + qint64(header.dirCount) * sizeof(IndexDir) +
+                        qint64(header.fileCount) * sizeof(PathStore::Entry) +
+                        qint64(header.nameArenaSize) * 2 * sizeof(char16_t) + header.stringsSize;
+    if (std::memcmp(header.magic, IndexMagic, sizeof(IndexMagic)) != 0 ||
+        header.version != IndexVersion || expectedSize != size) {
+        file.unmap(data);
+        return false;
+    }
+
+    auto dirRecords = reinterpret_cast<const IndexDir *>(data + sizeof(IndexHeader));
+    auto fileRecords = reinterpret_cast<const PathStore::Entry *>(dirRecords + header.dirCount);
+    auto names = reinterpret_cast<const char16_t *>(fileRecords + header.fileCount);
+    auto foldedNames = names + header.nameArenaSize;
+    auto strings = reinterpret_cast<const char *>(foldedNames + header.nameArenaSize);
+    auto valid = header.storeDirCount >= 1 && header.storeDirCount <= header.dirCount;
+    auto toString = [&](quint32 offset, quint32 length) {
+        if (quint64(offset) + length > header.stringsSize) {
+            valid = false;
+            return QString();
+        }
+        return QString::fromUtf8(strings + offset, length);
+    };
+
+    if (toString(header.rootOffset, header.rootSize) != rootDir) {
+        file.unmap(data);
+        return false;
+    }
+
+    // Interned in id order the directories get their saved ids back, which the file
+    // entries refer to
+    dirs.reserve(header.dirCount);
+    for (auto i = quint32(0); i < header.dirCount && valid; ++i) {
+        auto const &record = dirRecords[i];
+        auto relDir = toString(record.pathOffset, record.pathSize);
+        if (i < header.storeDirCount && fileList.addDir(relDir) != PathStore::DirId(i)) {
+            valid = false;
+        }
+        if (record.mtime != NotIndexed) {
+            dirs.insert(relDir, record.mtime);
+        }
+    }
+    // The names are copied in whole blocks, no file is built on its own
+    valid = valid && fileList.loadFiles(fileRecords, header.fileCount, names, foldedNames,
+                                        header.nameArenaSize);
+    file.unmap(data);
+
+    if (!valid) {
+        fileList = PathStore();
+        dirs.clear();
+        return false;
+    }
+    root = rootDir;
+    return true;
+}
+
+bool FileIndex::save(const QString &indexFile) const {
+    auto strings = QByteArray();
+    auto addString = [&strings](QStringView str, quint32 &offset, quint32 &length) {
+        auto utf8 = str.toUtf8();
+        offset = quint32(strings.size());
+        length = quint32(utf8.size());
+        strings.append(utf8);
+    };
+
+    auto header = IndexHeader{};
+    std::memcpy(header.magic, IndexMagic, sizeof(IndexMagic));
+    header.version = IndexVersion;
+    addString(root, header.rootOffset, header.rootSize);
+
+    auto fileRecords = QList<PathStore::Entry>();
+    fileRecords.reserve(fileList.size());
+    auto hasFiles = QList<bool>(fileList.dirCount(), false);
+    for (auto i = qsizetype(0); i < fileList.size(); ++i) {
+        fileRecords << fileList.entry(i);
+        hasFiles[fileRecords.last().dir] = true;
+    }
+
+    auto dirRecords = QList<IndexDir>();
+    dirRecords.reserve(fileList.dirCount() + dirs.size());
+    auto addDir = [&](const QString &relDir, qint64 mtime) {
+        auto record = IndexDir{mtime, 0, 0};
+        addString(relDir, record.pathOffset, record.pathSize);
+        dirRecords << record;
+    };
+    for (auto dir = PathStore::DirId(0); dir < fileList.dirCount(); ++dir) {
+        // Unknown directories with files get mtime 0, which makes the next check list them
+        // again
+        auto const &relDir = fileList.dirPath(dir);
+        addDir(relDir, dirs.value(relDir, hasFiles[dir] ? 0 : NotIndexed));
+    }
+    header.storeDirCount = quint32(dirRecords.size());
+    // Listed directories without files
+    for (auto it = dirs.cbegin(); it != dirs.cend(); ++it) {
+        if (fileList.findDir(it.key()) < 0) {
+            addDir(it.key(), it.value());
+        }
+    }
+
+    header.dirCount = quint32(dirRecords.size());
+    header.fileCount = quint32(fileList.size());
+    header.nameArenaSize = quint32(fileList.nameArenaSize());
+    header.stringsSize = quint32(strings.size());
+
+    QDir().mkpath(QFileInfo(indexFile).absolutePath());
+    QSaveFile file(indexFile);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char *>(dirRecords.constData()),
+               dirRecords.size() * sizeof(IndexDir));
+    file.write(reinterpret_cast<const char *>(fileRecords.constData()),
+               fileRecords.size() * sizeof(PathStore::Entry));
+    for (auto folded : {false, true}) {
+        for (auto offset = qsizetype(0); offset < fileList.nameArenaSize();
+             offset += PathStore::BlockSize) {
+            auto block = fileList.nameBlock(offset, folded);
+            file.write(reinterpret_cast<const char *>(block.utf16()),
+                       block.size() * sizeof(char16_t));
+        }
+    }
+    file.write(strings);
+    return file.commit();
+}
+
+void FileIndex::reset(const QString &rootDir, const QStringList &files,
+                      const QHash<QString, qint64> &directories) {
+    root = rootDir;
+    fileList = PathStore::fromList(files);
+    dirs = directories;
+}
+
+FileIndex::Changes FileIndex::findChanges() const {
+    auto changes = Changes();
+    auto prefix = (root + '/').toStdString();
+    auto path = std::string();
+    for (auto it = dirs.cbegin(); it != dirs.cend(); ++it) {
+        path.assign(prefix).append(it.key().toStdString());
+        auto mtime = DirScanner::directoryMtime(path);
+        if (mtime < 0) {
+            changes.removedDirs << it.key();
+        } else if (mtime != it.value()) {
+            changes.changedDirs << it.key();
+        }
+    }
+    return changes;
+}
+
+void FileIndex::apply(const Changes &changes, const QStringList &files,
+                      const QHash<QString, qint64> &directories) {
+    // Every directory is indexed on its own, so a removed sub tree shows up as one removed
+    // entry per directory and files can be matched by their exact parent
+    auto dropped = QSet<QString>();
+    for (auto const &dir : changes.changedDirs) {
+        dropped.insert(dir);
+    }
+    for (auto const &dir : changes.removedDirs) {
+        dropped.insert(dir);
+        dirs.remove(dir);
+    }
+    auto droppedIds = QList<bool>(fileList.dirCount());
+    for (auto dir = PathStore::DirId(0); dir < fileList.dirCount(); ++dir) {
+        droppedIds[dir] = dropped.contains(fileList.dirPath(dir));
+    }
+
+    auto updated = PathStore();
+    for (auto i = qsizetype(0); i < fileList.size(); ++i) {
+        auto dir = fileList.dirOf(i);
+        if (!droppedIds[dir]) {
+            updated.addFile(fileList.dirPath(dir), fileList.name(i));
+        }
+    }
+    updated.append(files);
+    fileList = updated;
+
+    for (auto it = directories.cbegin(); it != directories.cend(); ++it) {
+        dirs.insert(it.key(), it.value());
+    }
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "PathStore.hpp"
+
+#include <QHash>
+#include <QString>
+#include <QStringList>
+
+// Persistent list of the files under a project root.
+//
+// The index is stored as a compact binary file which is memory mapped on load:
+// a header, a table of directories (relative path and mtime), the file entries and
+// name arenas of the PathStore as they are laid out in memory, and a UTF-8 string
+// table for the directory paths. Loading copies the files in whole blocks. It is a
+// cache only, written in native byte order and discarded when the version does not
+// match.
+//
+// Directory mtimes allow checking the index incrementally: only directories whose
+// mtime changed need to be listed again, and only new directories walked.
+class FileIndex {
+  public:
+    struct Changes {
+        QStringList changedDirs;
+        QStringList removedDirs;
+        bool isEmpty() const { return changedDirs.isEmpty() && removedDirs.isEmpty(); }
+    };
+
+    static QString defaultLocation(const QString &rootDir);
+
+    bool load(const QString &indexFile, const QString &rootDir);
+    bool save(const QString &indexFile) const;
+
+    bool isEmpty() const { return dirs.isEmpty(); }
+    const QString &rootDir() const { return root; }
+    const PathStore &files() const { return fileList; }
+    const QHash<QString, qint64> &directories() const { return dirs; }
+    bool containsDir(const QString &relDir) const { return dirs.contains(relDir); }
+
+    void reset(const QString &rootDir, const QStringList &files,
+               const QHash<QString, qint64> &directories);
+
+    // Stats every indexed directory, one call per directory and none per file
+    Changes findChanges() const;
+
+    // Replaces the content of the changed directories with a fresh listing. `files` and
+    // `directories` hold what was found in the changed directories and new sub directories.
+    void apply(const Changes &changes, const QStringList &files,
+               const QHash<QString, qint64> &directories);
+
+  private:
+    QString root;
+    PathStore fileList;
+    QHash<QString, qint64> dirs;
+};
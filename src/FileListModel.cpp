@@ -0,0 +1,109 @@
+#include "FileListModel.hpp"
+
+#include <QDir>
+
+#include <algorithm>
+#include <iterator>
+
+FileListModel::FileListModel(QObject *parent) : QAbstractListModel(parent) {}
+
+void FileListModel::setRootDir(const QString &dir) { rootDir = dir; }
+
+void FileListModel::setRows(const PathStore &newPaths, const QList<qsizetype> &newRows) {
+    beginResetModel();
+    paths = newPaths;
+    rows = newRows;
+    endResetModel();
+}
+
+void FileListModel::appendRows(const PathStore &newPaths, const QList<qsizetype> &newRows) {
+    paths = newPaths;
+    if (newRows.isEmpty()) {
+        return;
+    }
+    beginInsertRows({}, rows.size(), rows.size() + newRows.size() - 1);
+    rows << newRows;
+    endInsertRows();
+}
+
+void FileListModel::mergeRows(const PathStore &newPaths, const QList<qsizetype> &newRows) {
+    paths = newPaths;
+    if (newRows.isEmpty()) {
+        return;
+    }
+
+    // Number of current rows before each new row, found by binary search
+    auto lessThan = [this](qsizetype a, qsizetype b) { return paths.lessThan(a, b); };
+    auto positions = QList<qsizetype>();
+    positions.reserve(newRows.size());
+    auto from = rows.cbegin();
+    for (auto file : newRows) {
+        from = std::upper_bound(from, rows.cend(), file, lessThan);
+        positions << (from - rows.cbegin());
+    }
+
+    // Rows are inserted at the end, then moved into place with one layout change
+    auto oldSize = rows.size();
+    beginInsertRows({}, oldSize, oldSize + newRows.size() - 1);
+    rows << newRows;
+    endInsertRows();
+
+    emit layoutAboutToBeChanged({}, QAbstractItemModel::VerticalSortHint);
+    auto merged = QList<qsizetype>();
+    merged.reserve(rows.size());
+    auto next = qsizetype(0);
+    for (auto i = qsizetype(0); i < newRows.size(); ++i) {
+        std::copy(rows.cbegin() + next, rows.cbegin() + positions[i],
+                  std::back_inserter(merged));
+        merged << newRows[i];
+        next = positions[i];
+    }
+    std::copy(rows.cbegin() + next, rows.cbegin() + oldSize, std::back_inserter(merged));
+
+    auto const persistent = persistentIndexList();
+    auto moved = QModelIndexList();
+    moved.reserve(persistent.size());
+    for (auto const &index : persistent) {
+        auto row = qsizetype(index.row());
+        if (row < oldSize) {
+            row += std::upper_bound(positions.cbegin(), positions.cend(), row) - positions.cbegin();
+        } else {
+            row = positions[row - oldSize] + (row - oldSize);
+        }
+        moved << createIndex(int(row), index.column());
+    }
+    changePersistentIndexList(persistent, moved);
+    rows = merged;
+    emit layoutChanged({}, QAbstractItemModel::VerticalSortHint);
+}
+
+void FileListModel::clear() { setRows({}, {}); }
+
+QString FileListModel::relativePath(int row) const { return paths.path(rows.at(row)); }
+
+QStringList FileListModel::displayedFiles() const {
+    auto files = QStringList();
+    files.reserve(rows.size());
+    for (auto i : rows) {
+        files << QDir::toNativeSeparators(paths.path(i));
+    }
+    return files;
+}
+
+int FileListModel::rowCount(const QModelIndex &parent) const {
+    return parent.isValid() ? 0 : int(rows.size());
+}
+
+QVariant FileListModel::data(const QModelIndex &index, int role) const {
+    if (!index.isValid() || index.row() >= rows.size()) {
+        return {};
+    }
+    switch (role) {
+    case Qt::DisplayRole:
+        return QDir::toNativeSeparators(relativePath(index.row()));
+    case Qt::ToolTipRole:
+        return QDir::toNativeSeparators(rootDir + relativePath(index.row()));
+    default:
+        return {};
+    }
+}
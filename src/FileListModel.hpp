@@ -0,0 +1,38 @@
+#pragma once
+
+#include "PathStore.hpp"
+
+#include <QAbstractListModel>
+#include <QList>
+#include <QStringList>
+
+// Rows of the file list. The model keeps a shared snapshot of the path store and a vector
+// of row -> file indices, display text and tooltips are built on demand in data().
+// A new filter result replaces the index vector in one reset. Rows found while a scan
+// runs are merged into place, so a sorted list stays sorted at every point.
+class FileListModel : public QAbstractListModel {
+    Q_OBJECT
+  public:
+    explicit FileListModel(QObject *parent = nullptr);
+
+    void setRootDir(const QString &dir);
+
+    // `rows` index into `paths`
+    void setRows(const PathStore &paths, const QList<qsizetype> &rows);
+    // `paths` must extend the current snapshot, as it does while a scan appends files
+    void appendRows(const PathStore &paths, const QList<qsizetype> &rows);
+    // Same, for rows sorted by path that go into the current rows which are sorted too
+    void mergeRows(const PathStore &paths, const QList<qsizetype> &rows);
+    void clear();
+
+    QString relativePath(int row) const;
+    QStringList displayedFiles() const;
+
+    int rowCount(const QModelIndex &parent = {}) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+
+  private:
+    QString rootDir;
+    PathStore paths;
+    QList<qsizetype> rows;
+};
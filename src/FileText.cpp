@@ -0,0 +1,36 @@
+#include "FileText.hpp"
+
+#include <QFile>
+
+#include <string_view>
+
+namespace {
+
+constexpr std::string_view Utf8Bom = "\xEF\xBB\xBF";
+
+} // namespace
+
+std::optional<std::string> readFileText(const QString &path) {
+    auto file = QFile(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return std::nullopt;
+    }
+    auto text = std::string();
+    if (auto fileSize = file.size(); fileSize > 0) {
+        text.resize(std::size_t(fileSize));
+        auto read = file.read(text.data(), fileSize);
+        if (read < 0) {
+            return std::nullopt;
+        }
+        // Truncated while reading
+        text.resize(std::size_t(read));
+    } else {
+        // Empty, or not a regular file
+        auto all = file.readAll();
+        text.assign(all.constData(), std::size_t(all.size()));
+    }
+    if (text.starts_with(Utf8Bom)) {
+        text.erase(0, Utf8Bom.size());
+    }
+    return text;
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <QString>
+
+#include <optional>
+#include <string>
+
+// Reads the bytes of a file into memory, without a leading UTF-8 byte order mark.
+//
+// The file is read once, so a later change to it cannot pull the text away from under the
+// editor or the server. Empty if the file cannot be read.
+std::optional<std::string> readFileText(const QString &path);
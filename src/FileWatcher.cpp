@@ -0,0 +1,358 @@
+#include "FileWatcher.hpp"
+#include "DirScanner.hpp"
+#include "IgnoreRules.hpp"
+
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QTimer>
+
+#include <array>
+#include <cstring>
+
+#if defined(__linux__)
+#include <QSocketNotifier>
+#include <cerrno>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+// Registering a watch is a syscall with a path lookup, keep each batch short
+constexpr qsizetype RegisterBatchSize = 1024;
+constexpr int CoalesceWindowMs = 100;
+constexpr int PollIntervalMs = 5000;
+
+#if defined(__linux__)
+constexpr uint32_t WatchMask = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_MODIFY |
+                               IN_CLOSE_WRITE | IN_ONLYDIR | IN_EXCL_UNLINK | IN_DELETE_SELF |
+                               IN_MOVE_SELF;
+#endif
+// mtimes come from a coarse clock, a change right after a listing can leave the mtime as
+// it was, so directories changed this recently are listed again as well
+constexpr qint64 RecentChangeNs = 1000LL * 1000 * 1000;
+
+inline bool isHidden(const char *name) { return name[0] == '.'; }
+
+// Whether the entries of a directory may have changed after a listing that saw mtime
+bool changedSince(const std::string &path, qint64 mtime) {
+    auto current = DirScanner::directoryMtime(path);
+    if (current < 0) {
+        return false;
+    }
+    auto now = QDateTime::currentMSecsSinceEpoch() * 1000 * 1000;
+    return current != mtime || now - current < RecentChangeNs;
+}
+
+inline bool isIgnoreFile(const char *name) {
+    for (auto fileName : IgnoreRules::FileNames) {
+        if (std::strcmp(name, fileName) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace
+
+FileWatcher::FileWatcher(QObject *parent) : QObject(parent) {}
+
+FileWatcher::~FileWatcher() {
+#if defined(__linux__)
+    if (inotifyFd != -1) {
+        // Closing the descriptor drops all of its watches at once
+        ::close(inotifyFd);
+    }
+#endif
+}
+
+void FileWatcher::setRootDir(const QString &dir) {
+    rootDir = QDir::fromNativeSeparators(dir);
+    if (!rootDir.endsWith('/')) {
+        rootDir += '/';
+    }
+}
+
+void FileWatcher::start() {
+    registerTimer = new QTimer(this);
+    registerTimer->setInterval(0);
+    connect(registerTimer, &QTimer::timeout, this, &FileWatcher::registerPending);
+
+    flushTimer = new QTimer(this);
+    flushTimer->setSingleShot(true);
+    flushTimer->setInterval(CoalesceWindowMs);
+    connect(flushTimer, &QTimer::timeout, this, &FileWatcher::flushChanges);
+
+#if defined(__linux__)
+    inotifyFd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotifyFd != -1) {
+        notifier = new QSocketNotifier(inotifyFd, QSocketNotifier::Read, this);
+        connect(notifier, &QSocketNotifier::activated, this, &FileWatcher::readEvents);
+        return;
+    }
+    qWarning() << "inotify is not available, polling for changes";
+#endif
+    startPolling();
+}
+
+void FileWatcher::watchDirectories(const QHash<QString, qint64> &relDirs) {
+    if (polling) {
+        return;
+    }
+    for (auto it = relDirs.cbegin(); it != relDirs.cend(); ++it) {
+        if (!knownDirs.contains(it.key())) {
+            knownDirs.insert(it.key());
+            pendingDirs << PendingDir{it.key(), it.value()};
+        }
+    }
+    if (!registerTimer->isActive()) {
+        registerTimer->start();
+    }
+}
+
+void FileWatcher::registerPending() {
+#if defined(__linux__)
+    auto end = qMin(pendingIndex + RegisterBatchSize, pendingDirs.size());
+    auto changedDirs = QStringList();
+    for (; pendingIndex < end; ++pendingIndex) {
+        auto const &pending = pendingDirs.at(pendingIndex);
+        if (dirToWatch.contains(pending.relDir) || !knownDirs.contains(pending.relDir)) {
+            // Watched already, or removed while it was queued
+            continue;
+        }
+        auto path = QFile::encodeName(rootDir + pending.relDir);
+        auto wd = ::inotify_add_watch(inotifyFd, path.constData(), WatchMask);
+        if (wd >= 0) {
+            watchToDir.insert(wd, pending.relDir);
+            dirToWatch.insert(pending.relDir, wd);
+            if (changedSince(path.toStdString(), pending.mtime)) {
+                changedDirs << pending.relDir;
+            }
+        } else if (errno == ENOSPC || errno == ENOMEM) {
+            qWarning() << "Out of inotify watches after" << dirToWatch.size()
+                       << "directories, polling for changes";
+            startPolling();
+            return;
+        } else {
+            knownDirs.remove(pending.relDir);
+        }
+    }
+    // Queues what is new, so the list is only appended to after the loop
+    for (auto const &relDir : changedDirs) {
+        listDirectoryTree(relDir);
+    }
+#endif
+    if (pendingIndex >= pendingDirs.size()) {
+        pendingDirs.clear();
+        pendingIndex = 0;
+        registerTimer->stop();
+    }
+}
+
+void FileWatcher::readEvents() {
+#if defined(__linux__)
+    alignas(struct inotify_event) char buffer[64 * 1024];
+    for (;;) {
+        auto bytes = ::read(inotifyFd, buffer, sizeof(buffer));
+        if (bytes <= 0) {
+            break;
+        }
+        for (auto offset = ssize_t(0); offset < bytes;) {
+            auto event = reinterpret_cast<const struct inotify_event *>(buffer + offset);
+            offset += sizeof(struct inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                // Events were lost, only a rescan can tell what changed
+                emit rescanRequested();
+                continue;
+            }
+            if (event->mask & IN_IGNORED) {
+                auto it = watchToDir.find(event->wd);
+                if (it != watchToDir.end()) {
+                    dirToWatch.remove(it.value());
+                    knownDirs.remove(it.value());
+                    watchToDir.erase(it);
+                }
+                continue;
+            }
+            if (event->len == 0) {
+                continue;
+            }
+            if (isIgnoreFile(event->name)) {
+                // Already listed files stay until the next rescan, new ones use the new rules
+                ignoreRules.clear();
+                continue;
+            }
+            if (isHidden(event->name)) {
+                continue;
+            }
+            auto it = watchToDir.constFind(event->wd);
+            if (it == watchToDir.cend()) {
+                continue;
+            }
+            auto name = QFile::decodeName(event->name);
+            auto isDir = (event->mask & IN_ISDIR) != 0;
+            if ((event->mask & (IN_CREATE | IN_MOVED_TO | IN_MODIFY | IN_CLOSE_WRITE)) &&
+                isIgnored(it.value(), name, isDir)) {
+                continue;
+            }
+            auto relPath = it.value() + name;
+            if (isDir) {
+                if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+                    listDirectoryTree(relPath + '/');
+                } else if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+                    removeDirectoryTree(relPath + '/');
+                }
+            } else if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+                recordChange(relPath, Change::Added);
+            } else if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+                recordChange(relPath, Change::Removed);
+            } else if (event->mask & (IN_MODIFY | IN_CLOSE_WRITE)) {
+                recordChange(relPath, Change::Modified);
+            }
+        }
+    }
+#endif
+}
+
+void FileWatcher::listDirectoryTree(const QString &relDir) {
+    // Files may have been created before the watch exists, so list the tree once. The
+    // scanner calls back on its one thread while this one waits.
+    auto options = DirScanner::Options{};
+    options.threads = 1;
+    options.respectIgnoreFiles = true;
+    options.descend = [this](const std::string &subDir) {
+        return !knownDirs.contains(QString::fromUtf8(subDir.data(), subDir.size()));
+    };
+    options.dirSink = [this](DirScanner::DirInfo &&dir) {
+        auto listed = QString::fromUtf8(dir.relPath.data(), dir.relPath.size());
+        if (!knownDirs.contains(listed)) {
+            knownDirs.insert(listed);
+            pendingDirs << PendingDir{listed, dir.mtime};
+        }
+    };
+    auto scanner = DirScanner(options);
+    scanner.scan(rootDir.toStdString(), {relDir.toStdString()},
+                 [this](std::vector<std::string> &&files) {
+                     for (auto const &file : files) {
+                         recordChange(QString::fromUtf8(file.data(), file.size()),
+                                      Change::Listed);
+                     }
+                 });
+    if (!polling && !registerTimer->isActive()) {
+        registerTimer->start();
+    }
+}
+
+void FileWatcher::removeDirectoryTree(const QString &relDir) {
+#if defined(__linux__)
+    // A tree moved out of the project keeps its watches, drop them
+    for (auto it = dirToWatch.begin(); it != dirToWatch.end();) {
+        if (it.key().startsWith(relDir)) {
+            ::inotify_rm_watch(inotifyFd, it.value());
+            watchToDir.remove(it.value());
+            it = dirToWatch.erase(it);
+        } else {
+            ++it;
+        }
+    }
+#endif
+    knownDirs.removeIf([&relDir](const QString &dir) { return dir.startsWith(relDir); });
+    for (auto it = changes.begin(); it != changes.end();) {
+        if (it.key().startsWith(relDir)) {
+            it = changes.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    removedDirs << relDir;
+    if (!flushTimer->isActive()) {
+        flushTimer->start();
+    }
+}
+
+void FileWatcher::recordChange(const QString &relPath, Change change) {
+    auto it = changes.find(relPath);
+    if (it == changes.end()) {
+        changes.insert(relPath, change);
+    } else if (auto merged = mergeChanges(it.value(), change)) {
+        it.value() = *merged;
+    } else {
+        changes.erase(it);
+    }
+    if (!flushTimer->isActive()) {
+        flushTimer->start();
+    }
+}
+
+std::optional<FileWatcher::Change> FileWatcher::mergeChanges(Change first, Change second) {
+    switch (first) {
+    case Change::Added:
+        // Created and deleted within one window
+        return second == Change::Removed ? std::nullopt : std::optional(Change::Added);
+    case Change::Removed:
+        // Replaced, e.g. by an editor saving through a temporary file
+        return second == Change::Removed ? Change::Removed : Change::Modified;
+    case Change::Modified:
+        return second == Change::Removed ? Change::Removed : Change::Modified;
+    case Change::Listed:
+        return second;
+    }
+    return second;
+}
+
+void FileWatcher::flushChanges() {
+    auto lists = std::array<QStringList, 4>();
+    for (auto it = changes.cbegin(); it != changes.cend(); ++it) {
+        lists[std::size_t(it.value())] << it.key();
+    }
+    changes.clear();
+    auto const &added = lists[std::size_t(Change::Added)];
+    auto const &modified = lists[std::size_t(Change::Modified)];
+    auto const &removed = lists[std::size_t(Change::Removed)];
+    auto const &listed = lists[std::size_t(Change::Listed)];
+    if (!added.isEmpty() || !modified.isEmpty() || !removed.isEmpty() ||
+        !removedDirs.isEmpty() || !listed.isEmpty()) {
+        emit filesChanged(added, modified, removed, removedDirs, listed);
+    }
+    removedDirs.clear();
+}
+
+bool FileWatcher::isIgnored(const QString &relDir, const QString &name, bool isDir) {
+    auto it = ignoreRules.find(relDir);
+    if (it == ignoreRules.end()) {
+        auto rules = IgnoreRules::forDirectory(QFile::encodeName(rootDir).toStdString(),
+                                               QFile::encodeName(relDir).toStdString());
+        it = ignoreRules.insert(relDir, rules);
+    }
+    auto const &rules = it.value();
+    return rules && rules->isIgnored(QFile::encodeName(relDir + name).toStdString(), isDir);
+}
+
+void FileWatcher::startPolling() {
+    if (polling) {
+        return;
+    }
+    polling = true;
+    pendingDirs.clear();
+    pendingIndex = 0;
+    knownDirs.clear();
+    registerTimer->stop();
+#if defined(__linux__)
+    if (notifier) {
+        notifier->setEnabled(false);
+    }
+    if (inotifyFd != -1) {
+        ::close(inotifyFd);
+        inotifyFd = -1;
+    }
+    watchToDir.clear();
+    dirToWatch.clear();
+#endif
+    pollTimer = new QTimer(this);
+    pollTimer->setInterval(PollIntervalMs);
+    connect(pollTimer, &QTimer::timeout, this, &FileWatcher::rescanRequested);
+    pollTimer->start();
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <QHash>
+#include <QObject>
+#include <QSet>
+#include <QStringList>
+
+#include <memory>
+#include <optional>
+
+class IgnoreRules;
+class QSocketNotifier;
+class QTimer;
+
+// Keeps the project file list live after the initial scan.
+//
+// On Linux every directory of the project gets an inotify watch. Watches are
+// registered in batches from the watcher's event loop, so that 100k directories
+// do not block it, and events are coalesced for a short window before being
+// reported as one delta. A rename is reported as a removal plus an addition.
+//
+// When the kernel runs out of watch descriptors (or on other platforms) the
+// watcher falls back to polling: it periodically asks for an incremental
+// rescan, which only stats directories (see FileIndex).
+//
+// A directory is listed again once its watch exists if its mtime moved since the scan
+// that found it, files created in between have no event. What that listing finds is
+// reported as listed, the receiver already knows most of it.
+//
+// Paths ignored by .gitignore style rules are not reported, as the scanner never lists
+// them either.
+//
+// The object is meant to live in its own thread, call start() from there.
+class FileWatcher : public QObject {
+    Q_OBJECT
+  public:
+    explicit FileWatcher(QObject *parent = nullptr);
+    ~FileWatcher();
+
+    void setRootDir(const QString &dir);
+
+  public slots:
+    void start();
+    // Directories with their mtime when they were listed
+    void watchDirectories(const QHash<QString, qint64> &relDirs);
+
+  signals:
+    // Paths are relative to the root, removed directories end with `/`
+    void filesChanged(const QStringList &added, const QStringList &modified,
+                      const QStringList &removed, const QStringList &removedDirs,
+                      const QStringList &listed);
+    void rescanRequested();
+
+  private:
+    enum class Change { Added, Modified, Removed, Listed };
+    struct PendingDir {
+        QString relDir;
+        qint64 mtime;
+    };
+
+    void registerPending();
+    void readEvents();
+    // Lists relDir and the directories under it that are not watched or queued yet
+    void listDirectoryTree(const QString &relDir);
+    void removeDirectoryTree(const QString &relDir);
+    void recordChange(const QString &relPath, Change change);
+    // What two changes of a path within one window amount to, nullopt if they cancel out
+    static std::optional<Change> mergeChanges(Change first, Change second);
+    void flushChanges();
+    void startPolling();
+    bool isIgnored(const QString &relDir, const QString &name, bool isDir);
+
+    QString rootDir;
+    int inotifyFd = -1;
+    bool polling = false;
+    QSocketNotifier *notifier = nullptr;
+    QTimer *registerTimer = nullptr;
+    QTimer *flushTimer = nullptr;
+    QTimer *pollTimer = nullptr;
+
+    QList<PendingDir> pendingDirs;
+    qsizetype pendingIndex = 0;
+    QHash<int, QString> watchToDir;
+    QHash<QString, int> dirToWatch;
+    // Watched or queued
+    QSet<QString> knownDirs;
+
+    QHash<QString, Change> changes;
+    QStringList removedDirs;
+
+    // Rules in effect per watched directory, dropped when an ignore file changes
+    QHash<QString, std::shared_ptr<const IgnoreRules>> ignoreRules;
+};
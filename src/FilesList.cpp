@@ -1,101 +1,394 @@
 ﻿#include "FilesList.hpp"
+#include "DirScanner.hpp"
+#include "FileListModel.hpp"
+#include "FileWatcher.hpp"
+#include "GlobMatcher.hpp"
 #include "LoadingWidget.hpp"
+#include "SpanTrace.hpp"
 
-#include <QCoreApplication>
 #include <QDebug>
 #include <QDir>
 #include <QElapsedTimer>
 #include <QFileInfo>
+#include <QLabel>
 #include <QLineEdit>
-#include <QListWidget>
-#include <QQueue>
-#include <QRegularExpression>
+#include <QListView>
+#include <QMutex>
+#include <QSet>
 #include <QThread>
 #include <QTimer>
 #include <QVBoxLayout>
+#include <QtConcurrent/QtConcurrent>
+
+#include <algorithm>
 
 // Normalize path to use `/`
 static inline QString normalizePath(const QString &path) {
     return QDir::fromNativeSeparators(path);
 }
 
-// Convert glob to regex list
-static QList<QRegularExpression> toRegexList(const QStringList &patterns) {
-    QList<QRegularExpression> list;
-    for (auto &pat : patterns) {
-        QString rx;
-        for (QChar ch : pat.trimmed()) {
-            if (ch == '*') {
-                rx += ".*";
-            } else if (ch == '?') {
-                rx += '.';
-            } else if (QString("[](){}.+^$|\\").contains(ch)) {
-                rx += '\\' + ch;
-            } else {
-                rx += ch;
-            }
-        }
-        if (!rx.isEmpty()) {
-            list << QRegularExpression("^" + rx + "$", QRegularExpression::CaseInsensitiveOption);
-        }
-    }
-    return list;
-}
+// The throttle keeps the ring from ever being full
+static constexpr std::size_t MaxBatchesInFlight = 8;
 
-FileScannerWorker::FileScannerWorker(QObject *parent) : QObject(parent) {}
+// Scan results are moved into the list once per frame, the number of files per frame
+// adapts so that adding them and merging the filtered rows fits the frame budget
+static constexpr int DrainIntervalMs = 16;
+static constexpr double DrainBudgetMs = 8.0;
+static constexpr qsizetype MinDrainFiles = 256;
+static constexpr qsizetype MaxDrainFiles = 64 * 1024;
+
+FileScannerWorker::FileScannerWorker(QObject *parent)
+    : QObject(parent), scanThrottle(std::make_shared<ScanThrottle>(MaxBatchesInFlight)),
+      batchRing(std::make_shared<FileBatchRing>(MaxBatchesInFlight)) {}
 
 void FileScannerWorker::setRootDir(const QString &dir) { rootDir = normalizePath(dir); }
 
+void FileScannerWorker::setIndex(const FileIndex &newIndex, const QString &newIndexFile) {
+    index = newIndex;
+    indexFile = newIndexFile;
+}
+
 void FileScannerWorker::start() {
     QElapsedTimer timer;
     timer.start();
-    QStringList collected;
-    scanDir(rootDir, collected);
+    if (index.isEmpty()) {
+        scanDir(rootDir);
+    } else {
+        refreshIndex();
+    }
+    if (!scanThrottle->isCancelled()) {
+        emit directoriesScanned(index.directories());
+    }
     emit finished(timer.elapsed());
 }
 
-void FileScannerWorker::scanDir(const QString &rootPath, QStringList &buf) {
-    QStringList chunk;
-    const int chunkSize = 200;
-    QQueue<QString> queue;
-    queue.enqueue(rootPath);
-
-    while (!queue.isEmpty()) {
-        auto dirPath = queue.dequeue();
-        QDir dir(dirPath);
-        auto entries = dir.entryInfoList(QDir::Files | QDir::Dirs | QDir::NoDotAndDotDot);
-
-        for (const QFileInfo &fi : entries) {
-            if (fi.isDir()) {
-                queue.enqueue(normalizePath(fi.absoluteFilePath()));
-            } else {
-                auto rel = QDir(rootDir).relativeFilePath(fi.absoluteFilePath());
-                chunk << normalizePath(rel);
-                if (chunk.size() >= chunkSize) {
-                    emit filesChunkFound(chunk);
-                    chunk.clear();
-                    QThread::msleep(20);
-                }
+void FileScannerWorker::scanDir(const QString &rootPath) {
+    auto span = ScopedSpan("FileScannerWorker::scanDir");
+    QMutex mutex;
+    auto allFiles = QStringList();
+    auto dirs = QHash<QString, qint64>();
+
+    auto options = DirScanner::Options{};
+    options.batchSize = 1000;
+    options.throttle = scanThrottle;
+    options.respectIgnoreFiles = true;
+    options.dirSink = [&](DirScanner::DirInfo &&dir) {
+        auto relDir = QString::fromUtf8(dir.relPath.data(), dir.relPath.size());
+        QMutexLocker lock(&mutex);
+        dirs.insert(relDir, dir.mtime);
+    };
+
+    auto scanner = DirScanner(options);
+    scanner.scan(rootPath.toStdString(), [&](std::vector<std::string> &&files) {
+        auto chunk = QStringList();
+        chunk.reserve(files.size());
+        for (auto const &file : files) {
+            chunk << QString::fromUtf8(file.data(), file.size());
+        }
+        // Scanner threads push one at a time, which keeps the ring single producer
+        QMutexLocker lock(&mutex);
+        allFiles << chunk;
+        while (!batchRing->tryPush(std::move(chunk)) && !scanThrottle->isCancelled()) {
+            QThread::yieldCurrentThread();
+        }
+    });
+
+    if (!scanner.isCancelled()) {
+        index.reset(rootPath, allFiles, dirs);
+        if (!indexFile.isEmpty()) {
+            index.save(indexFile);
+        }
+    }
+}
+
+void FileScannerWorker::refreshIndex() {
+    auto span = ScopedSpan("FileScannerWorker::refreshIndex");
+    auto changes = index.findChanges();
+    if (changes.isEmpty()) {
+        return;
+    }
+
+    QMutex mutex;
+    auto files = QStringList();
+    auto dirs = QHash<QString, qint64>();
+    auto startDirs = std::vector<std::string>();
+    for (auto const &dir : std::as_const(changes.changedDirs)) {
+        startDirs.push_back(dir.toStdString());
+    }
+
+    auto options = DirScanner::Options{};
+    options.throttle = scanThrottle;
+    options.respectIgnoreFiles = true;
+    options.descend = [this](const std::string &relDir) {
+        // Known directories are only listed again if their own mtime changed
+        return !index.containsDir(QString::fromUtf8(relDir.data(), relDir.size()));
+    };
+    options.dirSink = [&](DirScanner::DirInfo &&dir) {
+        auto relDir = QString::fromUtf8(dir.relPath.data(), dir.relPath.size());
+        QMutexLocker lock(&mutex);
+        dirs.insert(relDir, dir.mtime);
+    };
+
+    auto scanner = DirScanner(options);
+    auto collect = [&](std::vector<std::string> &&found) {
+        QMutexLocker lock(&mutex);
+        for (auto const &file : found) {
+            files << QString::fromUtf8(file.data(), file.size());
+        }
+        // Nothing is sent to the UI per batch, the throttle is only used for cancellation
+        scanThrottle->release();
+    };
+    scanner.scan(rootDir.toStdString(), std::move(startDirs), collect);
+    if (scanner.isCancelled()) {
+        return;
+    }
+
+    index.apply(changes, files, dirs);
+    index.save(indexFile);
+    emit indexRefreshed(index.files());
+}
+
+namespace {
+
+struct FilterRange {
+    qsizetype begin;
+    qsizetype end;
+};
+
+// Files per parallel job, the generation is also checked at this granularity
+constexpr qsizetype FilterChunkSize = 4096;
+// Ranked queries show the best matches only, the list says how many were left out
+constexpr qsizetype RankedResultLimit = 2000;
+
+// Matches every directory segment once, a file then only needs its name checked.
+// Parents are always interned before their children.
+QList<bool> matchDirectories(const PathStore &files, const GlobMatcher &matcher) {
+    auto matched = QList<bool>(files.dirCount(), false);
+    if (matcher.isEmpty()) {
+        return matched;
+    }
+    for (auto dir = PathStore::DirId(1); dir < files.dirCount(); ++dir) {
+        matched[dir] = matched[files.parentDir(dir)] || matcher.matches(files.foldedDirName(dir));
+    }
+    return matched;
+}
+
+inline bool matchesPath(const PathStore &files, qsizetype file, const QList<bool> &matchedDirs,
+                        const GlobMatcher &matcher) {
+    return matchedDirs[files.dirOf(file)] ||
+           (!matcher.isEmpty() && matcher.matches(files.foldedName(file)));
+}
+
+} // namespace
+
+FileFilterWorker::FileFilterWorker(QObject *parent) : QObject(parent) {}
+
+void FileFilterWorker::cancelOlderThan(quint64 generation) {
+    latestGeneration.store(generation, std::memory_order_relaxed);
+}
+
+bool FileFilterWorker::isStale(quint64 generation) const {
+    return latestGeneration.load(std::memory_order_relaxed) != generation;
+}
+
+void FileFilterWorker::filter(quint64 generation, const PathStore &files, qsizetype first,
+                              const QStringList &excludePatterns, const QStringList &showPatterns,
+                              bool append) {
+    if (isStale(generation)) {
+        return;
+    }
+    auto span = ScopedSpan("FileFilterWorker::filter");
+
+    // Patterns with wildcards filter, words (`~word` fuzzy) are queries which rank the result
+    auto globs = QStringList();
+    auto terms = QStringList();
+    for (auto const &pattern : showPatterns) {
+        auto trimmed = pattern.trimmed();
+        if (trimmed.isEmpty() || trimmed == u"~") {
+            continue;
+        }
+        if (trimmed.contains('*') || trimmed.contains('?')) {
+            globs << trimmed;
+        } else {
+            terms << trimmed;
+        }
+    }
+
+    auto excludes = GlobMatcher(excludePatterns);
+    auto shows = GlobMatcher(globs);
+    auto matchCount = qsizetype(0);
+    auto rows = terms.isEmpty() ? filterByGlobs(generation, files, first, excludes, shows)
+                                : rankTerms(generation, files, first, excludePatterns, excludes,
+                                            shows, terms, append, matchCount);
+    if (isStale(generation)) {
+        return;
+    }
+    emit filteringDone(generation, files, rows, append, !terms.isEmpty(),
+                       terms.isEmpty() ? rows.size() : matchCount);
+}
+
+QList<qsizetype> FileFilterWorker::filterByGlobs(quint64 generation, const PathStore &files,
+                                                 qsizetype first, const GlobMatcher &excludes,
+                                                 const GlobMatcher &shows) {
+    auto ranges = QList<FilterRange>();
+    for (auto begin = first; begin < files.size(); begin += FilterChunkSize) {
+        ranges << FilterRange{begin, qMin(begin + FilterChunkSize, files.size())};
+    }
+
+    auto excludedDirs = matchDirectories(files, excludes);
+    auto shownDirs = matchDirectories(files, shows);
+    auto matchRange = [&](const FilterRange &range) {
+        auto rows = QList<qsizetype>();
+        if (isStale(generation)) {
+            return rows;
+        }
+        for (auto i = range.begin; i < range.end; ++i) {
+            if (matchesPath(files, i, excludedDirs, excludes)) {
+                continue;
+            }
+            if (!shows.isEmpty() && !matchesPath(files, i, shownDirs, shows)) {
+                continue;
+            }
+            rows << i;
+        }
+        return rows;
+    };
+
+    auto parts = QtConcurrent::blockingMapped<QList<QList<qsizetype>>>(ranges, matchRange);
+    auto rows = QList<qsizetype>();
+    if (isStale(generation)) {
+        return rows;
+    }
+    for (auto const &part : std::as_const(parts)) {
+        rows << part;
+    }
+    std::sort(rows.begin(), rows.end(),
+              [&](qsizetype a, qsizetype b) { return files.lessThan(a, b); });
+    return rows;
+}
+
+QList<qsizetype> FileFilterWorker::rankTerms(quint64 generation, const PathStore &files,
+                                             qsizetype first, const QStringList &excludePatterns,
+                                             const GlobMatcher &excludes,
+                                             const GlobMatcher &shows, const QStringList &words,
+                                             bool append, qsizetype &matchCount) {
+    // Chunks of a running scan are scored directly, the index covers the full list only
+    auto useIndex = !append;
+    if (useIndex && !matcher.isIndexed(files)) {
+        matcher.setPaths(files);
+        candidates.clear();
+        lastTerm.clear();
+    }
+
+    // Typing one more character can only narrow the result, so only the paths that
+    // matched the previous query need to be scored again. This holds for both kinds of
+    // terms, and `~` in front keeps them apart.
+    auto singleTerm = words.size() == 1 && shows.isEmpty();
+    auto refine = useIndex && singleTerm && !lastTerm.isEmpty() &&
+                  words.first().startsWith(lastTerm, Qt::CaseInsensitive) &&
+                  excludePatterns == lastExcludePatterns;
+    // Glob matches need no query characters, so the masks can only reject without globs
+    auto prefilter = useIndex && shows.isEmpty();
+    auto terms = QList<FuzzyMatcher::Term>();
+    for (auto const &word : words) {
+        terms << FuzzyMatcher::parseTerm(word);
+    }
+
+    auto begin = refine ? qsizetype(0) : first;
+    auto total = refine ? candidates.size() : files.size();
+    auto ranges = QList<FilterRange>();
+    for (; begin < total; begin += FilterChunkSize) {
+        ranges << FilterRange{begin, qMin(begin + FilterChunkSize, total)};
+    }
+
+    auto excludedDirs = matchDirectories(files, excludes);
+    auto shownDirs = matchDirectories(files, shows);
+    auto matchRange = [&](const FilterRange &range) {
+        auto matches = QList<FuzzyMatcher::Match>();
+        if (isStale(generation)) {
+            return matches;
+        }
+        auto rel = QString();
+        for (auto pos = range.begin; pos < range.end; ++pos) {
+            auto i = refine ? candidates.at(pos) : pos;
+            if (prefilter && std::none_of(terms.cbegin(), terms.cend(), [&](auto const &term) {
+                    return matcher.mayMatch(i, term.mask);
+                })) {
+                continue;
+            }
+            if (matchesPath(files, i, excludedDirs, excludes)) {
+                continue;
             }
+            // Scoring looks at the whole path, it is assembled in a reused buffer
+            files.path(i, rel);
+            auto best = -1;
+            for (auto const &term : terms) {
+                best = qMax(best, FuzzyMatcher::score(term, rel));
+            }
+            if (best < 0 && !shows.isEmpty() && matchesPath(files, i, shownDirs, shows)) {
+                best = 0;
+            }
+            if (best >= 0) {
+                matches << FuzzyMatcher::Match{best, i};
+            }
+        }
+        return matches;
+    };
+
+    using MatchList = QList<FuzzyMatcher::Match>;
+    auto parts = QtConcurrent::blockingMapped<QList<MatchList>>(ranges, matchRange);
+    auto rows = QList<qsizetype>();
+    if (isStale(generation)) {
+        return rows;
+    }
+    auto matches = QList<FuzzyMatcher::Match>();
+    for (auto const &part : std::as_const(parts)) {
+        matches << part;
+    }
+
+    matchCount = matches.size();
+    if (useIndex) {
+        lastTerm = singleTerm ? words.first() : QString();
+        lastExcludePatterns = excludePatterns;
+        candidates.clear();
+        candidates.reserve(matches.size());
+        for (auto const &match : std::as_const(matches)) {
+            candidates << match.index;
         }
+        matcher.selectTop(matches, RankedResultLimit);
+    } else {
+        std::sort(matches.begin(), matches.end(), [](auto const &a, auto const &b) {
+            return a.score > b.score;
+        });
     }
-    if (!chunk.isEmpty()) {
-        emit filesChunkFound(chunk);
+
+    rows.reserve(matches.size());
+    for (auto const &match : std::as_const(matches)) {
+        rows << match.index;
     }
+    return rows;
 }
 
 FilesList::FilesList(QWidget *parent) : QWidget(parent) {
     auto layout = new QVBoxLayout(this);
     layout->setContentsMargins(0, 0, 0, 0);
-    list = new QListWidget(this);
+    model = new FileListModel(this);
+    list = new QListView(this);
+    limitLabel = new QLabel(this);
+    limitLabel->hide();
     excludeEdit = new QLineEdit(this);
     showEdit = new QLineEdit(this);
     loadingWidget = new LoadingWidget(this);
 
+    list->setModel(model);
     list->setAlternatingRowColors(true);
+    // Lets the view lay out only the visible rows
+    list->setUniformItemSizes(true);
+    list->setEditTriggers(QAbstractItemView::NoEditTriggers);
 
     showEdit->setClearButtonEnabled(true);
-    showEdit->setPlaceholderText(tr("Files to show (e.g. main;*.cpp;*.h)"));
+    showEdit->setPlaceholderText(
+        tr("Files to show, ~words are fuzzy (e.g. mainwin;~mwh;*.cpp;*.h)"));
     showEdit->setToolTip(showEdit->placeholderText());
 
     excludeEdit->setClearButtonEnabled(true);
@@ -105,69 +398,233 @@ FilesList::FilesList(QWidget *parent) : QWidget(parent) {
 
     layout->addWidget(loadingWidget);
     layout->addWidget(list);
+    layout->addWidget(limitLabel);
     layout->addWidget(showEdit);
     layout->addWidget(excludeEdit);
 
-    connect(list, &QListWidget::itemClicked, this,
-            [=](auto *it) { emit fileSelected(it->text()); });
+    connect(list, &QListView::clicked, this, [=](const QModelIndex &index) {
+        emit fileSelected(index.data().toString());
+    });
     connect(excludeEdit, &QLineEdit::textChanged, this, &FilesList::scheduleUpdateList);
     connect(showEdit, &QLineEdit::textChanged, this, &FilesList::scheduleUpdateList);
 
     updateTimer = new QTimer(this);
     updateTimer->setSingleShot(true);
     updateTimer->setInterval(300);
-    connect(updateTimer, &QTimer::timeout, this, [this]() { updateList(fullList, true); });
+    connect(updateTimer, &QTimer::timeout, this, [this]() { updateList(0, true); });
+
+    drainTimer = new QTimer(this);
+    drainTimer->setInterval(DrainIntervalMs);
+    connect(drainTimer, &QTimer::timeout, this, &FilesList::drainScanResults);
+
+    filterThread = new QThread(this);
+    filterWorker = new FileFilterWorker;
+    filterWorker->moveToThread(filterThread);
+    connect(this, &FilesList::requestFiltering, filterWorker, &FileFilterWorker::filter);
+    connect(filterWorker, &FileFilterWorker::filteringDone, this, &FilesList::showFilteredFiles);
+    connect(filterThread, &QThread::finished, filterWorker, &QObject::deleteLater);
+    filterThread->start();
+}
+
+FilesList::~FilesList() {
+    clear();
+    filterThread->quit();
+    filterThread->wait();
 }
 
 void FilesList::setDir(const QString &dir) {
     clear();
     directory = normalizePath(dir);
+    model->setRootDir(directory);
 
+    // Show the last known state right away, the worker then only checks what changed
+    auto index = FileIndex();
+    if (index.load(FileIndex::defaultLocation(directory), directory)) {
+        fullList = index.files();
+        loadingWidget->setToolTip(QString(tr("Total %1 files")).arg(fullList.size()));
+        updateList(0, true);
+    }
+    startWatcher();
+    startScan(index, true);
+}
+
+void FilesList::rescan() {
+    if (directory.isEmpty() || scanThrottle) {
+        return;
+    }
+    auto index = FileIndex();
+    if (index.load(FileIndex::defaultLocation(directory), directory)) {
+        startScan(index, false);
+    }
+}
+
+void FilesList::startScan(const FileIndex &index, bool initialScan) {
     auto *thread = new QThread;
     auto *worker = new FileScannerWorker;
+    auto generation = ++scanGeneration;
+    scanThrottle = worker->throttle();
+    scanRing = worker->ring();
+    scanFinished = false;
+    drainBatch.clear();
+    drainOffset = 0;
+    lastDrained = 0;
+    drainTimer->start();
     worker->moveToThread(thread);
-    worker->setRootDir(dir);
-    connect(worker, &FileScannerWorker::filesChunkFound, this, [=](const QStringList &chunk) {
-        QMetaObject::invokeMethod(
-            this,
-            [=]() {
-                fullList.append(chunk);
-                loadingWidget->setToolTip(QString(tr("Total %1 files")).arg(fullList.size()));
-                updateList(chunk, false);
-            },
-            Qt::QueuedConnection);
+    worker->setRootDir(directory);
+    worker->setIndex(index, FileIndex::defaultLocation(directory));
+    connect(worker, &FileScannerWorker::indexRefreshed, this, [=](const PathStore &files) {
+        if (generation == scanGeneration) {
+            fullList = files;
+            loadingWidget->setToolTip(QString(tr("Total %1 files")).arg(fullList.size()));
+            updateList(0, true);
+        }
     });
+    if (initialScan && watcher) {
+        connect(worker, &FileScannerWorker::directoriesScanned, watcher,
+                &FileWatcher::watchDirectories);
+    }
     connect(worker, &FileScannerWorker::finished, this, [=](qint64 ms) {
         qDebug() << "Scan finished in" << ms << "ms";
         worker->deleteLater();
         thread->quit();
-        loadingWidget->stop();
+        if (generation == scanGeneration) {
+            // The last batches may still be in the ring, see drainScanResults()
+            scanFinished = true;
+        }
     });
     connect(thread, &QThread::started, worker, &FileScannerWorker::start);
     connect(thread, &QThread::finished, thread, &QObject::deleteLater);
     thread->start();
-    loadingWidget->start();
-    loadingWidget->setToolTip({});
+    if (initialScan) {
+        loadingWidget->start();
+        if (fullList.isEmpty()) {
+            loadingWidget->setToolTip({});
+        }
+    }
+}
+
+void FilesList::startWatcher() {
+    auto *thread = new QThread;
+    watcher = new FileWatcher;
+    watcher->setRootDir(directory);
+    watcher->moveToThread(thread);
+    connect(watcher, &FileWatcher::filesChanged, this, &FilesList::applyChanges);
+    connect(watcher, &FileWatcher::rescanRequested, this, &FilesList::rescan);
+    connect(watcher, &QObject::destroyed, thread, &QThread::quit);
+    connect(thread, &QThread::started, watcher, &FileWatcher::start);
+    connect(thread, &QThread::finished, thread, &QObject::deleteLater);
+    thread->start();
+}
+
+void FilesList::applyChanges(const QStringList &added, const QStringList &modified,
+                             const QStringList &removed, const QStringList &removedDirs,
+                             const QStringList &listed) {
+    if (sender() != watcher) {
+        return;
+    }
+
+    // Added files that are already known were replaced, e.g. by an editor saving
+    // through a temporary file, they are reported as changed like modified ones. Listed
+    // files were found by listing a directory again and are new only if unknown.
+    auto addedSet = QSet<QString>(added.cbegin(), added.cend());
+    addedSet.unite(QSet<QString>(modified.cbegin(), modified.cend()));
+    auto listedSet = QSet<QString>(listed.cbegin(), listed.cend());
+    auto removedSet = QSet<QString>(removed.cbegin(), removed.cend());
+
+    // Only files in a directory with changes need their full path compared, removed trees
+    // are resolved once per directory
+    auto touchedDirs = QList<bool>(fullList.dirCount(), false);
+    for (auto const *paths : {&added, &modified, &removed, &listed}) {
+        for (auto const &rel : *paths) {
+            auto dir = fullList.findDir(QStringView(rel).first(rel.lastIndexOf('/') + 1));
+            if (dir >= 0) {
+                touchedDirs[dir] = true;
+            }
+        }
+    }
+    auto removedDirSet = QSet<QString>(removedDirs.cbegin(), removedDirs.cend());
+    auto removedDirIds = QList<bool>(fullList.dirCount(), false);
+    for (auto dir = PathStore::DirId(1); dir < fullList.dirCount(); ++dir) {
+        removedDirIds[dir] =
+            removedDirIds[fullList.parentDir(dir)] || removedDirSet.contains(fullList.dirPath(dir));
+    }
+
+    auto changed = QStringList();
+    auto deleted = QStringList();
+    auto updated = PathStore();
+    auto rel = QString();
+    for (auto i = qsizetype(0); i < fullList.size(); ++i) {
+        auto dir = fullList.dirOf(i);
+        if (touchedDirs[dir]) {
+            fullList.path(i, rel);
+            if (addedSet.remove(rel)) {
+                changed << rel;
+                continue;
+            }
+            if (removedSet.contains(rel)) {
+                deleted << rel;
+                continue;
+            }
+            if (listedSet.remove(rel)) {
+                updated.addFile(fullList.dirPath(dir), fullList.name(i));
+                continue;
+            }
+        }
+        if (removedDirIds[dir]) {
+            // Removed trees are reported file by file
+            fullList.path(i, rel);
+            deleted << rel;
+            continue;
+        }
+        updated.addFile(fullList.dirPath(dir), fullList.name(i));
+    }
+    if (changed.isEmpty() && deleted.isEmpty() && addedSet.isEmpty() && listedSet.isEmpty()) {
+        // Listed files that were known already
+        return;
+    }
+    updated.append(changed);
+    auto created = QStringList(addedSet.cbegin(), addedSet.cend());
+    created << QStringList(listedSet.cbegin(), listedSet.cend());
+    updated.append(created);
+    fullList = updated;
+
+    // Rows of the view index into the previous list, filter the new one from scratch.
+    // The view keeps showing its own snapshot until the result arrives.
+    updateList(0, true);
+    loadingWidget->setToolTip(QString(tr("Total %1 files")).arg(fullList.size()));
+    emit filesChanged(created, changed, deleted);
 }
 
 void FilesList::setFiles(const QStringList &files) {
-    fullList = files;
-    scheduleUpdateList();
+    fullList = PathStore::fromList(files);
+    updateList(0, true);
 }
 
 void FilesList::clear() {
-    fullList.clear();
-    list->clear();
+    if (scanThrottle) {
+        // Abort a scan that is still running, its pending chunks get dropped
+        scanThrottle->cancel();
+        scanThrottle.reset();
+        scanRing.reset();
+        drainBatch.clear();
+        drainTimer->stop();
+        ++scanGeneration;
+        loadingWidget->stop();
+    }
+    if (watcher) {
+        // Deleted in its own thread, which then quits
+        disconnect(watcher, nullptr, this, nullptr);
+        watcher->deleteLater();
+        watcher = nullptr;
+    }
+    filterWorker->cancelOlderThan(++filterGeneration);
+    fullList = PathStore();
+    model->clear();
+    limitLabel->hide();
     directory.clear();
 }
 
-QStringList FilesList::currentFilteredFiles() const {
-    auto res = QStringList();
-    for (auto i = 0; i < list->count(); ++i) {
-        res << list->item(i)->text();
-    }
-    return res;
-}
+QStringList FilesList::currentFilteredFiles() const { return model->displayedFiles(); }
 
 void FilesList::scheduleUpdateList() {
     if (updateTimer->isActive()) {
@@ -176,83 +633,97 @@ void FilesList::scheduleUpdateList() {
     updateTimer->start();
 }
 
-void FilesList::updateList(const QStringList &files, bool clearList) {
-    auto excludes = toRegexList(excludeEdit->text().split(';', Qt::SkipEmptyParts));
-    auto shows = toRegexList(showEdit->text().split(';', Qt::SkipEmptyParts));
-    auto showTokens = showEdit->text().toLower().split(';', Qt::SkipEmptyParts);
-    auto filtered = QStringList();
-    auto count = 0;
-
+void FilesList::updateList(qsizetype first, bool clearList) {
+    auto span = ScopedSpan("FilesList::updateList");
+    // Only full passes start a new generation, appended chunks are filtered in the
+    // current one so they do not abort a full pass that is already running
     if (clearList) {
-        list->clear();
+        filterWorker->cancelOlderThan(++filterGeneration);
+    }
+    emit requestFiltering(filterGeneration, fullList, first,
+                          excludeEdit->text().split(';', Qt::SkipEmptyParts),
+                          showEdit->text().split(';', Qt::SkipEmptyParts), !clearList);
+}
+
+void FilesList::showFilteredFiles(quint64 generation, const PathStore &files,
+                                  const QList<qsizetype> &rows, bool append, bool ranked,
+                                  qsizetype matchCount) {
+    if (generation != filterGeneration) {
+        return;
+    }
+    auto span = ScopedSpan("FilesList::showFilteredFiles");
+    // Every pass of a generation filters a snapshot of the same growing list
+    QElapsedTimer timer;
+    timer.start();
+    if (!append) {
+        model->setRows(files, rows);
+        limitLabel->setText(
+            tr("Showing the best %1 of %2 matches").arg(rows.size()).arg(matchCount));
+        limitLabel->setVisible(matchCount > rows.size());
+        emit filtersChanged();
+    } else if (ranked) {
+        model->appendRows(files, rows);
+    } else {
+        model->mergeRows(files, rows);
     }
+    lastMergeMs = timer.nsecsElapsed() / 1e6;
+}
 
-    for (auto const &rel : files) {
-        auto normPath = normalizePath(rel);
-        auto segments = normPath.split('/', Qt::SkipEmptyParts);
-        auto excluded = false;
+void FilesList::drainScanResults() {
+    if (!scanRing) {
+        drainTimer->stop();
+        return;
+    }
+    auto span = ScopedSpan("FilesList::drainScanResults");
 
-        for (auto const &rx : excludes) {
-            for (auto const &segment : segments) {
-                if (rx.match(segment).hasMatch()) {
-                    excluded = true;
-                    break;
-                }
-            }
-            if (excluded) {
+    QElapsedTimer timer;
+    timer.start();
+    auto first = fullList.size();
+    auto taken = qsizetype(0);
+    while (taken < drainLimit) {
+        if (drainOffset == drainBatch.size()) {
+            auto batch = scanRing->tryPop();
+            if (!batch) {
                 break;
             }
+            drainBatch = std::move(*batch);
+            drainOffset = 0;
+            scanThrottle->release();
         }
-        if (excluded) {
-            continue;
-        }
-
-        if (!shows.isEmpty() || !showTokens.isEmpty()) {
-            auto matched = false;
-            for (auto const &rx : shows) {
-                for (auto const &segment : segments) {
-                    if (rx.match(segment).hasMatch()) {
-                        matched = true;
-                        break;
-                    }
-                }
-                if (matched) {
-                    break;
-                }
-            }
-
-            if (!matched && !showTokens.isEmpty()) {
-                for (auto const &token : showTokens) {
-                    for (auto const &segment : segments) {
-                        if (segment.toLower().contains(token)) {
-                            matched = true;
-                            break;
-                        }
-                    }
-                    if (matched) {
-                        break;
-                    }
-                }
-            }
-
-            if (!matched) {
-                continue;
-            }
+        auto end = qMin(drainBatch.size(), drainOffset + drainLimit - taken);
+        for (; drainOffset < end; ++drainOffset, ++taken) {
+            fullList.addFile(drainBatch.at(drainOffset));
         }
+    }
+    if (taken > 0) {
+        loadingWidget->setToolTip(QString(tr("Total %1 files")).arg(fullList.size()));
+        updateList(first, false);
+    }
 
-        filtered << rel;
-        if (++count % 200 == 0) {
-            QCoreApplication::processEvents();
-        }
+    if (taken > 0) {
+        // What a file cost to add in this frame and to merge into the view in the frame
+        // before, the next frame takes as many as fit into the budget
+        auto addMs = timer.nsecsElapsed() / 1e6 / taken;
+        auto mergeMs = lastDrained > 0 ? lastMergeMs / lastDrained : 0.0;
+        auto fileMs = qMax(addMs + mergeMs, 1e-6);
+        drainLimit = qBound(MinDrainFiles, qsizetype(DrainBudgetMs / fileMs), MaxDrainFiles);
+        lastDrained = taken;
     }
 
-    filtered.sort(Qt::CaseInsensitive);
-    for (auto const &rel : filtered) {
-        auto *item = new QListWidgetItem(QDir::toNativeSeparators(rel));
-        item->setToolTip(QDir::toNativeSeparators(directory + rel));
-        list->addItem(item);
+    if (scanFinished && drainOffset == drainBatch.size() && scanRing->isEmpty()) {
+        finishScan();
     }
-    if (clearList) {
-        emit filtersChanged();
+}
+
+void FilesList::finishScan() {
+    drainTimer->stop();
+    drainBatch.clear();
+    drainOffset = 0;
+    scanRing.reset();
+    scanThrottle.reset();
+    loadingWidget->stop();
+    if (!showEdit->text().trimmed().isEmpty()) {
+        // Chunks were filtered on their own while scanning, rank the whole list
+        updateList(0, true);
     }
 }
@@ -3,38 +3,107 @@
 
 #include <QStringList>
 #include <QThread>
+#include <memory>
+
+#include "FileIndex.hpp"
+#include "FuzzyMatcher.hpp"
+#include "GlobMatcher.hpp"
+#include "PathStore.hpp"
+#include "SpscRing.hpp"
 #include <QTimer>
 #include <QWidget>
 
+class QLabel;
 class QLineEdit;
-class QListWidget;
+class QListView;
+class FileListModel;
 class FileScannerWorker;
 class FileFilterWorker;
+class FileWatcher;
 class LoadingWidget;
+class ScanThrottle;
+
+// Batches of relative paths from the scanner threads to the UI thread
+using FileBatchRing = SpscRing<QStringList>;
 
 class FileScannerWorker : public QObject {
     Q_OBJECT
   public:
     explicit FileScannerWorker(QObject *parent = nullptr);
     void setRootDir(const QString &dir);
+    // With a loaded index only changed directories are listed, otherwise the whole tree is
+    // scanned. The result is written back to indexFile either way.
+    void setIndex(const FileIndex &index, const QString &indexFile);
+
+    // A full scan pushes its results into ring(). The consumer must release() the throttle
+    // for every batch it pops, the scanner stalls once too many batches are pending.
+    std::shared_ptr<ScanThrottle> throttle() const { return scanThrottle; }
+    std::shared_ptr<FileBatchRing> ring() const { return batchRing; }
 
   public slots:
     void start();
 
   signals:
-
-    void filesChunkFound(const QStringList &chunk);
+    void indexRefreshed(const PathStore &files);
+    // Directories with their mtime when they were listed
+    void directoriesScanned(const QHash<QString, qint64> &relDirs);
     void finished(qint64 elapsedMs);
 
   private:
-    void scanDir(const QString &rootPath, QStringList &buffer);
+    void scanDir(const QString &rootPath);
+    void refreshIndex();
     QString rootDir;
+    QString indexFile;
+    FileIndex index;
+    std::shared_ptr<ScanThrottle> scanThrottle;
+    std::shared_ptr<FileBatchRing> batchRing;
+};
+
+// Filters file lists on its own thread. Requests are tagged with a generation, and
+// a newer full request makes older ones abort at the next chunk boundary.
+// Results are indices into the filtered list in display order, sorted by path unless they
+// are ranked by a query.
+class FileFilterWorker : public QObject {
+    Q_OBJECT
+  public:
+    explicit FileFilterWorker(QObject *parent = nullptr);
+
+    // Thread safe, may be called while a filter pass is running
+    void cancelOlderThan(quint64 generation);
+
+  public slots:
+    // Only files from `first` on are filtered, earlier ones were handled by a previous pass
+    void filter(quint64 generation, const PathStore &files, qsizetype first,
+                const QStringList &excludePatterns, const QStringList &showPatterns, bool append);
+
+  signals:
+    // matchCount is more than rows when only the best ranked matches are in rows
+    void filteringDone(quint64 generation, const PathStore &files, const QList<qsizetype> &rows,
+                       bool append, bool ranked, qsizetype matchCount);
+
+  private:
+    bool isStale(quint64 generation) const;
+    QList<qsizetype> filterByGlobs(quint64 generation, const PathStore &files, qsizetype first,
+                                   const GlobMatcher &excludes, const GlobMatcher &shows);
+    QList<qsizetype> rankTerms(quint64 generation, const PathStore &files, qsizetype first,
+                               const QStringList &excludePatterns, const GlobMatcher &excludes,
+                               const GlobMatcher &shows, const QStringList &words, bool append,
+                               qsizetype &matchCount);
+
+    std::atomic<quint64> latestGeneration{0};
+
+    // State of the last complete ranked pass over the full list
+    FuzzyMatcher matcher;
+    QList<qsizetype> candidates;
+    QString lastTerm;
+    QStringList lastExcludePatterns;
 };
 
 class FilesList : public QWidget {
     Q_OBJECT
   public:
     explicit FilesList(QWidget *parent = nullptr);
+    ~FilesList();
 
     void setFiles(const QStringList &files);
     void setDir(const QString &dir);
@@ -44,24 +113,58 @@ class FilesList : public QWidget {
   signals:
     void fileSelected(const QString &filename);
     void filtersChanged();
-    void requestFiltering(const QStringList &files, const QStringList &excludePatterns,
-                          const QStringList &showPatterns);
+    // Relative paths of files that changed on disk after the initial scan
+    void filesChanged(const QStringList &created, const QStringList &changed,
+                      const QStringList &deleted);
+    void requestFiltering(quint64 generation, const PathStore &files, qsizetype first,
+                          const QStringList &excludePatterns, const QStringList &showPatterns,
+                          bool append);
 
   private slots:
     void scheduleUpdateList();
-    void updateList(const QStringList &files, bool clearList);
+    // Filters fullList from `first` on, a full pass (clearList) replaces the shown rows
+    void updateList(qsizetype first, bool clearList);
+    void showFilteredFiles(quint64 generation, const PathStore &files,
+                           const QList<qsizetype> &rows, bool append, bool ranked,
+                           qsizetype matchCount);
+    void drainScanResults();
+    void applyChanges(const QStringList &added, const QStringList &modified,
+                      const QStringList &removed, const QStringList &removedDirs,
+                      const QStringList &listed);
+    void rescan();
 
   private:
+    void startScan(const FileIndex &index, bool initialScan);
+    void startWatcher();
+    void finishScan();
+
     LoadingWidget *loadingWidget = nullptr;
-    QListWidget *list = nullptr;
+    QListView *list = nullptr;
+    // Says how many matches the ranked list leaves out
+    QLabel *limitLabel = nullptr;
+    FileListModel *model = nullptr;
     QLineEdit *excludeEdit = nullptr;
     QLineEdit *showEdit = nullptr;
 
     QString directory;
-    QStringList fullList;
+    PathStore fullList;
+    std::shared_ptr<ScanThrottle> scanThrottle;
+    std::shared_ptr<FileBatchRing> scanRing;
+    quint64 scanGeneration = 0;
+    bool scanFinished = false;
+
+    // Batch taken from the ring that was not fully added to fullList yet
+    QStringList drainBatch;
+    qsizetype drainOffset = 0;
+    qsizetype drainLimit = 1024;
+    double lastMergeMs = 0;
+    qsizetype lastDrained = 0;
+    QTimer *drainTimer = nullptr;
+    FileWatcher *watcher = nullptr;
 
     QThread *filterThread = nullptr;
     FileFilterWorker *filterWorker = nullptr;
+    quint64 filterGeneration = 0;
     QTimer *updateTimer = nullptr;
 };
 
@@ -0,0 +1,200 @@
+#include "FuzzyMatcher.hpp"
+
+#include <QVarLengthArray>
+
+#include <algorithm>
+#include <array>
+
+namespace {
+
+constexpr int ScoreMatch = 16;
+constexpr int BonusPathStart = 10;
+constexpr int BonusPathSeparator = 10;
+constexpr int BonusDelimiter = 8;
+constexpr int BonusCamelCase = 7;
+constexpr int BonusConsecutive = 5;
+constexpr int BonusFileName = 4;
+constexpr int PenaltyGapStart = 3;
+constexpr int PenaltyGapExtension = 1;
+
+constexpr auto AsciiLower = [] {
+    auto table = std::array<char16_t, 128>();
+    for (auto ch = 0; ch < 128; ++ch) {
+        table[ch] = char16_t((ch >= 'A' && ch <= 'Z') ? ch + 32 : ch);
+    }
+    return table;
+}();
+
+inline char16_t lower(char16_t ch) {
+    return ch < 128 ? AsciiLower[ch] : QChar(ch).toCaseFolded().unicode();
+}
+
+inline int charBit(char16_t ch) {
+    ch = lower(ch);
+    if (ch >= u'a' && ch <= u'z') {
+        return ch - u'a';
+    }
+    if (ch >= u'0' && ch <= u'9') {
+        return 26 + (ch - u'0');
+    }
+    switch (ch) {
+    case u'.':
+        return 36;
+    case u'_':
+        return 37;
+    case u'-':
+        return 38;
+    case u'/':
+        return 39;
+    default:
+        return ch < 128 ? 40 : 41;
+    }
+}
+
+int boundaryBonus(QStringView text, qsizetype i) {
+    if (i == 0) {
+        return BonusPathStart;
+    }
+    auto prev = text[i - 1];
+    if (prev == u'/') {
+        return BonusPathSeparator;
+    }
+    if (prev == u'_' || prev == u'-' || prev == u'.' || prev == u' ') {
+        return BonusDelimiter;
+    }
+    if (prev.isLower() && text[i].isUpper()) {
+        return BonusCamelCase;
+    }
+    return 0;
+}
+
+} // namespace
+
+void FuzzyMatcher::setPaths(const PathStore &paths) {
+    pathStore = paths;
+    auto dirMasks = QList<quint64>(paths.dirCount());
+    for (auto dir = PathStore::DirId(0); dir < paths.dirCount(); ++dir) {
+        dirMasks[dir] = charMask(paths.dirPath(dir));
+    }
+    masks.resize(paths.size());
+    for (auto i = qsizetype(0); i < paths.size(); ++i) {
+        masks[i] = dirMasks[paths.dirOf(i)] | charMask(paths.name(i));
+    }
+}
+
+quint64 FuzzyMatcher::charMask(QStringView text) {
+    auto mask = quint64(0);
+    for (auto ch : text) {
+        mask |= quint64(1) << charBit(ch.unicode());
+    }
+    return mask;
+}
+
+FuzzyMatcher::Term FuzzyMatcher::parseTerm(QStringView word) {
+    auto fuzzy = word.startsWith(u'~');
+    auto text = (fuzzy ? word.sliced(1) : word).toString();
+    return {text, fuzzy, charMask(text)};
+}
+
+int FuzzyMatcher::score(const Term &term, QStringView path) {
+    if (!term.fuzzy && !path.contains(term.text, Qt::CaseInsensitive)) {
+        return -1;
+    }
+    return score(term.text, path);
+}
+
+int FuzzyMatcher::score(QStringView query, QStringView text) {
+    if (query.isEmpty()) {
+        return 0;
+    }
+
+    // Fold the query once, the text is folded on the fly
+    auto pattern = QVarLengthArray<char16_t, 64>(query.size());
+    for (auto i = qsizetype(0); i < query.size(); ++i) {
+        pattern[i] = lower(query[i].unicode());
+    }
+    auto const patternSize = pattern.size();
+    auto const *chars = text.utf16();
+    auto const textSize = text.size();
+
+    // Forward: find where the first complete match ends
+    auto qi = qsizetype(0);
+    auto end = qsizetype(-1);
+    for (auto ti = qsizetype(0); ti < textSize; ++ti) {
+        if (lower(chars[ti]) == pattern[qi] && ++qi == patternSize) {
+            end = ti;
+            break;
+        }
+    }
+    if (end < 0) {
+        return -1;
+    }
+
+    // Backward: shortest window ending there
+    auto start = end;
+    qi = patternSize - 1;
+    for (auto ti = end; ti >= 0; --ti) {
+        if (lower(chars[ti]) == pattern[qi] && qi-- == 0) {
+            start = ti;
+            break;
+        }
+    }
+
+    auto nameStart = text.lastIndexOf(u'/') + 1;
+    auto score = 0;
+    auto consecutive = false;
+    auto inGap = false;
+    qi = 0;
+    for (auto ti = start; ti <= end && qi < patternSize; ++ti) {
+        if (lower(chars[ti]) == pattern[qi]) {
+            score += ScoreMatch + boundaryBonus(text, ti);
+            if (consecutive) {
+                score += BonusConsecutive;
+            }
+            if (ti >= nameStart) {
+                score += BonusFileName;
+            }
+            consecutive = true;
+            inGap = false;
+            ++qi;
+        } else {
+            score -= inGap ? PenaltyGapExtension : PenaltyGapStart;
+            consecutive = false;
+            inGap = true;
+        }
+    }
+    return qMax(score, 0);
+}
+
+void FuzzyMatcher::selectTop(QList<Match> &matches, qsizetype limit) const {
+    auto better = [this](const Match &a, const Match &b) {
+        if (a.score != b.score) {
+            return a.score > b.score;
+        }
+        auto sizeA = pathStore.pathSize(a.index);
+        auto sizeB = pathStore.pathSize(b.index);
+        if (sizeA != sizeB) {
+            return sizeA < sizeB;
+        }
+        return pathStore.lessThan(a.index, b.index);
+    };
+    auto count = qMin(limit, matches.size());
+    std::partial_sort(matches.begin(), matches.begin() + count, matches.end(), better);
+    matches.resize(count);
+}
+
+QList<FuzzyMatcher::Match> FuzzyMatcher::match(const Term &term, qsizetype limit) const {
+    auto matches = QList<Match>();
+    auto path = QString();
+    for (auto i = qsizetype(0); i < pathStore.size(); ++i) {
+        if (!mayMatch(i, term.mask)) {
+            continue;
+        }
+        pathStore.path(i, path);
+        if (auto s = score(term, path); s >= 0) {
+            matches << Match{s, i};
+        }
+    }
+    selectTop(matches, limit);
+    return matches;
+}
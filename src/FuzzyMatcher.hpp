@@ -0,0 +1,60 @@
+#pragma once
+
+#include "PathStore.hpp"
+
+#include <QList>
+#include <QString>
+#include <QStringView>
+
+// Quick-open style matching over a list of relative paths.
+//
+// A plain term matches a path that contains it, a fuzzy term (`~` in front) a path where
+// its characters appear in order. Both are case insensitive and ranked the same way.
+// Matches are scored on the shortest window that contains the query, with bonuses
+// for characters right after a path separator, a delimiter (`_`, `-`, `.`) or a
+// camelCase boundary, for consecutive characters and for hits inside the file name,
+// and penalties for gaps.
+//
+// setPaths() computes a 64 bit character mask per path, directory masks are computed once
+// and shared by their files. A path can only match when it contains every character of
+// the query, so most paths are rejected by a single AND before any scoring happens.
+class FuzzyMatcher {
+  public:
+    struct Match {
+        int score = 0;
+        qsizetype index = 0;
+    };
+
+    struct Term {
+        QString text;
+        bool fuzzy = false;
+        quint64 mask = 0;
+    };
+    // A word of the show filter, `~word` is fuzzy
+    static Term parseTerm(QStringView word);
+
+    void setPaths(const PathStore &paths);
+    const PathStore &paths() const { return pathStore; }
+    bool isIndexed(const PathStore &paths) const { return pathStore.isSharedWith(paths); }
+
+    static quint64 charMask(QStringView text);
+    bool mayMatch(qsizetype index, quint64 queryMask) const {
+        return (masks[index] & queryMask) == queryMask;
+    }
+
+    // Returns -1 when query is not a subsequence of text
+    static int score(QStringView query, QStringView text);
+    // Returns -1 when path does not match term
+    static int score(const Term &term, QStringView path);
+
+    // Moves the best `limit` matches to the front, ordered by score, then shorter path,
+    // then name. The list is truncated to `limit` entries.
+    void selectTop(QList<Match> &matches, qsizetype limit) const;
+
+    // Single threaded convenience: prefilter, score and rank the whole list
+    QList<Match> match(const Term &term, qsizetype limit) const;
+
+  private:
+    PathStore pathStore;
+    QList<quint64> masks;
+};
@@ -0,0 +1,198 @@
+#include "GlobMatcher.hpp"
+
+#include <bit>
+
+namespace {
+
+inline char16_t fold(char16_t ch) {
+    if (ch < 128) {
+        return (ch >= u'A' && ch <= u'Z') ? char16_t(ch + 32) : ch;
+    }
+    return QChar(ch).toCaseFolded().unicode();
+}
+
+// `folded` is already case folded, only `text` needs folding
+inline bool equalFolded(QStringView text, QStringView folded) {
+    if (text.size() != folded.size()) {
+        return false;
+    }
+    for (auto i = qsizetype(0); i < text.size(); ++i) {
+        if (fold(text[i].unicode()) != folded[i].unicode()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+inline bool containsFolded(QStringView text, QStringView folded) {
+    for (auto i = qsizetype(0); i + folded.size() <= text.size(); ++i) {
+        if (equalFolded(text.sliced(i, folded.size()), folded)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Iterative `*` / `?` matcher, backtracks only to the last star
+bool globMatch(QStringView pattern, QStringView text) {
+    auto p = qsizetype(0);
+    auto t = qsizetype(0);
+    auto star = qsizetype(-1);
+    auto mark = qsizetype(0);
+    while (t < text.size()) {
+        if (p < pattern.size() && pattern[p] == u'*') {
+            star = p++;
+            mark = t;
+        } else if (p < pattern.size() &&
+                   (pattern[p] == u'?' || pattern[p].unicode() == fold(text[t].unicode()))) {
+            ++p;
+            ++t;
+        } else if (star != -1) {
+            p = star + 1;
+            t = ++mark;
+        } else {
+            return false;
+        }
+    }
+    while (p < pattern.size() && pattern[p] == u'*') {
+        ++p;
+    }
+    return p == pattern.size();
+}
+
+} // namespace
+
+GlobMatcher::GlobMatcher(const QStringList &rawPatterns) {
+    for (auto const &raw : rawPatterns) {
+        auto trimmed = raw.trimmed();
+        if (trimmed.isEmpty()) {
+            continue;
+        }
+
+        auto pattern = Pattern();
+        pattern.folded.reserve(trimmed.size());
+        for (auto ch : std::as_const(trimmed)) {
+            pattern.folded += QChar(fold(ch.unicode()));
+        }
+        auto const &folded = pattern.folded;
+        auto isWildcard = [](QChar ch) { return ch == u'*' || ch == u'?'; };
+
+        auto stars = folded.count(u'*');
+        auto questions = folded.count(u'?');
+        pattern.minLength = folded.size() - stars;
+        pattern.prefixLength = 0;
+        while (pattern.prefixLength < folded.size() && !isWildcard(folded[pattern.prefixLength])) {
+            ++pattern.prefixLength;
+        }
+        pattern.suffixLength = 0;
+        while (pattern.suffixLength < folded.size() &&
+               !isWildcard(folded[folded.size() - 1 - pattern.suffixLength])) {
+            ++pattern.suffixLength;
+        }
+
+        if (stars == 0 && questions == 0) {
+            pattern.kind = Kind::Exact;
+        } else if (stars == folded.size()) {
+            pattern.kind = Kind::Any;
+        } else if (questions == 0 && stars == 1 && folded.endsWith(u'*')) {
+            pattern.kind = Kind::Prefix;
+        } else if (questions == 0 && stars == 1 && folded.startsWith(u'*')) {
+            pattern.kind = Kind::Suffix;
+        } else if (questions == 0 && stars == 2 && folded.startsWith(u'*') &&
+                   folded.endsWith(u'*')) {
+            pattern.kind = Kind::Contains;
+        } else {
+            pattern.kind = Kind::General;
+        }
+
+        auto index = patterns.size();
+        if (index < MaskBits) {
+            // Patterns past the mask width are always tried, see matches()
+            auto bit = quint64(1) << index;
+            if (pattern.prefixLength == 0) {
+                anyFirst |= bit;
+            } else if (auto ch = folded.front().unicode(); ch < TableSize) {
+                firstChar[ch] |= bit;
+            } else {
+                nonAsciiFirst |= bit;
+            }
+            if (pattern.suffixLength == 0) {
+                anyLast |= bit;
+            } else if (auto ch = folded.back().unicode(); ch < TableSize) {
+                lastChar[ch] |= bit;
+            } else {
+                nonAsciiLast |= bit;
+            }
+        }
+        patterns << pattern;
+    }
+}
+
+quint64 GlobMatcher::candidates(QStringView segment) const {
+    auto first = fold(segment.front().unicode());
+    auto last = fold(segment.back().unicode());
+    auto byFirst = anyFirst | (first < TableSize ? firstChar[first] : nonAsciiFirst);
+    auto byLast = anyLast | (last < TableSize ? lastChar[last] : nonAsciiLast);
+    return byFirst & byLast;
+}
+
+bool GlobMatcher::matchPattern(const Pattern &pattern, QStringView segment) const {
+    if (segment.size() < pattern.minLength) {
+        return false;
+    }
+    auto folded = QStringView(pattern.folded);
+    switch (pattern.kind) {
+    case Kind::Exact:
+        return equalFolded(segment, folded);
+    case Kind::Prefix:
+        return equalFolded(segment.first(pattern.prefixLength),
+                           folded.first(pattern.prefixLength));
+    case Kind::Suffix:
+        return equalFolded(segment.last(pattern.suffixLength), folded.last(pattern.suffixLength));
+    case Kind::Contains:
+        return containsFolded(segment, folded.sliced(1, folded.size() - 2));
+    case Kind::Any:
+        return true;
+    case Kind::General:
+        break;
+    }
+    return globMatch(folded, segment);
+}
+
+bool GlobMatcher::matches(QStringView segment) const {
+    if (segment.isEmpty()) {
+        for (auto const &pattern : patterns) {
+            if (pattern.minLength == 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+    for (auto mask = candidates(segment); mask != 0; mask &= mask - 1) {
+        if (matchPattern(patterns[std::countr_zero(mask)], segment)) {
+            return true;
+        }
+    }
+    for (auto i = qsizetype(MaskBits); i < patterns.size(); ++i) {
+        if (matchPattern(patterns[i], segment)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool GlobMatcher::matchesAnySegment(QStringView path) const {
+    if (patterns.isEmpty()) {
+        return false;
+    }
+    auto start = qsizetype(0);
+    for (auto i = qsizetype(0); i <= path.size(); ++i) {
+        if (i == path.size() || path[i] == u'/') {
+            if (i > start && matches(path.sliced(start, i - start))) {
+                return true;
+            }
+            start = i + 1;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <QList>
+#include <QString>
+#include <QStringList>
+#include <QStringView>
+
+#include <array>
+
+// Matches path segments against a set of glob patterns (`*` and `?`), case insensitive.
+//
+// All patterns are compiled together. Each pattern is reduced to its literal prefix and
+// suffix, and two tables indexed by the first and last character of a segment give a
+// bitset of the patterns that could still match. Most segments are rejected with those
+// two lookups, the remaining candidates use a fast path for the common shapes
+// (`name`, `name*`, `*name`, `*name*`) and a backtracking matcher otherwise.
+// Matching works directly on UTF-16 views and never allocates.
+//
+// A compiled matcher is immutable and can be shared between threads.
+class GlobMatcher {
+  public:
+    GlobMatcher() = default;
+    explicit GlobMatcher(const QStringList &patterns);
+
+    bool isEmpty() const { return patterns.isEmpty(); }
+    qsizetype size() const { return patterns.size(); }
+
+    bool matches(QStringView segment) const;
+    // True if any `/` separated segment of path matches
+    bool matchesAnySegment(QStringView path) const;
+
+  private:
+    enum class Kind { Exact, Prefix, Suffix, Contains, Any, General };
+
+    struct Pattern {
+        QString folded;
+        Kind kind = Kind::General;
+        qsizetype prefixLength = 0;
+        qsizetype suffixLength = 0;
+        qsizetype minLength = 0;
+    };
+
+    static constexpr int TableSize = 128;
+    static constexpr int MaskBits = 64;
+
+    bool matchPattern(const Pattern &pattern, QStringView segment) const;
+    quint64 candidates(QStringView segment) const;
+
+    QList<Pattern> patterns;
+    std::array<quint64, TableSize> firstChar{};
+    std::array<quint64, TableSize> lastChar{};
+    quint64 anyFirst = 0;
+    quint64 anyLast = 0;
+    quint64 nonAsciiFirst = 0;
+    quint64 nonAsciiLast = 0;
+};
@@ -0,0 +1,104 @@
+#include "HoverCache.hpp"
+
+#include <algorithm>
+#include <iterator>
+#include <tuple>
+
+bool HoverCache::Range::contains(int line, int column) const {
+    auto position = std::tie(line, column);
+    return std::tie(startLine, startColumn) <= position && position < std::tie(endLine, endColumn);
+}
+
+HoverCache::HoverCache(std::size_t maxBytes) : maxBytes(maxBytes) {}
+
+std::optional<std::string> HoverCache::find(const std::string &document, int version, int line,
+                                            int column) {
+    auto it = byDocument.find(document);
+    if (it != byDocument.end()) {
+        for (auto entry : it->second) {
+            if (entry->version == version && entry->range.contains(line, column)) {
+                entries.splice(entries.begin(), entries, entry);
+                ++hits;
+                return entry->text;
+            }
+        }
+    }
+    ++misses;
+    return std::nullopt;
+}
+
+void HoverCache::insert(const std::string &document, int version, const Range &range,
+                        std::string text) {
+    auto &documentEntries = byDocument[document];
+    // A late answer for a version the document already moved on from
+    for (auto entry : documentEntries) {
+        if (entry->version > version) {
+            return;
+        }
+    }
+    // Entries of older versions can never be hit again
+    for (auto i = documentEntries.size(); i-- > 0;) {
+        auto entry = documentEntries[i];
+        if (entry->version < version ||
+            (entry->range.startLine == range.startLine &&
+             entry->range.startColumn == range.startColumn)) {
+            bytes -= sizeOf(*entry);
+            entries.erase(entry);
+            documentEntries.erase(documentEntries.begin() + i);
+        }
+    }
+
+    entries.push_front({document, version, range, std::move(text)});
+    documentEntries.push_back(entries.begin());
+    bytes += sizeOf(entries.front());
+    // Keeps at least the new entry, even if it alone is over the limit
+    while (bytes > maxBytes && entries.size() > 1) {
+        erase(std::prev(entries.end()));
+        ++evictions;
+    }
+}
+
+void HoverCache::invalidate(const std::string &document) {
+    auto it = byDocument.find(document);
+    if (it == byDocument.end()) {
+        return;
+    }
+    for (auto entry : it->second) {
+        bytes -= sizeOf(*entry);
+        entries.erase(entry);
+    }
+    byDocument.erase(it);
+}
+
+void HoverCache::clear() {
+    entries.clear();
+    byDocument.clear();
+    bytes = 0;
+}
+
+HoverCache::Stats HoverCache::stats() const {
+    auto result = Stats();
+    result.hits = hits;
+    result.misses = misses;
+    result.evictions = evictions;
+    result.entries = entries.size();
+    result.bytes = bytes;
+    return result;
+}
+
+std::size_t HoverCache::sizeOf(const Entry &entry) {
+    // List node and index slot, plus the heap blocks of both strings
+    return sizeof(Entry) + 2 * sizeof(void *) + sizeof(EntryList::iterator) +
+           entry.document.capacity() + entry.text.capacity();
+}
+
+void HoverCache::erase(EntryList::iterator entry) {
+    auto it = byDocument.find(entry->document);
+    auto &documentEntries = it->second;
+    documentEntries.erase(std::find(documentEntries.begin(), documentEntries.end(), entry));
+    if (documentEntries.empty()) {
+        byDocument.erase(it);
+    }
+    bytes -= sizeOf(*entry);
+    entries.erase(entry);
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Rendered hover texts keyed by document, document version and the symbol range the server
+// returned, so hovering anywhere on a symbol that was already asked about is answered
+// locally.
+//
+// The cache is bounded by an estimate of the memory it uses and evicts the least recently
+// used entries first. It is not thread safe, the owner has to serialise access.
+class HoverCache {
+  public:
+    struct Range {
+        int startLine = 0;
+        int startColumn = 0;
+        int endLine = 0;
+        int endColumn = 0;
+
+        bool contains(int line, int column) const;
+    };
+
+    struct Stats {
+        std::uint64_t hits = 0;
+        std::uint64_t misses = 0;
+        std::uint64_t evictions = 0;
+        std::size_t entries = 0;
+        std::size_t bytes = 0;
+    };
+
+    explicit HoverCache(std::size_t maxBytes = 1024 * 1024);
+
+    std::optional<std::string> find(const std::string &document, int version, int line,
+                                    int column);
+    // Replaces the entries of older versions of document, ignored if the cache already has a
+    // newer one
+    void insert(const std::string &document, int version, const Range &range, std::string text);
+    // Drops all entries of document, when it changed or was closed
+    void invalidate(const std::string &document);
+    void clear();
+
+    Stats stats() const;
+
+  private:
+    struct Entry {
+        std::string document;
+        int version = 0;
+        Range range;
+        std::string text;
+    };
+    using EntryList = std::list<Entry>;
+
+    static std::size_t sizeOf(const Entry &entry);
+    void erase(EntryList::iterator entry);
+
+    std::size_t maxBytes;
+    std::size_t bytes = 0;
+    // Most recently used first
+    EntryList entries;
+    std::unordered_map<std::string, std::vector<EntryList::iterator>> byDocument;
+    std::uint64_t hits = 0;
+    std::uint64_t misses = 0;
+    std::uint64_t evictions = 0;
+};
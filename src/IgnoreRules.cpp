@@ -0,0 +1,267 @@
+#include "IgnoreRules.hpp"
+
+#include <fstream>
+#include <iterator>
+
+namespace {
+
+inline bool hasWildcard(std::string_view pattern) {
+    return pattern.find_first_of("*?[\\") != std::string_view::npos;
+}
+
+// Matches `[...]` at the start of pattern against ch. Returns the length of the class, or
+// 0 if the class is not terminated and `[` has to be taken literally.
+std::size_t matchClass(std::string_view pattern, char ch, bool &matched) {
+    auto i = std::size_t(1);
+    auto negated = i < pattern.size() && (pattern[i] == '!' || pattern[i] == '^');
+    if (negated) {
+        ++i;
+    }
+    matched = false;
+    // A `]` right after the opening bracket is part of the class
+    for (auto first = true; i < pattern.size(); first = false) {
+        auto lo = pattern[i];
+        if (lo == ']' && !first) {
+            matched = matched != negated;
+            return i + 1;
+        }
+        if (lo == '\\' && i + 1 < pattern.size()) {
+            lo = pattern[++i];
+        }
+        auto hi = lo;
+        if (i + 2 < pattern.size() && pattern[i + 1] == '-' && pattern[i + 2] != ']') {
+            hi = pattern[i + 2];
+            i += 2;
+        }
+        if (ch >= lo && ch <= hi) {
+            matched = true;
+        }
+        ++i;
+    }
+    return 0;
+}
+
+// gitignore glob: `*` and `?` stop at `/`, `**/` matches any number of directories and a
+// trailing `/**` everything below
+bool globMatch(std::string_view pattern, std::string_view text) {
+    while (!pattern.empty()) {
+        auto ch = pattern.front();
+        if (ch == '*') {
+            if (pattern.size() >= 2 && pattern[1] == '*') {
+                auto rest = pattern.substr(2);
+                if (rest.empty()) {
+                    return true;
+                }
+                if (rest.front() == '/') {
+                    rest.remove_prefix(1);
+                    for (auto i = std::size_t(0);;) {
+                        if (globMatch(rest, text.substr(i))) {
+                            return true;
+                        }
+                        auto slash = text.find('/', i);
+                        if (slash == std::string_view::npos) {
+                            return false;
+                        }
+                        i = slash + 1;
+                    }
+                }
+                // `**` anywhere else is an ordinary `*`
+                pattern.remove_prefix(1);
+            }
+            auto rest = pattern.substr(1);
+            for (auto i = std::size_t(0); i <= text.size(); ++i) {
+                if (globMatch(rest, text.substr(i))) {
+                    return true;
+                }
+                if (i < text.size() && text[i] == '/') {
+                    return false;
+                }
+            }
+            return false;
+        }
+        if (text.empty()) {
+            return false;
+        }
+        if (ch == '?') {
+            if (text.front() == '/') {
+                return false;
+            }
+        } else if (ch == '[') {
+            auto matched = false;
+            if (auto length = matchClass(pattern, text.front(), matched); length > 0) {
+                if (!matched || text.front() == '/') {
+                    return false;
+                }
+                pattern.remove_prefix(length);
+                text.remove_prefix(1);
+                continue;
+            }
+            if (text.front() != '[') {
+                return false;
+            }
+        } else {
+            if (ch == '\\' && pattern.size() > 1) {
+                pattern.remove_prefix(1);
+                ch = pattern.front();
+            }
+            if (ch != text.front()) {
+                return false;
+            }
+        }
+        pattern.remove_prefix(1);
+        text.remove_prefix(1);
+    }
+    return text.empty();
+}
+
+std::string joinPath(const std::string &rootDir, const std::string &relPath) {
+    auto path = rootDir;
+    if (!path.empty() && path.back() != '/') {
+        path.push_back('/');
+    }
+    return path.append(relPath);
+}
+
+} // namespace
+
+IgnoreRules::IgnoreRules(std::shared_ptr<const IgnoreRules> parent, std::string relDir)
+    : parent(std::move(parent)), base(std::move(relDir)) {}
+
+std::shared_ptr<const IgnoreRules> IgnoreRules::forExcludeFile(const std::string &rootDir) {
+    auto exclude = std::make_shared<IgnoreRules>(nullptr, std::string());
+    exclude->addFile(joinPath(rootDir, ".git/info/exclude"));
+    if (exclude->isEmpty()) {
+        return nullptr;
+    }
+    return exclude;
+}
+
+std::shared_ptr<const IgnoreRules> IgnoreRules::forDirectory(const std::string &rootDir,
+                                                             const std::string &relDir) {
+    auto rules = forChild(forExcludeFile(rootDir), rootDir, std::string());
+    for (auto end = relDir.find('/'); end != std::string::npos; end = relDir.find('/', end + 1)) {
+        rules = forChild(rules, rootDir, relDir.substr(0, end + 1));
+    }
+    return rules;
+}
+
+std::shared_ptr<const IgnoreRules>
+IgnoreRules::forChild(const std::shared_ptr<const IgnoreRules> &parentRules,
+                      const std::string &rootDir, const std::string &relDir, const bool *hasFile) {
+    auto rules = std::shared_ptr<IgnoreRules>();
+    for (auto i = std::size_t(0); i < std::size(FileNames); ++i) {
+        if (hasFile && !hasFile[i]) {
+            continue;
+        }
+        if (!rules) {
+            rules = std::make_shared<IgnoreRules>(parentRules, relDir);
+        }
+        rules->addFile(joinPath(rootDir, relDir + FileNames[i]));
+    }
+    if (!rules || rules->isEmpty()) {
+        return parentRules;
+    }
+    return rules;
+}
+
+bool IgnoreRules::addFile(const std::string &path) {
+    auto file = std::ifstream(path, std::ios::binary);
+    if (!file) {
+        return false;
+    }
+    auto text =
+        std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    addPatterns(text);
+    return true;
+}
+
+void IgnoreRules::addPatterns(std::string_view text) {
+    while (!text.empty()) {
+        auto end = text.find('\n');
+        auto line = text.substr(0, end);
+        text.remove_prefix(end == std::string_view::npos ? text.size() : end + 1);
+
+        if (!line.empty() && line.back() == '\r') {
+            line.remove_suffix(1);
+        }
+        // Trailing spaces are dropped unless escaped
+        while (!line.empty() && line.back() == ' ' &&
+               !(line.size() >= 2 && line[line.size() - 2] == '\\')) {
+            line.remove_suffix(1);
+        }
+        if (line.empty() || line.front() == '#') {
+            continue;
+        }
+
+        auto rule = Rule();
+        if (line.front() == '!') {
+            rule.negated = true;
+            line.remove_prefix(1);
+        } else if (line.size() >= 2 && line.front() == '\\' &&
+                   (line[1] == '!' || line[1] == '#')) {
+            line.remove_prefix(1);
+        }
+        if (!line.empty() && line.back() == '/') {
+            rule.dirOnly = true;
+            line.remove_suffix(1);
+        }
+        if (line.empty()) {
+            continue;
+        }
+        // A slash anywhere but at the end anchors the pattern to this directory
+        rule.anchored = line.find('/') != std::string_view::npos;
+        if (line.front() == '/') {
+            line.remove_prefix(1);
+        }
+
+        if (!hasWildcard(line)) {
+            rule.kind = Kind::Literal;
+            rule.pattern = line;
+        } else if (!rule.anchored && line.front() == '*' && !hasWildcard(line.substr(1))) {
+            rule.kind = Kind::Suffix;
+            rule.pattern = line.substr(1);
+        } else {
+            rule.kind = Kind::Glob;
+            rule.pattern = line;
+        }
+        rules.push_back(std::move(rule));
+    }
+}
+
+bool IgnoreRules::isIgnored(std::string_view relPath, bool isDir) const {
+    auto name = relPath.substr(relPath.rfind('/') + 1);
+    for (auto node = this; node; node = node->parent.get()) {
+        if (auto result = node->match(relPath, name, isDir); result >= 0) {
+            return result == 1;
+        }
+    }
+    return false;
+}
+
+int IgnoreRules::match(std::string_view relPath, std::string_view name, bool isDir) const {
+    auto rel = relPath.substr(base.size());
+    // The last matching rule wins
+    for (auto it = rules.rbegin(); it != rules.rend(); ++it) {
+        if (it->dirOnly && !isDir) {
+            continue;
+        }
+        auto text = it->anchored ? rel : name;
+        auto matched = false;
+        switch (it->kind) {
+        case Kind::Literal:
+            matched = text == it->pattern;
+            break;
+        case Kind::Suffix:
+            matched = text.size() >= it->pattern.size() &&
+                      text.substr(text.size() - it->pattern.size()) == it->pattern;
+            break;
+        case Kind::Glob:
+            matched = globMatch(it->pattern, text);
+            break;
+        }
+        if (matched) {
+            return it->negated ? 0 : 1;
+        }
+    }
+    return -1;
+}
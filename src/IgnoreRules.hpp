@@ -0,0 +1,60 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// gitignore style rules of one directory, chained to the rules of its parents.
+//
+// Supports comments, `!` negation, trailing `/` for directories only, anchoring by a
+// leading or inner `/`, `*`, `?`, `[...]` classes and `**`. Later rules override earlier
+// ones and rules of deeper directories override their parents, as in git.
+//
+// A node is immutable once built and shared between all directories below it that have
+// no ignore file of their own, so scanner threads can use it without locking.
+class IgnoreRules {
+  public:
+    // Names of the per directory ignore files, in increasing precedence
+    static constexpr const char *FileNames[] = {".gitignore", ".ignore"};
+
+    IgnoreRules(std::shared_ptr<const IgnoreRules> parent, std::string relDir);
+
+    // Rules of `.git/info/exclude`, null if there are none. They have a lower precedence
+    // than any ignore file, so the root directory's rules are a child of this node.
+    static std::shared_ptr<const IgnoreRules> forExcludeFile(const std::string &rootDir);
+    // Rules in effect inside relDir, reads the ignore files of every directory on the way
+    static std::shared_ptr<const IgnoreRules> forDirectory(const std::string &rootDir,
+                                                           const std::string &relDir);
+    // Rules for relDir (the root or a sub directory of parentRules), returns parentRules if
+    // it has no ignore file of its own. hasFile tells which of FileNames exist, if known.
+    static std::shared_ptr<const IgnoreRules>
+    forChild(const std::shared_ptr<const IgnoreRules> &parentRules, const std::string &rootDir,
+             const std::string &relDir, const bool *hasFile = nullptr);
+
+    // Returns false if the file could not be read
+    bool addFile(const std::string &path);
+    void addPatterns(std::string_view text);
+    bool isEmpty() const { return rules.empty(); }
+
+    // relPath is relative to the project root, directories without the trailing `/`
+    bool isIgnored(std::string_view relPath, bool isDir) const;
+
+  private:
+    enum class Kind { Literal, Suffix, Glob };
+
+    struct Rule {
+        std::string pattern;
+        Kind kind = Kind::Glob;
+        bool negated = false;
+        bool dirOnly = false;
+        bool anchored = false;
+    };
+
+    // 1 ignored, 0 explicitly included, -1 no rule of this node matched
+    int match(std::string_view relPath, std::string_view name, bool isDir) const;
+
+    std::shared_ptr<const IgnoreRules> parent;
+    std::string base;
+    std::vector<Rule> rules;
+};
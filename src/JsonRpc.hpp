@@ -0,0 +1,28 @@
+#pragma once
+
+#include <QJsonObject>
+#include <QJsonValue>
+#include <QString>
+
+// JSON-RPC pieces shared by the servers that speak LSP themselves: clangd_mux, lsp_mock and
+// lsp_replay.
+namespace jsonrpc {
+
+// Error codes of JSON-RPC and LSP
+constexpr int InvalidRequest = -32600;
+constexpr int InternalError = -32603;
+constexpr int ServerNotInitialized = -32002;
+constexpr int RequestCancelled = -32800;
+
+// Request ids are numbers or strings, both count as the same request on either side
+inline QString idKey(const QJsonValue &id) {
+    return id.isString() ? "s" + id.toString() : "n" + QString::number(id.toInteger());
+}
+
+inline QJsonObject errorResponse(const QJsonValue &id, int code, const QString &message) {
+    return {{"jsonrpc", "2.0"},
+            {"id", id},
+            {"error", QJsonObject{{"code", code}, {"message", message}}}};
+}
+
+} // namespace jsonrpc
@@ -0,0 +1,74 @@
+#include "LatencyHistogram.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdio>
+
+int LatencyHistogram::bucketOf(std::uint64_t micros) {
+    if (micros < SubBuckets) {
+        return int(micros);
+    }
+    auto msb = std::bit_width(micros) - 1;
+    auto sub = (micros >> (msb - SubBucketBits)) & (SubBuckets - 1);
+    return int((msb - SubBucketBits + 1) * SubBuckets + sub);
+}
+
+std::uint64_t LatencyHistogram::upperBound(int bucket) {
+    if (bucket < SubBuckets) {
+        return bucket;
+    }
+    auto shift = bucket / SubBuckets - 1;
+    auto lower = std::uint64_t(SubBuckets + bucket % SubBuckets) << shift;
+    return lower + (std::uint64_t(1) << shift) - 1;
+}
+
+void LatencyHistogram::record(std::chrono::nanoseconds latency) {
+    auto micros = std::uint64_t(std::max<std::int64_t>(latency.count(), 0) / 1000);
+    buckets[bucketOf(micros)].fetch_add(1, std::memory_order_relaxed);
+    total.fetch_add(1, std::memory_order_relaxed);
+    auto seen = maxMicros.load(std::memory_order_relaxed);
+    while (micros > seen && !maxMicros.compare_exchange_weak(seen, micros)) {
+    }
+}
+
+void LatencyHistogram::reset() {
+    for (auto &bucket : buckets) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+    total.store(0, std::memory_order_relaxed);
+    maxMicros.store(0, std::memory_order_relaxed);
+}
+
+std::uint64_t LatencyHistogram::count() const { return total.load(std::memory_order_relaxed); }
+
+std::chrono::microseconds LatencyHistogram::quantile(double q) const {
+    auto n = count();
+    if (n == 0) {
+        return {};
+    }
+    auto rank = std::max<std::uint64_t>(1, std::uint64_t(std::ceil(std::clamp(q, 0.0, 1.0) * n)));
+    auto seen = std::uint64_t(0);
+    for (auto i = 0; i < BucketCount; ++i) {
+        seen += buckets[i].load(std::memory_order_relaxed);
+        if (seen >= rank) {
+            // The bucket bound may lie above the largest value actually seen
+            return std::chrono::microseconds(std::min(upperBound(i), maxMicros.load()));
+        }
+    }
+    return max();
+}
+
+std::chrono::microseconds LatencyHistogram::max() const {
+    return std::chrono::microseconds(maxMicros.load(std::memory_order_relaxed));
+}
+
+std::string LatencyHistogram::summary() const {
+    auto format = [](std::chrono::microseconds value) {
+        char text[32];
+        std::snprintf(text, sizeof(text), "%.1f ms", value.count() / 1000.0);
+        return std::string(text);
+    };
+    return "p50 " + format(quantile(0.5)) + ", p90 " + format(quantile(0.9)) + ", p99 " +
+           format(quantile(0.99)) + ", max " + format(max());
+}
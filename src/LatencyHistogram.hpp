@@ -0,0 +1,38 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+// Lock free latency histogram for request round trips.
+//
+// Values are kept in microseconds in log2 buckets, each split into 8 linear sub-buckets,
+// so a quantile is reported with at most 12.5% error at any scale. record() can be
+// called from any thread while another one reads quantiles.
+class LatencyHistogram {
+  public:
+    void record(std::chrono::nanoseconds latency);
+    void reset();
+
+    std::uint64_t count() const;
+    // Upper bound of the bucket holding quantile q (0..1), zero if nothing was recorded
+    std::chrono::microseconds quantile(double q) const;
+    std::chrono::microseconds max() const;
+
+    // "p50 1.2 ms, p90 3.4 ms, p99 12 ms, max 40 ms"
+    std::string summary() const;
+
+  private:
+    static constexpr int SubBucketBits = 3;
+    static constexpr int SubBuckets = 1 << SubBucketBits;
+    static constexpr int BucketCount = 64 * SubBuckets;
+
+    static int bucketOf(std::uint64_t micros);
+    static std::uint64_t upperBound(int bucket);
+
+    std::array<std::atomic<std::uint64_t>, BucketCount> buckets{};
+    std::atomic<std::uint64_t> total{0};
+    std::atomic<std::uint64_t> maxMicros{0};
+};
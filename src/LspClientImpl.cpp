@@ -1,19 +1,99 @@
 #include <cstring>
+#include <future>
 #include <iostream>
+#include <optional>
+#include <type_traits>
+#include <variant>
 
 #include "LspClientImpl.hpp"
+#include "LspReactor.hpp"
+#include "ServerProcess.hpp"
+#include "SessionRecorder.hpp"
+#include "SpanTrace.hpp"
+#include "WireTrace.hpp"
 #include "lsp/fileuri.h"
 
+namespace {
+
+// How long the server gets to answer `shutdown`, and then to exit after `exit`
+constexpr auto ShutdownTimeout = std::chrono::milliseconds(2000);
+constexpr auto ExitTimeout = std::chrono::milliseconds(500);
+// From hover() to the answer, including the wait in the scheduler
+constexpr const char *HoverSpan = "hover round trip";
+
+std::string hoverText(const decltype(lsp::Hover::contents) &contents) {
+    auto text = std::string();
+    std::visit(
+        [&](const auto &value) {
+            using T = std::decay_t<decltype(value)>;
+
+            if constexpr (std::is_same_v<T, lsp::MarkupContent>) {
+                text = value.value;
+            } else if constexpr (std::is_same_v<T, std::string>) {
+                text = value;
+            } else if constexpr (std::is_same_v<T, lsp::MarkedString_Language_Value>) {
+                text = "[" + value.language + "] " + value.value;
+            } else if constexpr (std::is_same_v<T, std::vector<lsp::MarkedString>>) {
+                for (const auto &item : value) {
+                    std::visit(
+                        [&](const auto &inner) {
+                            using InnerT = std::decay_t<decltype(inner)>;
+                            if (!text.empty()) {
+                                text += '\n';
+                            }
+                            if constexpr (std::is_same_v<InnerT, std::string>) {
+                                text += inner;
+                            } else if constexpr (std::is_same_v<
+                                                     InnerT, lsp::MarkedString_Language_Value>) {
+                                text += "[" + inner.language + "] " + inner.value;
+                            }
+                        },
+                        item);
+                }
+            }
+        },
+        contents);
+    return text;
+}
+
+} // namespace
+
 LspClientImpl::LspClientImpl() {}
 
-void LspClientImpl::debugIO(bool enable) { (void)enable; }
+void LspClientImpl::debugIO(bool enable) {
+    auto &trace = WireTrace::instance();
+    if (enable) {
+        printRequestStats(std::cerr);
+        auto path = WireTrace::defaultPath();
+        if (trace.start(path)) {
+            std::cerr << "Tracing LSP messages to " << path << "\n";
+        } else {
+            std::cerr << "Cannot write LSP trace to " << path << "\n";
+        }
+    } else if (trace.isRunning()) {
+        trace.stop();
+        std::cerr << trace.latencyTable();
+    }
+}
+
+void LspClientImpl::setServerCommand(std::vector<std::string> command) {
+    m_serverCommand = std::move(command);
+}
+
+void LspClientImpl::setSessionRecording(std::string path) { m_recordingPath = std::move(path); }
 
 void LspClientImpl::setDocumentRoot(const std::string &newRoot) {
+    if (m_initialized) {
+        // A server is initialized only once, another project gets a fresh one
+        shutdownLspServer();
+        stopClangd();
+        startClangd();
+    }
     m_documentRoot = newRoot;
     initializeLspServer();
 }
 
-void LspClientImpl::openDocument(const std::string &fileName, const std::string &fileContents) {
+void LspClientImpl::openDocument(const std::string &fileName, std::string fileContents) {
     if (!m_running) {
         return;
     }
@@ -23,39 +103,492 @@ void LspClientImpl::openDocument(const std::string &fileName, const std::string
             .uri = lsp::FileUri::fromPath(fileName),
             .languageId = "cpp", // or "c", "python", etc.
             .version = 1,
-            .text = fileContents // The full text of the opened file
+            .text = std::move(fileContents) // The full text of the opened file
         }};
+    m_documentVersions[fileName] = 1;
+    invalidateHovers(fileName);
     m_messageHandler->sendNotification<lsp::notifications::TextDocument_DidOpen>(std::move(params));
 }
 
-void LspClientImpl::hover(
-    const std::string &fileName, int line, int column,
-    std::function<void(lsp::requests::TextDocument_Hover::Result &&result)> callback) {
+bool LspClientImpl::incrementalSync() const {
+    return m_syncKind == lsp::TextDocumentSyncKind::Incremental;
+}
 
-    if (!m_running) {
+void LspClientImpl::changeDocument(const std::string &fileName,
+                                   const std::vector<DocumentEdit> &edits) {
+    if (!m_running || edits.empty() || m_syncKind == lsp::TextDocumentSyncKind::None) {
         return;
     }
 
-    lsp::HoverParams params;
+    lsp::notifications::TextDocument_DidChange::Params params;
     params.textDocument.uri = lsp::FileUri::fromPath(fileName);
-    params.position.line = line;
-    params.position.character = column;
-    // params.workDoneToken
-
-    m_messageHandler->sendRequest<lsp::requests::TextDocument_Hover>(
-        std::move(params),
-        [callback = std::move(callback)](auto result) { callback(std::move(result)); },
-        [](const lsp::Error &error) {
-            std::cerr << "Failed to get response from LSP server: " << error.what() << std::endl;
-        });
+    params.textDocument.version = ++m_documentVersions[fileName];
+    invalidateHovers(fileName);
+    params.contentChanges.reserve(edits.size());
+    for (auto const &edit : edits) {
+        lsp::TextDocumentContentChangeEvent_Range_RangeLength_Text change;
+        change.range.start.line = edit.startLine;
+        change.range.start.character = edit.startColumn;
+        change.range.end.line = edit.endLine;
+        change.range.end.character = edit.endColumn;
+        change.text = edit.text;
+        params.contentChanges.push_back(std::move(change));
+    }
+    m_messageHandler->sendNotification<lsp::notifications::TextDocument_DidChange>(
+        std::move(params));
+}
+
+void LspClientImpl::changeDocument(const std::string &fileName, const std::string &fileContents) {
+    if (!m_running || m_syncKind == lsp::TextDocumentSyncKind::None) {
+        return;
+    }
+
+    lsp::notifications::TextDocument_DidChange::Params params;
+    params.textDocument.uri = lsp::FileUri::fromPath(fileName);
+    params.textDocument.version = ++m_documentVersions[fileName];
+    invalidateHovers(fileName);
+    lsp::TextDocumentContentChangeEvent_Text change;
+    change.text = fileContents;
+    params.contentChanges.push_back(std::move(change));
+    m_messageHandler->sendNotification<lsp::notifications::TextDocument_DidChange>(
+        std::move(params));
+}
+
+void LspClientImpl::closeDocument(const std::string &fileName) {
+    cancelHover(fileName);
+    invalidateHovers(fileName);
+    if (m_documentVersions.erase(fileName) == 0 || !m_running) {
+        return;
+    }
+
+    lsp::notifications::TextDocument_DidClose::Params params;
+    params.textDocument.uri = lsp::FileUri::fromPath(fileName);
+    m_messageHandler->sendNotification<lsp::notifications::TextDocument_DidClose>(
+        std::move(params));
+}
+
+void LspClientImpl::didChangeWatchedFiles(const std::vector<std::string> &created,
+                                          const std::vector<std::string> &changed,
+                                          const std::vector<std::string> &deleted) {
+    if (!m_running) {
+        return;
+    }
+
+    lsp::notifications::Workspace_DidChangeWatchedFiles::Params params;
+    auto addEvents = [&params](const std::vector<std::string> &files, lsp::FileChangeType type) {
+        for (auto const &file : files) {
+            lsp::FileEvent event;
+            event.uri = lsp::FileUri::fromPath(file);
+            event.type = type;
+            params.changes.push_back(std::move(event));
+        }
+    };
+    addEvents(created, lsp::FileChangeType::Created);
+    addEvents(changed, lsp::FileChangeType::Changed);
+    addEvents(deleted, lsp::FileChangeType::Deleted);
+    if (params.changes.empty()) {
+        return;
+    }
+    m_messageHandler->sendNotification<lsp::notifications::Workspace_DidChangeWatchedFiles>(
+        std::move(params));
+}
+
+void LspClientImpl::hover(const std::string &fileName, int line, int column,
+                          std::function<void(std::string &&tooltip)> callback) {
+
+    if (!m_running) {
+        return;
+    }
+
+    auto version = 0;
+    if (auto it = m_documentVersions.find(fileName); it != m_documentVersions.end()) {
+        version = it->second;
+    }
+
+    auto serial = std::uint64_t(0);
+    auto superseded = std::optional<PendingRequest>();
+    auto cached = std::optional<std::string>();
+    {
+        auto lock = std::lock_guard(m_requestsMutex);
+        cached = m_hoverCache.find(fileName, version, line, column);
+        auto it = m_hovers.find(fileName);
+        if (it != m_hovers.end()) {
+            superseded = it->second;
+        }
+        if (cached) {
+            if (it != m_hovers.end()) {
+                m_hovers.erase(it);
+            }
+        } else {
+            serial = ++m_nextSerial;
+            auto &pending = m_hovers[fileName];
+            pending = PendingRequest();
+            pending.serial = serial;
+            pending.sent = std::chrono::steady_clock::now();
+        }
+    }
+    if (superseded) {
+        cancelPending(*superseded);
+    }
+    if (cached) {
+        callback(std::move(*cached));
+        return;
+    }
+    ++m_hoverStats.sent;
+    if (SpanTrace::enabled()) {
+        SpanTrace::instance().asyncBegin(HoverSpan, serial);
+    }
+
+    auto send = [this, fileName, line, column, version, serial,
+                 callback = std::move(callback)](RequestScheduler::Done done) {
+        if (!m_running) {
+            done();
+            return;
+        }
+        {
+            // Superseded while it left the queue, cancelPending() could not drop it anymore
+            auto lock = std::lock_guard(m_requestsMutex);
+            if (auto it = m_hovers.find(fileName);
+                it == m_hovers.end() || it->second.serial != serial) {
+                done();
+                if (SpanTrace::enabled()) {
+                    SpanTrace::instance().asyncEnd(HoverSpan, serial);
+                }
+                return;
+            }
+        }
+        lsp::HoverParams params;
+        params.textDocument.uri = lsp::FileUri::fromPath(fileName);
+        params.position.line = line;
+        params.position.character = column;
+        // params.workDoneToken
+
+        auto id = m_messageHandler->sendRequest<lsp::requests::TextDocument_Hover>(
+            std::move(params),
+            [this, fileName, version, serial, callback,
+             done](lsp::requests::TextDocument_Hover::Result &&result) {
+                done();
+                auto tooltip = std::string();
+                if (!result.isNull()) {
+                    tooltip = hoverText(result->contents);
+                    // Even a superseded response is worth keeping
+                    if (result->range.has_value()) {
+                        auto const &range = *result->range;
+                        auto cacheRange = HoverCache::Range{
+                            int(range.start.line), int(range.start.character),
+                            int(range.end.line), int(range.end.character)};
+                        auto lock = std::lock_guard(m_requestsMutex);
+                        m_hoverCache.insert(fileName, version, cacheRange, tooltip);
+                    }
+                }
+                if (finishHover(fileName, serial, true)) {
+                    callback(std::move(tooltip));
+                }
+            },
+            [this, fileName, serial, done](const lsp::Error &error) {
+                done();
+                // Cancelled requests end with an error too, those are expected
+                if (finishHover(fileName, serial, false)) {
+                    std::cerr << "Failed to get response from LSP server: " << error.what()
+                              << std::endl;
+                }
+            });
+
+        {
+            auto lock = std::lock_guard(m_requestsMutex);
+            if (auto it = m_hovers.find(fileName);
+                it != m_hovers.end() && it->second.serial == serial) {
+                it->second.id = id;
+                return;
+            }
+        }
+        // Superseded while it was being sent, before cancelPending() could see the id
+        cancelRequest(id);
+    };
+    auto ticket = m_scheduler.submit(RequestScheduler::Priority::Interactive,
+                                     "textDocument/hover " + fileName, std::move(send));
+    {
+        auto lock = std::lock_guard(m_requestsMutex);
+        if (auto it = m_hovers.find(fileName);
+            it != m_hovers.end() && it->second.serial == serial) {
+            it->second.ticket = ticket;
+        }
+    }
+    m_scheduler.pump();
+}
+
+void LspClientImpl::cancelHover(const std::string &fileName) {
+    auto pending = PendingRequest();
+    {
+        auto lock = std::lock_guard(m_requestsMutex);
+        auto it = m_hovers.find(fileName);
+        if (it == m_hovers.end()) {
+            return;
+        }
+        pending = it->second;
+        m_hovers.erase(it);
+    }
+    cancelPending(pending);
+}
+
+void LspClientImpl::semanticTokens(
+    const std::string &fileName, const std::string &previousResultId,
+    std::function<void(std::optional<SemanticTokensUpdate> &&)> callback) {
+    auto delta = false;
+    {
+        auto lock = std::lock_guard(m_requestsMutex);
+        if (m_running && !m_tokensLegendKnown) {
+            // Asked before the server answered initialize, sent once it did
+            auto &waiting = m_tokensWaiting[fileName];
+            if (waiting) {
+                waiting(false);
+            }
+            waiting = [this, fileName, previousResultId,
+                       callback = std::move(callback)](bool send) mutable {
+                if (send) {
+                    semanticTokens(fileName, previousResultId, std::move(callback));
+                } else {
+                    callback(std::nullopt);
+                }
+            };
+            return;
+        }
+        if (!m_running || m_tokensLegend.tokenTypes.empty()) {
+            callback(std::nullopt);
+            return;
+        }
+        delta = m_tokensDelta && !previousResultId.empty();
+    }
+
+    auto send = [this, fileName, previousResultId, delta, callback](RequestScheduler::Done done) {
+        if (!m_running) {
+            done();
+            callback(std::nullopt);
+            return;
+        }
+        auto onError = [callback, done](const lsp::Error &error) {
+            done();
+            std::cerr << "Failed to get semantic tokens: " << error.what() << std::endl;
+            callback(std::nullopt);
+        };
+        if (!delta) {
+            lsp::SemanticTokensParams params;
+            params.textDocument.uri = lsp::FileUri::fromPath(fileName);
+            m_messageHandler->sendRequest<lsp::requests::TextDocument_SemanticTokens_Full>(
+                std::move(params),
+                [callback, done](lsp::requests::TextDocument_SemanticTokens_Full::Result &&result) {
+                    done();
+                    if (result.isNull()) {
+                        callback(std::nullopt);
+                        return;
+                    }
+                    auto update = SemanticTokensUpdate();
+                    update.resultId = result->resultId.value_or("");
+                    update.data.assign(result->data.begin(), result->data.end());
+                    callback(std::move(update));
+                },
+                onError);
+            return;
+        }
+
+        lsp::SemanticTokensDeltaParams params;
+        params.textDocument.uri = lsp::FileUri::fromPath(fileName);
+        params.previousResultId = previousResultId;
+        m_messageHandler->sendRequest<lsp::requests::TextDocument_SemanticTokens_Full_Delta>(
+            std::move(params),
+            [callback,
+             done](lsp::requests::TextDocument_SemanticTokens_Full_Delta::Result &&result) {
+                done();
+                if (result.isNull()) {
+                    callback(std::nullopt);
+                    return;
+                }
+                auto update = SemanticTokensUpdate();
+                // The server answers with all tokens if it forgot the previous result
+                std::visit(
+                    [&](const auto &value) {
+                        using T = std::decay_t<decltype(value)>;
+                        update.resultId = value.resultId.value_or("");
+                        if constexpr (std::is_same_v<T, lsp::SemanticTokensDelta>) {
+                            update.delta = true;
+                            update.edits.reserve(value.edits.size());
+                            for (auto const &edit : value.edits) {
+                                auto &tokensEdit = update.edits.emplace_back();
+                                tokensEdit.start = edit.start;
+                                tokensEdit.deleteCount = edit.deleteCount;
+                                if (edit.data.has_value()) {
+                                    tokensEdit.data.assign(edit.data->begin(), edit.data->end());
+                                }
+                            }
+                        } else {
+                            update.data.assign(value.data.begin(), value.data.end());
+                        }
+                    },
+                    *result);
+                callback(std::move(update));
+            },
+            onError);
+    };
+    // Only the latest request for a document matters, a queued one is replaced and gets
+    // nothing
+    m_scheduler.submit(RequestScheduler::Priority::Visible,
+                       "textDocument/semanticTokens " + fileName, std::move(send),
+                       [callback = std::move(callback)] { callback(std::nullopt); });
+    m_scheduler.pump();
+}
+
+void LspClientImpl::sendWaitingTokens() {
+    auto waiting = decltype(m_tokensWaiting)();
+    {
+        auto lock = std::lock_guard(m_requestsMutex);
+        m_tokensLegendKnown = true;
+        waiting.swap(m_tokensWaiting);
+    }
+    for (auto &[fileName, send] : waiting) {
+        send(true);
+    }
+}
+
+SemanticTokensLegend LspClientImpl::semanticTokensLegend() const {
+    auto lock = std::lock_guard(m_requestsMutex);
+    return m_tokensLegend;
+}
+
+void LspClientImpl::onDiagnostics(std::function<void()> callback) {
+    auto lock = std::lock_guard(m_diagnosticsMutex);
+    m_diagnosticsCallback = std::move(callback);
+}
+
+std::vector<PublishedDiagnostics> LspClientImpl::takeDiagnostics() {
+    auto published = std::vector<PublishedDiagnostics>();
+    auto lock = std::lock_guard(m_diagnosticsMutex);
+    published.reserve(m_diagnostics.size());
+    for (auto &[fileName, diagnostics] : m_diagnostics) {
+        published.push_back({fileName, std::move(diagnostics)});
+    }
+    m_diagnostics.clear();
+    m_diagnosticsWaiting = false;
+    return published;
+}
+
+void LspClientImpl::printRequestStats(std::ostream &out) const {
+    out << "Hover requests: " << m_hoverStats.sent << " sent, " << m_hoverStats.completed
+        << " completed, " << m_hoverStats.cancelled << " cancelled, " << m_hoverStats.dropped
+        << " dropped late, " << m_hoverStats.failed << " failed\n";
+    if (m_hoverStats.latency.count() > 0) {
+        out << "Hover latency: " << m_hoverStats.latency.summary() << "\n";
+    }
+    auto cache = HoverCache::Stats();
+    {
+        auto lock = std::lock_guard(m_requestsMutex);
+        cache = m_hoverCache.stats();
+    }
+    out << m_scheduler.summary();
+    out << "Hover cache: " << cache.hits << " hits, " << cache.misses << " misses, "
+        << cache.evictions << " evictions, " << cache.entries << " entries in "
+        << cache.bytes / 1024 << " KiB\n";
+}
+
+void LspClientImpl::invalidateHovers(const std::string &fileName) {
+    auto lock = std::lock_guard(m_requestsMutex);
+    m_hoverCache.invalidate(fileName);
+}
+
+void LspClientImpl::cancelPending(const PendingRequest &pending) {
+    ++m_hoverStats.cancelled;
+    if (pending.id) {
+        cancelRequest(*pending.id);
+    } else if (m_scheduler.cancel(pending.ticket) && SpanTrace::enabled()) {
+        // Never sent, nothing will answer. Otherwise the send function is running and sees
+        // that the hover was superseded.
+        SpanTrace::instance().asyncEnd(HoverSpan, pending.serial);
+    }
+}
+
+void LspClientImpl::cancelRequest(const lsp::MessageId &id) {
+    if (!m_running) {
+        return;
+    }
+    lsp::notifications::CancelRequest::Params params;
+    if (auto intId = std::get_if<lsp::json::Integer>(&id)) {
+        params.id = static_cast<int>(*intId);
+    } else if (auto strId = std::get_if<lsp::json::String>(&id)) {
+        params.id = *strId;
+    } else {
+        return;
+    }
+    m_messageHandler->sendNotification<lsp::notifications::CancelRequest>(std::move(params));
+}
+
+bool LspClientImpl::finishHover(const std::string &fileName, std::uint64_t serial,
+                                bool succeeded) {
+    if (SpanTrace::enabled()) {
+        SpanTrace::instance().asyncEnd(HoverSpan, serial);
+    }
+    auto lock = std::lock_guard(m_requestsMutex);
+    auto it = m_hovers.find(fileName);
+    if (it == m_hovers.end() || it->second.serial != serial) {
+        if (succeeded) {
+            ++m_hoverStats.dropped;
+        }
+        return false;
+    }
+    if (succeeded) {
+        ++m_hoverStats.completed;
+        m_hoverStats.latency.record(std::chrono::steady_clock::now() - it->second.sent);
+    } else {
+        ++m_hoverStats.failed;
+    }
+    m_hovers.erase(it);
+    return true;
 }
 
 LspClientImpl::~LspClientImpl() {
+    if (WireTrace::instance().isRunning() || SpanTrace::enabled()) {
+        printRequestStats(std::cerr);
+    }
     shutdownLspServer();
     stopClangd();
 }
 
 void LspClientImpl::startClangd() {
+#if defined(__linux__)
+    // A running clangd_mux shares its clangd with the other instances, otherwise we own one.
+    // A server command set explicitly is always started.
+    if (m_serverCommand.empty()) {
+        m_stream = MessageStream::connectTo(muxSocketPath());
+    }
+    if (!m_stream) {
+        auto command = m_serverCommand.empty() ? std::vector<std::string>{"/usr/bin/clangd"}
+                                               : m_serverCommand;
+        try {
+            m_stream = std::make_unique<ServerProcess>(
+                command[0], std::vector<std::string>(command.begin() + 1, command.end()));
+        } catch (const std::system_error &e) {
+            std::cerr << "Cannot start " << command[0] << ": " << e.what() << std::endl;
+            return;
+        }
+    }
+    if (!m_recordingPath.empty()) {
+        // A restarted server gets a file of its own, the earlier sessions are kept
+        auto path = SessionRecorder::sessionPath(m_recordingPath, ++m_recordedSessions);
+        auto recorder = std::make_shared<SessionRecorder>();
+        if (recorder->open(path)) {
+            m_stream->setRecorder(std::move(recorder));
+            if (m_recordedSessions > 1) {
+                std::cerr << "Recording the session to " << path << std::endl;
+            }
+        } else {
+            std::cerr << "Cannot record the session to " << path << std::endl;
+        }
+    }
+    m_connection = std::make_unique<lsp::Connection>(*m_stream);
+    m_messageHandler = std::make_unique<lsp::MessageHandler>(*m_connection);
+    registerHandlers();
+    m_running = true;
+    m_reactor = LspReactor::shared();
+    m_reactor->add(m_stream->fd(), [this] { onServerReadable(); });
+#else
     try {
 #if defined(WIN32)
         m_clandIO = std::make_unique<lsp::Process>("C :\\Program Files\\LLVM\\bin\\clangd.exe");
@@ -64,18 +597,42 @@ void LspClientImpl::startClangd() {
 #endif
         m_connection = std::make_unique<lsp::Connection>(m_clandIO->stdIO());
         m_messageHandler = std::make_unique<lsp::MessageHandler>(*m_connection);
+        registerHandlers();
         m_running = true;
         m_workerThread = std::thread(&LspClientImpl::runLoop, this);
     } catch (lsp::ProcessError e) {
     }
+#endif
 }
 
 void LspClientImpl::stopClangd() {
     m_running = false;
-    // Send shutdown/exit message if needed here
+    if (m_stream) {
+        m_reactor->remove(m_stream->fd());
+        m_stream->close(ExitTimeout);
+    }
     if (m_workerThread.joinable()) {
         m_workerThread.join();
     }
+    m_messageHandler.reset();
+    m_connection.reset();
+    m_stream.reset();
+    m_initialized = false;
+    m_documentVersions.clear();
+    m_scheduler.reset();
+    auto lock = std::lock_guard(m_requestsMutex);
+    m_hovers.clear();
+    m_hoverCache.clear();
+    m_tokensLegend = {};
+    m_tokensDelta = false;
+    m_tokensLegendKnown = false;
+    for (auto &[fileName, waiting] : m_tokensWaiting) {
+        waiting(false);
+    }
+    m_tokensWaiting.clear();
+    auto diagnosticsLock = std::lock_guard(m_diagnosticsMutex);
+    m_diagnostics.clear();
+    m_diagnosticsWaiting = false;
 }
 
 void LspClientImpl::initializeLspServer() {
@@ -89,11 +646,24 @@ void LspClientImpl::initializeLspServer() {
 
     auto id = m_messageHandler->sendRequest<lsp::requests::Initialize>(
         std::move(initializeParams),
-        [](lsp::requests::Initialize::Result &&result) {
+        [this](lsp::requests::Initialize::Result &&result) {
             std::cout << " - Server initialized successfully\n";
+            // Servers that do not say anything about sync get no changes at all
+            auto syncKind = lsp::TextDocumentSyncKind::None;
             if (result.capabilities.textDocumentSync.has_value()) {
+                std::visit(
+                    [&](const auto &value) {
+                        using T = std::decay_t<decltype(value)>;
+                        if constexpr (std::is_same_v<T, lsp::TextDocumentSyncOptions>) {
+                            syncKind = value.change.value_or(lsp::TextDocumentSyncKind::None);
+                        } else {
+                            syncKind = value;
+                        }
+                    },
+                    *result.capabilities.textDocumentSync);
                 std::cout << " - Text document sync supported\n";
             }
+            m_syncKind = syncKind;
             if (result.capabilities.completionProvider.has_value()) {
                 std::cout << " - Completion provider supported\n";
             }
@@ -106,10 +676,39 @@ void LspClientImpl::initializeLspServer() {
             if (result.capabilities.renameProvider.has_value()) {
                 std::cout << " - Rename provider provider supported\n";
             }
+            if (result.capabilities.semanticTokensProvider.has_value()) {
+                auto legend = SemanticTokensLegend();
+                auto delta = false;
+                std::visit(
+                    [&](const auto &options) {
+                        legend.tokenTypes = options.legend.tokenTypes;
+                        legend.tokenModifiers = options.legend.tokenModifiers;
+                        if (!options.full.has_value()) {
+                            return;
+                        }
+                        std::visit(
+                            [&](const auto &full) {
+                                using T = std::decay_t<decltype(full)>;
+                                if constexpr (!std::is_same_v<T, bool>) {
+                                    delta = full.delta.value_or(false);
+                                }
+                            },
+                            *options.full);
+                    },
+                    *result.capabilities.semanticTokensProvider);
+                auto lock = std::lock_guard(m_requestsMutex);
+                m_tokensLegend = std::move(legend);
+                m_tokensDelta = delta;
+                std::cout << " - Semantic tokens supported" << (delta ? " with deltas" : "")
+                          << "\n";
+            }
+            sendWaitingTokens();
         },
-        [](const lsp::Error &error) {
+        [this](const lsp::Error &error) {
             std::cerr << "Failed to get response from LSP server: " << error.what() << std::endl;
+            sendWaitingTokens();
         });
+    m_initialized = true;
     if (auto strPtr = std::get_if<lsp::json::String>(&id)) {
         std::cerr << "lsp::requests::Initialize - String ID: " << *strPtr << "\n";
     } else if (auto intPtr = std::get_if<lsp::json::Integer>(&id)) {
@@ -117,16 +716,100 @@ void LspClientImpl::initializeLspServer() {
     } else if (std::holds_alternative<lsp::json::Null>(id)) {
         std::cerr << "lsp::requests::Initialize - ID is null\n";
     }
-#if 0
-    auto [id, result] = m_messageHandler->sendRequest<lsp::requests::TextDocument_Diagnostic>(
-        lsp::requests::TextDocument_Diagnostic::Params{/* parameters */});
-#endif
 }
 
-void LspClientImpl::shutdownLspServer() {}
+void LspClientImpl::shutdownLspServer() {
+    if (!m_running || !m_initialized) {
+        return;
+    }
+
+    auto answered = std::make_shared<std::promise<void>>();
+    auto shutdown = answered->get_future();
+    m_messageHandler->sendRequest<lsp::requests::Shutdown>(
+        [answered](auto &&) { answered->set_value(); },
+        [answered](const lsp::Error &error) {
+            std::cerr << "lsp::requests::Shutdown failed: " << error.what() << std::endl;
+            answered->set_value();
+        });
+    if (shutdown.wait_for(ShutdownTimeout) == std::future_status::timeout) {
+        std::cerr << "clangd did not answer shutdown in time" << std::endl;
+    }
+    if (m_running) {
+        m_messageHandler->sendNotification<lsp::notifications::Exit>();
+    }
+    m_initialized = false;
+}
+
+void LspClientImpl::registerHandlers() {
+    m_messageHandler->add<lsp::notifications::TextDocument_PublishDiagnostics>(
+        [this](lsp::notifications::TextDocument_PublishDiagnostics::Params &&params) {
+            publishDiagnostics(std::move(params));
+        });
+}
+
+// clangd pushes diagnostics, there is nothing to ask for with textDocument/diagnostic
+void LspClientImpl::publishDiagnostics(
+    lsp::notifications::TextDocument_PublishDiagnostics::Params &&params) {
+    auto diagnostics = std::vector<Diagnostic>();
+    diagnostics.reserve(params.diagnostics.size());
+    for (auto &item : params.diagnostics) {
+        auto &diagnostic = diagnostics.emplace_back();
+        diagnostic.startLine = int(item.range.start.line);
+        diagnostic.startColumn = int(item.range.start.character);
+        diagnostic.endLine = int(item.range.end.line);
+        diagnostic.endColumn = int(item.range.end.character);
+        if (item.severity.has_value()) {
+            diagnostic.severity = Diagnostic::Severity(int(*item.severity));
+        }
+        diagnostic.message = std::move(item.message);
+    }
+    auto version = std::optional<int>();
+    if (params.version.has_value()) {
+        version = int(*params.version);
+    }
+    // Sorted and indexed here, the UI thread only swaps pointers
+    auto document = std::make_shared<const DocumentDiagnostics>(version, std::move(diagnostics));
+
+    auto callback = std::function<void()>();
+    {
+        auto lock = std::lock_guard(m_diagnosticsMutex);
+        // A document published twice before the UI looked keeps only the latest
+        m_diagnostics[params.uri.path()] = std::move(document);
+        if (!m_diagnosticsWaiting) {
+            m_diagnosticsWaiting = true;
+            callback = m_diagnosticsCallback;
+        }
+    }
+    if (callback) {
+        callback();
+    }
+}
 
 void LspClientImpl::runLoop() {
     while (m_running) {
         m_messageHandler->processIncomingMessages();
+        m_scheduler.pump();
+    }
+}
+
+// Runs on the reactor thread. Messages are only processed once they are buffered in full,
+// so the connection never blocks the thread that serves the other servers.
+void LspClientImpl::onServerReadable() {
+    auto open = m_stream->fill();
+    while (m_stream->takeMessage()) {
+        try {
+            m_messageHandler->processIncomingMessages();
+        } catch (const std::exception &e) {
+            std::cerr << "Failed to process message from LSP server: " << e.what() << std::endl;
+        }
+    }
+    // Completions only free their slot, what waited for it is sent from here
+    m_scheduler.pump();
+    if (!open) {
+        if (m_running) {
+            std::cerr << "clangd closed its output" << std::endl;
+        }
+        m_running = false;
+        m_reactor->remove(m_stream->fd());
     }
 }
@@ -1,9 +1,16 @@
 #pragma once
 
 #include <atomic>
+#include <chrono>
+#include <cstdint>
 #include <functional>
+#include <iosfwd>
 #include <memory>
+#include <mutex>
+#include <optional>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 #include <lsp/process.h>
 #include <lsp/io/stream.h>
@@ -11,6 +18,43 @@
 #include <lsp/messagehandler.h>
 #include <lsp/messages.h>
 
+#include "DiagnosticStore.hpp"
+#include "HoverCache.hpp"
+#include "LatencyHistogram.hpp"
+#include "RequestScheduler.hpp"
+#include "SemanticTokens.hpp"
+
+class LspReactor;
+class MessageStream;
+
+// A change to an open document. Lines and columns are zero based, columns count UTF-16 code
+// units as required by LSP.
+struct DocumentEdit {
+    int startLine = 0;
+    int startColumn = 0;
+    int endLine = 0;
+    int endColumn = 0;
+    std::string text;
+};
+
+// Semantic tokens as the server sent them: all of them, or edits to the previous result
+struct SemanticTokensUpdate {
+    std::string resultId;
+    bool delta = false;
+    std::vector<std::uint32_t> data;
+    std::vector<SemanticTokens::Edit> edits;
+};
+
+// Names of the token types and modifiers the server uses, tokens refer to them by index
+struct SemanticTokensLegend {
+    std::vector<std::string> tokenTypes;
+    std::vector<std::string> tokenModifiers;
+};
+
+struct PublishedDiagnostics {
+    std::string fileName;
+    std::shared_ptr<const DocumentDiagnostics> diagnostics;
+};
 
 class LspClientImpl {
   public:
@@ -23,24 +67,130 @@ class LspClientImpl {
     LspClientImpl(LspClientImpl &&) = delete;
     LspClientImpl &operator=(LspClientImpl &&) = delete;
 
+    // Traces the messages to the server into WireTrace::defaultPath() while enabled, then
+    // prints the latency of each method
     void debugIO(bool enable);
 
+    // Started instead of clangd, without looking for clangd_mux, e.g. lsp_replay with its
+    // arguments. Empty goes back to clangd. Used from the next startClangd() on.
+    void setServerCommand(std::vector<std::string> command);
+    // The sessions with the servers started from now on are saved to path, see
+    // SessionRecorder. Empty stops recording.
+    void setSessionRecording(std::string path);
     void setDocumentRoot(const std::string &documentRoot);
-    void openDocument(const std::string &fileName, const std::string &fileContents);
-    void hover(const std::string &fileName, int line, int column, std::function<void(lsp::requests::TextDocument_Hover::Result &&result)> callback);
+    // The contents are moved into the message as they are, they must be UTF-8
+    void openDocument(const std::string &fileName, std::string fileContents);
+    // False until the server asked for incremental sync, the whole text has to be sent then
+    bool incrementalSync() const;
+    void changeDocument(const std::string &fileName, const std::vector<DocumentEdit> &edits);
+    void changeDocument(const std::string &fileName, const std::string &fileContents);
+    // The server drops its state for the file, e.g. the AST and preamble clangd keeps
+    void closeDocument(const std::string &fileName);
+    void didChangeWatchedFiles(const std::vector<std::string> &created,
+                               const std::vector<std::string> &changed,
+                               const std::vector<std::string> &deleted);
+    // At most one hover per file is in flight: a new one cancels the previous request and a
+    // late response to a superseded request is dropped, the callback is not called for it.
+    // Positions inside a symbol hovered before at the same document version are answered
+    // from the cache, right away. The tooltip is empty if the server had nothing to show.
+    void hover(const std::string &fileName, int line, int column,
+               std::function<void(std::string &&tooltip)> callback);
+    void cancelHover(const std::string &fileName);
+    // Asks for the edits since previousResultId, or for all tokens if it is empty or the
+    // server cannot send deltas. The callback is always called, with nothing if the request
+    // failed, was replaced by a later one for the document before it was sent, or the server
+    // has no semantic tokens. Until the server is initialized the latest request of each
+    // document waits, an earlier one gets nothing.
+    void semanticTokens(const std::string &fileName, const std::string &previousResultId,
+                        std::function<void(std::optional<SemanticTokensUpdate> &&)> callback);
+    // Empty until the server is initialized
+    SemanticTokensLegend semanticTokensLegend() const;
+    // Called on the reader thread when diagnostics arrive and none are waiting, so a burst
+    // of publishes makes one call. They are collected with takeDiagnostics().
+    void onDiagnostics(std::function<void()> callback);
+    // The latest diagnostics of each document published since the last call
+    std::vector<PublishedDiagnostics> takeDiagnostics();
+    void printRequestStats(std::ostream &out) const;
 
+    // On Linux the server's output is read by the shared LspReactor thread, elsewhere by a
+    // thread of this client
     void startClangd();
+    // Waits a short time for the server to exit and kills it otherwise
     void stopClangd();
     void initializeLspServer();
+    // Sends `shutdown`, waits a bounded time for the answer and sends `exit`
     void shutdownLspServer();
 
   private:
+    struct PendingRequest {
+        std::uint64_t serial = 0;
+        RequestScheduler::Ticket ticket = 0;
+        // Set once the request left the scheduler
+        std::optional<lsp::MessageId> id;
+        std::chrono::steady_clock::time_point sent;
+    };
+
+    struct RequestStats {
+        std::atomic<std::uint64_t> sent{0};
+        std::atomic<std::uint64_t> completed{0};
+        std::atomic<std::uint64_t> cancelled{0};
+        std::atomic<std::uint64_t> dropped{0};
+        std::atomic<std::uint64_t> failed{0};
+        LatencyHistogram latency;
+    };
+
+    // Sends $/cancelRequest if the request went out already, otherwise drops it from the
+    // scheduler. The pending request must be gone from m_hovers.
+    void cancelPending(const PendingRequest &pending);
+    void cancelRequest(const lsp::MessageId &id);
+    // Returns false if the hover was superseded or cancelled meanwhile
+    bool finishHover(const std::string &fileName, std::uint64_t serial, bool succeeded);
+    void invalidateHovers(const std::string &fileName);
+    // Sends the tokens requests that waited for the legend
+    void sendWaitingTokens();
+
+    void registerHandlers();
+    void publishDiagnostics(
+        lsp::notifications::TextDocument_PublishDiagnostics::Params &&params);
+
     void runLoop();
+    void onServerReadable();
+
     std::string m_documentRoot;
+    std::vector<std::string> m_serverCommand;
+    std::string m_recordingPath;
+    int m_recordedSessions = 0;
+    std::shared_ptr<LspReactor> m_reactor;
+    // clangd, or the connection to clangd_mux
+    std::unique_ptr<MessageStream> m_stream;
     std::unique_ptr<lsp::Connection> m_connection;
     std::unique_ptr<lsp::MessageHandler> m_messageHandler;
     std::unique_ptr<lsp::Process> m_clandIO;
 
     std::thread m_workerThread;
     std::atomic_bool m_running{false};
+    bool m_initialized = false;
+    std::atomic<lsp::TextDocumentSyncKind> m_syncKind{lsp::TextDocumentSyncKind::Full};
+    std::unordered_map<std::string, int> m_documentVersions;
+
+    // Responses arrive on the reactor or worker thread
+    mutable std::mutex m_requestsMutex;
+    std::unordered_map<std::string, PendingRequest> m_hovers;
+    std::uint64_t m_nextSerial = 0;
+    RequestStats m_hoverStats;
+    SemanticTokensLegend m_tokensLegend;
+    bool m_tokensDelta = false;
+    // Set once the server answered initialize, whether it has semantic tokens or not
+    bool m_tokensLegendKnown = false;
+    // Called with true to send the request, with false to give up on it
+    std::unordered_map<std::string, std::function<void(bool send)>> m_tokensWaiting;
+    // Every request except the initialize/shutdown handshake goes through here
+    RequestScheduler m_scheduler;
+    HoverCache m_hoverCache;
+
+    // Converted on the reader thread, handed to the UI in batches
+    std::mutex m_diagnosticsMutex;
+    std::unordered_map<std::string, std::shared_ptr<const DocumentDiagnostics>> m_diagnostics;
+    bool m_diagnosticsWaiting = false;
+    std::function<void()> m_diagnosticsCallback;
 };
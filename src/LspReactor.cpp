@@ -0,0 +1,143 @@
+#include "LspReactor.hpp"
+
+#include <cstdint>
+#include <iostream>
+#include <system_error>
+
+#if defined(__linux__)
+#include <cerrno>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+constexpr int MaxEvents = 16;
+
+} // namespace
+
+std::shared_ptr<LspReactor> LspReactor::shared() {
+    static auto mutex = std::mutex();
+    static auto reactor = std::weak_ptr<LspReactor>();
+    auto lock = std::lock_guard(mutex);
+    auto result = reactor.lock();
+    if (!result) {
+        result = std::make_shared<LspReactor>();
+        reactor = result;
+    }
+    return result;
+}
+
+#if defined(__linux__)
+
+LspReactor::LspReactor() {
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    wakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (epollFd == -1 || wakeFd == -1) {
+        throw std::system_error(errno, std::generic_category(), "LspReactor");
+    }
+    auto event = epoll_event{};
+    event.events = EPOLLIN;
+    event.data.fd = wakeFd;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &event);
+    thread = std::thread(&LspReactor::run, this);
+}
+
+LspReactor::~LspReactor() {
+    {
+        auto lock = std::lock_guard(mutex);
+        stopping = true;
+    }
+    wake();
+    if (thread.joinable()) {
+        thread.join();
+    }
+    ::close(wakeFd);
+    ::close(epollFd);
+}
+
+void LspReactor::add(int fd, std::function<void()> onReadable) {
+    {
+        auto lock = std::lock_guard(mutex);
+        handlers[fd] = std::make_shared<std::function<void()>>(std::move(onReadable));
+    }
+    auto event = epoll_event{};
+    event.events = EPOLLIN | EPOLLRDHUP;
+    event.data.fd = fd;
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) == -1) {
+        std::cerr << "LspReactor: cannot watch descriptor " << fd << ": "
+                  << std::generic_category().message(errno) << std::endl;
+    }
+}
+
+void LspReactor::remove(int fd) {
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+    auto lock = std::unique_lock(mutex);
+    handlers.erase(fd);
+    if (std::this_thread::get_id() != thread.get_id()) {
+        idle.wait(lock, [&] { return runningFd != fd; });
+    }
+}
+
+void LspReactor::wake() {
+    auto value = std::uint64_t(1);
+    [[maybe_unused]] auto written = ::write(wakeFd, &value, sizeof(value));
+}
+
+void LspReactor::run() {
+    epoll_event events[MaxEvents];
+    while (true) {
+        auto count = epoll_wait(epollFd, events, MaxEvents, -1);
+        if (count == -1 && errno != EINTR) {
+            std::cerr << "LspReactor: epoll_wait failed: "
+                      << std::generic_category().message(errno) << std::endl;
+            return;
+        }
+        for (auto i = 0; i < count; ++i) {
+            auto fd = events[i].data.fd;
+            if (fd == wakeFd) {
+                auto value = std::uint64_t();
+                [[maybe_unused]] auto read = ::read(wakeFd, &value, sizeof(value));
+                continue;
+            }
+            auto handler = std::shared_ptr<std::function<void()>>();
+            {
+                auto lock = std::lock_guard(mutex);
+                auto it = handlers.find(fd);
+                if (it == handlers.end()) {
+                    // Removed after epoll_wait returned
+                    continue;
+                }
+                handler = it->second;
+                runningFd = fd;
+            }
+            (*handler)();
+            {
+                auto lock = std::lock_guard(mutex);
+                runningFd = -1;
+            }
+            idle.notify_all();
+        }
+        auto lock = std::lock_guard(mutex);
+        if (stopping) {
+            return;
+        }
+    }
+}
+
+#else
+
+LspReactor::LspReactor() {}
+
+LspReactor::~LspReactor() {}
+
+void LspReactor::add(int, std::function<void()>) {}
+
+void LspReactor::remove(int) {}
+
+void LspReactor::wake() {}
+
+void LspReactor::run() {}
+
+#endif
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+// One I/O thread serving the pipes of any number of language servers (Linux only).
+//
+// Descriptors are watched with epoll and their callbacks run on the reactor thread when data
+// can be read or the other side hung up, the thread sleeps otherwise. Descriptors can be
+// added and removed from any thread, stopping wakes the thread through an eventfd.
+class LspReactor {
+  public:
+    // The reactor shared by all clients of this process, started on first use
+    static std::shared_ptr<LspReactor> shared();
+
+    LspReactor();
+    ~LspReactor();
+
+    LspReactor(const LspReactor &) = delete;
+    LspReactor &operator=(const LspReactor &) = delete;
+
+    // fd must be non-blocking, onReadable has to read until it would block
+    void add(int fd, std::function<void()> onReadable);
+    // After this returns the callback of fd is not running and will not run again. Can be
+    // called from the callback itself.
+    void remove(int fd);
+
+  private:
+    void run();
+    void wake();
+
+    int epollFd = -1;
+    int wakeFd = -1;
+    std::thread thread;
+
+    std::mutex mutex;
+    std::condition_variable idle;
+    std::unordered_map<int, std::shared_ptr<std::function<void()>>> handlers;
+    int runningFd = -1;
+    bool stopping = false;
+};
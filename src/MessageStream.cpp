@@ -0,0 +1,299 @@
+#include "MessageStream.hpp"
+#include "SessionRecorder.hpp"
+#include "WireTrace.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string_view>
+#include <system_error>
+
+#if defined(__linux__)
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+constexpr std::size_t ReadChunk = 64 * 1024;
+// Consumed input is dropped from the front of the buffer once it grows past this
+constexpr std::size_t CompactThreshold = 256 * 1024;
+constexpr auto HeaderEnd = std::string_view("\r\n\r\n");
+
+// Value of the Content-Length header, -1 if there is none
+long long contentLength(std::string_view header) {
+    constexpr auto Name = std::string_view("content-length:");
+    while (!header.empty()) {
+        auto end = header.find("\r\n");
+        auto line = header.substr(0, end);
+        header.remove_prefix(end == std::string_view::npos ? header.size() : end + 2);
+        if (line.size() < Name.size() ||
+            !std::equal(Name.begin(), Name.end(), line.begin(),
+                        [](char a, char b) { return a == std::tolower((unsigned char)b); })) {
+            continue;
+        }
+        auto value = line.substr(Name.size());
+        while (!value.empty() && value.front() == ' ') {
+            value.remove_prefix(1);
+        }
+        auto length = 0LL;
+        if (std::from_chars(value.data(), value.data() + value.size(), length).ec == std::errc()) {
+            return length;
+        }
+    }
+    return -1;
+}
+
+} // namespace
+
+#if defined(__linux__)
+
+std::string muxSocketPath() {
+    if (auto runtimeDir = std::getenv("XDG_RUNTIME_DIR"); runtimeDir && *runtimeDir) {
+        return std::string(runtimeDir) + "/lsp-client-demo-mux.sock";
+    }
+    return "/tmp/lsp-client-demo-mux-" + std::to_string(getuid()) + ".sock";
+}
+
+MessageStream::MessageStream(int fd) : socketFd(fd) {
+    fcntl(socketFd, F_SETFL, fcntl(socketFd, F_GETFL) | O_NONBLOCK);
+}
+
+MessageStream::~MessageStream() { ::close(socketFd); }
+
+std::unique_ptr<MessageStream> MessageStream::connectTo(const std::string &socketPath) {
+    auto address = sockaddr_un{};
+    address.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(address.sun_path)) {
+        return nullptr;
+    }
+    std::memcpy(address.sun_path, socketPath.c_str(), socketPath.size() + 1);
+    auto fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        return nullptr;
+    }
+    if (::connect(fd, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) == -1) {
+        ::close(fd);
+        return nullptr;
+    }
+    return std::make_unique<MessageStream>(fd);
+}
+
+bool MessageStream::fill() {
+    if (readPos == buffer.size() || readPos > CompactThreshold) {
+        auto consumed = std::min(readPos, framedPos);
+        buffer.erase(buffer.begin(), buffer.begin() + consumed);
+        readPos -= consumed;
+        framedPos -= consumed;
+    }
+
+    char chunk[ReadChunk];
+    while (true) {
+        auto count = ::recv(socketFd, chunk, sizeof(chunk), 0);
+        if (count > 0) {
+            buffer.insert(buffer.end(), chunk, chunk + count);
+            continue;
+        }
+        auto error = count == -1 ? errno : 0;
+        if (error == EINTR) {
+            continue;
+        }
+        frameMessages();
+        return error == EAGAIN || error == EWOULDBLOCK;
+    }
+}
+
+void MessageStream::read(char *data, std::size_t size) {
+    // Only waits if the connection reads past what was framed, which it should not
+    while (buffer.size() - readPos < size) {
+        auto request = pollfd{socketFd, POLLIN, 0};
+        ::poll(&request, 1, -1);
+        if (!fill() && buffer.size() - readPos < size) {
+            throw std::runtime_error("Language server closed the connection");
+        }
+    }
+    std::memcpy(data, buffer.data() + readPos, size);
+    readPos += size;
+}
+
+void MessageStream::write(const char *data, std::size_t size) {
+    auto lock = std::lock_guard(writeMutex);
+    if (WireTrace::enabled() || recorder) {
+        observeOutput(data, size);
+    } else if (!observedOutput.empty()) {
+        observedOutput.clear();
+    }
+    while (size > 0) {
+        auto count = ::send(socketFd, data, size, MSG_NOSIGNAL);
+        if (count >= 0) {
+            data += count;
+            size -= std::size_t(count);
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            auto request = pollfd{socketFd, POLLOUT, 0};
+            ::poll(&request, 1, -1);
+        } else if (errno != EINTR) {
+            throw std::system_error(errno, std::generic_category(), "Language server connection");
+        }
+    }
+}
+
+bool MessageStream::flushQueued() {
+    auto lock = std::lock_guard(writeMutex);
+    while (queuedPos < queued.size()) {
+        auto count =
+            ::send(socketFd, queued.data() + queuedPos, queued.size() - queuedPos, MSG_NOSIGNAL);
+        if (count >= 0) {
+            queuedPos += std::size_t(count);
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            break;
+        } else if (errno != EINTR) {
+            throw std::system_error(errno, std::generic_category(), "Language server connection");
+        }
+    }
+    if (queuedPos == queued.size()) {
+        queued.clear();
+        queuedPos = 0;
+    } else if (queuedPos > CompactThreshold) {
+        queued.erase(0, queuedPos);
+        queuedPos = 0;
+    }
+    return queued.empty();
+}
+
+void MessageStream::closeInput() { ::shutdown(socketFd, SHUT_WR); }
+
+#else
+
+std::string muxSocketPath() { return {}; }
+
+MessageStream::MessageStream(int fd) : socketFd(fd) {}
+
+MessageStream::~MessageStream() {}
+
+std::unique_ptr<MessageStream> MessageStream::connectTo(const std::string &) { return nullptr; }
+
+bool MessageStream::fill() { return false; }
+
+void MessageStream::read(char *, std::size_t) {}
+
+void MessageStream::write(const char *, std::size_t) {}
+
+bool MessageStream::flushQueued() { return true; }
+
+void MessageStream::closeInput() {}
+
+#endif
+
+bool MessageStream::takeMessage() {
+    if (completeMessages == 0) {
+        return false;
+    }
+    --completeMessages;
+    return true;
+}
+
+std::optional<std::string> MessageStream::takeMessageBody() {
+    if (completeMessages == 0) {
+        return std::nullopt;
+    }
+    auto begin = buffer.begin() + readPos;
+    auto headerEnd = std::search(begin, buffer.end(), HeaderEnd.begin(), HeaderEnd.end());
+    auto header = std::string_view(buffer.data() + readPos, headerEnd - begin);
+    auto bodyPos = std::size_t(headerEnd - buffer.begin()) + HeaderEnd.size();
+    auto length = std::size_t(std::max(contentLength(header), 0LL));
+    auto body = std::string(buffer.data() + bodyPos, length);
+    readPos = bodyPos + length;
+    --completeMessages;
+    return body;
+}
+
+void MessageStream::writeMessage(const std::string &body) {
+    auto message = "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+    write(message.data(), message.size());
+}
+
+void MessageStream::queueMessage(const std::string &body) {
+    {
+        auto lock = std::lock_guard(writeMutex);
+        if (WireTrace::enabled() || recorder) {
+            observe(WireTrace::Direction::Sent, body);
+        }
+        queued += "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n";
+        queued += body;
+    }
+    flushQueued();
+}
+
+void MessageStream::close(std::chrono::milliseconds) { closeInput(); }
+
+void MessageStream::setRecorder(std::shared_ptr<SessionRecorder> sessionRecorder) {
+    recorder = std::move(sessionRecorder);
+}
+
+void MessageStream::frameMessages() {
+    while (true) {
+        auto begin = buffer.begin() + framedPos;
+        auto headerEnd = std::search(begin, buffer.end(), HeaderEnd.begin(), HeaderEnd.end());
+        if (headerEnd == buffer.end()) {
+            return;
+        }
+        auto header = std::string_view(buffer.data() + framedPos, headerEnd - begin);
+        // A message without a length is handed over as is, the connection reports the error
+        auto length = std::max(contentLength(header), 0LL);
+        auto bodyPos = std::size_t(headerEnd - buffer.begin()) + HeaderEnd.size();
+        if (buffer.size() - bodyPos < std::size_t(length)) {
+            return;
+        }
+        framedPos = bodyPos + std::size_t(length);
+        ++completeMessages;
+        if (WireTrace::enabled() || recorder) {
+            observe(WireTrace::Direction::Received,
+                    {buffer.data() + bodyPos, std::size_t(length)});
+        }
+    }
+}
+
+void MessageStream::observe(WireTrace::Direction direction, std::string_view body) {
+    if (WireTrace::enabled()) {
+        WireTrace::instance().record(direction, body);
+    }
+    if (recorder) {
+        recorder->record(direction, body);
+    }
+}
+
+void MessageStream::observeOutput(const char *data, std::size_t size) {
+    // The connection writes the header and the body of a message separately, they are
+    // collected until the body is complete. Output that does not start with a header, as
+    // when tracing was turned on in the middle of a message, is skipped.
+    auto chunk = std::string_view(data, size);
+    if (observedOutput.empty() && !chunk.starts_with("Content-Length")) {
+        return;
+    }
+    observedOutput.append(chunk);
+    while (true) {
+        auto output = std::string_view(observedOutput);
+        auto headerEnd = output.find(HeaderEnd);
+        if (headerEnd == std::string_view::npos) {
+            return;
+        }
+        auto length = contentLength(output.substr(0, headerEnd));
+        auto bodyPos = headerEnd + HeaderEnd.size();
+        if (length < 0) {
+            observedOutput.clear();
+            return;
+        }
+        if (output.size() - bodyPos < std::size_t(length)) {
+            return;
+        }
+        observe(WireTrace::Direction::Sent, output.substr(bodyPos, std::size_t(length)));
+        observedOutput.erase(0, bodyPos + std::size_t(length));
+    }
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <lsp/io/stream.h>
+
+#include "WireTrace.hpp"
+
+class SessionRecorder;
+
+// Where clangd_mux listens, $XDG_RUNTIME_DIR or /tmp with the user id
+std::string muxSocketPath();
+
+// LSP messages over a non-blocking socket (Linux only).
+//
+// The owner reads whatever is available with fill() when the socket is readable. The input
+// is split into messages by their Content-Length header, so a reader is only handed a
+// message once all of it is buffered: either through takeMessage() followed by read()
+// calls from an lsp::Connection, or as a whole through takeMessageBody().
+class MessageStream : public lsp::io::Stream {
+  public:
+    // Takes ownership of fd and makes it non-blocking
+    explicit MessageStream(int fd);
+    ~MessageStream() override;
+
+    MessageStream(const MessageStream &) = delete;
+    MessageStream &operator=(const MessageStream &) = delete;
+
+    // Null if nobody listens on socketPath
+    static std::unique_ptr<MessageStream> connectTo(const std::string &socketPath);
+
+    int fd() const { return socketFd; }
+
+    // Reads all available input, false once the other side closed its end
+    bool fill();
+    // True if a complete message is buffered, the next one is then counted as taken
+    bool takeMessage();
+    // The next complete message without its header
+    std::optional<std::string> takeMessageBody();
+    // Frames body with a Content-Length header and writes it
+    void writeMessage(const std::string &body);
+    // For an owner that must never block, like clangd_mux serving many clients: frames body
+    // and queues it behind what is not written yet, then writes what the socket takes now.
+    // The rest is written by flushQueued() once the socket is writable. Throws
+    // std::system_error once the connection is broken.
+    void queueMessage(const std::string &body);
+    // Writes queued output until the socket would block, true once all of it is written
+    bool flushQueued();
+    std::size_t queuedBytes() const { return queued.size() - queuedPos; }
+
+    // lsp::io::Stream
+    void read(char *buffer, std::size_t size) override;
+    void write(const char *buffer, std::size_t size) override;
+
+    // Signals end of input to the other side
+    void closeInput();
+    // Ends the session: closes the input and gives the other side up to timeout to finish
+    virtual void close(std::chrono::milliseconds timeout);
+
+    // Every message from now on is also saved by recorder. Must be set before the stream is
+    // read or written from other threads.
+    void setRecorder(std::shared_ptr<SessionRecorder> recorder);
+
+  private:
+    void frameMessages();
+    // Hands a message to the wire trace and the recorder
+    void observe(WireTrace::Direction direction, std::string_view body);
+    // Finds the messages in written output while tracing or recording
+    void observeOutput(const char *data, std::size_t size);
+
+    int socketFd = -1;
+    std::mutex writeMutex;
+    std::shared_ptr<SessionRecorder> recorder;
+    // Written output of a message that is not complete yet, only while tracing or recording
+    std::string observedOutput;
+    // Output of queueMessage() the socket did not take yet, from queuedPos on
+    std::string queued;
+    std::size_t queuedPos = 0;
+
+    std::vector<char> buffer;
+    std::size_t readPos = 0;
+    // Start of the first message that is not complete yet
+    std::size_t framedPos = 0;
+    std::size_t completeMessages = 0;
+};
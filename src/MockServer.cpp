@@ -0,0 +1,161 @@
+#include "MockServer.hpp"
+#include "JsonRpc.hpp"
+
+#include <QTimer>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace {
+
+constexpr int NotificationTickMs = 10;
+// A client that cannot keep up slows the flood down instead of a backlog building up
+constexpr qint64 MaxNotificationsPerTick = 1000;
+// A token is about "1,0,5,0,0," in the response
+constexpr qsizetype TokenBytes = 10;
+
+QJsonObject position(int line, int character) {
+    return {{"line", line}, {"character", character}};
+}
+
+} // namespace
+
+MockServer::MockServer(const Options &options, QObject *parent)
+    : StdioServer(parent), options(options), random(options.seed) {
+    auto line = QStringLiteral("int mock_value = 0; // synthetic hover text\n");
+    hoverText.reserve(options.responseBytes);
+    while (hoverText.size() < options.responseBytes) {
+        hoverText += line.left(options.responseBytes - hoverText.size());
+    }
+    auto tokens = std::max<qsizetype>(options.responseBytes / TokenBytes, 1);
+    for (auto i = qsizetype(0); i < tokens; ++i) {
+        for (auto value : {1, 0, 5, int(i % 3), 0}) {
+            tokensData.append(value);
+        }
+    }
+    for (auto i = 0; i < options.diagnosticsPerNotification; ++i) {
+        diagnostics.append(QJsonObject{
+            {"range", QJsonObject{{"start", position(i, 0)}, {"end", position(i, 8)}}},
+            {"severity", 1 + i % 4},
+            {"message", QString("mock diagnostic %1").arg(i)}});
+    }
+
+    notificationTimer = new QTimer(this);
+    notificationTimer->setInterval(NotificationTickMs);
+    notificationTimer->setTimerType(Qt::PreciseTimer);
+    connect(notificationTimer, &QTimer::timeout, this, &MockServer::publishDiagnostics);
+}
+
+void MockServer::handleClientMessage(const QJsonObject &message) {
+    auto method = message.value("method").toString();
+    auto params = message.value("params").toObject();
+    auto id = message.value("id");
+    if (method.isEmpty()) {
+        return;
+    }
+    if (method == "textDocument/didOpen") {
+        auto uri = params.value("textDocument").toObject().value("uri").toString();
+        if (!documents.contains(uri)) {
+            documents.append(uri);
+        }
+        return;
+    }
+    if (method == "textDocument/didClose") {
+        documents.removeOne(params.value("textDocument").toObject().value("uri").toString());
+        return;
+    }
+    if (method == "$/cancelRequest") {
+        if (pending.remove(jsonrpc::idKey(params.value("id")))) {
+            send(jsonrpc::errorResponse(params.value("id"), jsonrpc::RequestCancelled,
+                                        "Request cancelled"));
+        }
+        return;
+    }
+    if (id.isUndefined()) {
+        return;
+    }
+
+    // The handshake is answered at once and never fails
+    if (method == "initialize" || method == "shutdown") {
+        auto reply = answer(method);
+        reply["id"] = id;
+        send(reply);
+        if (method == "initialize" && options.notificationsPerSecond > 0) {
+            notificationClock.start();
+            notificationsSent = 0;
+            notificationTimer->start();
+        } else if (method == "shutdown") {
+            notificationTimer->stop();
+        }
+        return;
+    }
+    auto failed = std::bernoulli_distribution(std::clamp(options.errorRate, 0.0, 1.0))(random);
+    answerLater(id, failed ? jsonrpc::errorResponse(id, jsonrpc::InternalError, "Injected error")
+                           : answer(method));
+}
+
+QJsonObject MockServer::answer(const QString &method) {
+    auto result = QJsonValue(QJsonValue::Null);
+    if (method == "initialize") {
+        auto legend = QJsonObject{{"tokenTypes", QJsonArray{"variable", "function", "type"}},
+                                  {"tokenModifiers", QJsonArray()}};
+        result = QJsonObject{
+            {"capabilities",
+             QJsonObject{{"textDocumentSync", 2},
+                         {"hoverProvider", true},
+                         {"semanticTokensProvider",
+                          QJsonObject{{"legend", legend}, {"full", true}}}}},
+            {"serverInfo", QJsonObject{{"name", "lsp_mock"}}}};
+    } else if (method == "textDocument/hover") {
+        result = QJsonObject{
+            {"contents", QJsonObject{{"kind", "plaintext"}, {"value", hoverText}}}};
+    } else if (method == "textDocument/semanticTokens/full") {
+        result = QJsonObject{{"data", tokensData}};
+    }
+    return {{"jsonrpc", "2.0"}, {"result", result}};
+}
+
+void MockServer::answerLater(const QJsonValue &id, QJsonObject reply) {
+    reply["id"] = id;
+    auto mean = std::max(options.latencyMs, 0.0);
+    auto delayMs = mean;
+    if (options.latency == Latency::Uniform && mean > 0) {
+        delayMs = std::uniform_real_distribution(0.0, 2 * mean)(random);
+    } else if (options.latency == Latency::Exponential && mean > 0) {
+        delayMs = std::exponential_distribution(1 / mean)(random);
+    }
+    auto delay = std::chrono::milliseconds(std::lround(delayMs));
+    if (delay.count() == 0) {
+        send(reply);
+        return;
+    }
+    auto key = jsonrpc::idKey(id);
+    pending.insert(key, std::move(reply));
+    QTimer::singleShot(delay, Qt::PreciseTimer, this, [this, key] {
+        // Gone if it was cancelled meanwhile
+        auto reply = pending.take(key);
+        if (!reply.isEmpty()) {
+            send(reply);
+        }
+    });
+}
+
+void MockServer::publishDiagnostics() {
+    auto target = qint64(options.notificationsPerSecond * notificationClock.elapsed() / 1000);
+    auto due = std::min(target - notificationsSent, MaxNotificationsPerTick);
+    // What did not fit into a tick or had no document to go to is not made up for later
+    notificationsSent = target;
+    for (auto i = qint64(0); i < due && !documents.isEmpty() && isServing(); ++i) {
+        nextDocument = nextDocument % documents.size();
+        send({{"jsonrpc", "2.0"},
+              {"method", "textDocument/publishDiagnostics"},
+              {"params",
+               QJsonObject{{"uri", documents[nextDocument++]}, {"diagnostics", diagnostics}}}});
+    }
+}
+
+void MockServer::finish() {
+    notificationTimer->stop();
+    StdioServer::finish();
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "StdioServer.hpp"
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QString>
+#include <QStringList>
+
+#include <random>
+
+class QTimer;
+
+// A language server that answers with synthetic data under a configurable load, to stress
+// the client (Linux only).
+//
+// Hovers and semantic tokens are answered with results of about Options::responseBytes of
+// JSON, other requests with null, each after a delay drawn from the latency distribution.
+// A share of the requests fails with an internal error instead. Once initialized it
+// publishes diagnostics for the open documents at the configured rate, round robin.
+// $/cancelRequest answers a request that is still waiting with RequestCancelled at once.
+class MockServer : public StdioServer {
+    Q_OBJECT
+  public:
+    enum class Latency { Fixed, Uniform, Exponential };
+
+    struct Options {
+        qsizetype responseBytes = 256;
+        Latency latency = Latency::Fixed;
+        // Mean delay of an answer, uniform delays spread over twice this
+        double latencyMs = 0;
+        double notificationsPerSecond = 0;
+        int diagnosticsPerNotification = 10;
+        // Share of the requests answered with an error, 0 to 1
+        double errorRate = 0;
+        unsigned seed = 1;
+    };
+
+    explicit MockServer(const Options &options, QObject *parent = nullptr);
+
+  protected:
+    void handleClientMessage(const QJsonObject &message) override;
+    void finish() override;
+
+  private:
+    QJsonObject answer(const QString &method);
+    void answerLater(const QJsonValue &id, QJsonObject reply);
+    void publishDiagnostics();
+
+    Options options;
+    std::mt19937 random;
+    // Built once, every answer of a kind is the same
+    QString hoverText;
+    QJsonArray tokensData;
+    QJsonArray diagnostics;
+
+    // Answers waiting for their delay, by request id
+    QHash<QString, QJsonObject> pending;
+    QStringList documents;
+    qsizetype nextDocument = 0;
+    QTimer *notificationTimer = nullptr;
+    QElapsedTimer notificationClock;
+    qint64 notificationsSent = 0;
+};
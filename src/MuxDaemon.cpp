@@ -0,0 +1,617 @@
+#include "MuxDaemon.hpp"
+#include "JsonRpc.hpp"
+#include "MessageStream.hpp"
+#include "ServerProcess.hpp"
+
+#include <QDebug>
+#include <QHash>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QSocketNotifier>
+#include <QTimer>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <system_error>
+
+#include <cerrno>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+
+// How long a clangd without clients is kept running
+constexpr int LingerMs = 30000;
+constexpr auto ExitTimeout = std::chrono::milliseconds(2000);
+// How often stopped servers are checked for having exited
+constexpr int ReapIntervalMs = 50;
+constexpr int ListenBacklog = 16;
+// Output a client has not read yet, beyond this it is taken as stuck and disconnected
+constexpr std::size_t MaxClientBacklog = 64 * 1024 * 1024;
+
+QJsonObject response(const QJsonValue &id, const QJsonValue &result) {
+    return {{"jsonrpc", "2.0"}, {"id", id}, {"result", result}};
+}
+
+QJsonObject notification(const QString &method, const QJsonObject &params) {
+    return {{"jsonrpc", "2.0"}, {"method", method}, {"params", params}};
+}
+
+QString documentUri(const QJsonObject &message) {
+    return message.value("params")["textDocument"]["uri"].toString();
+}
+
+// Offset of an LSP position, which counts UTF-16 code units as QString does. Positions past
+// the end of a line or the text are clamped.
+qsizetype textOffset(const QString &text, const QJsonObject &position) {
+    auto lineStart = qsizetype(0);
+    for (auto line = position.value("line").toInt(); line > 0; --line) {
+        auto newline = text.indexOf('\n', lineStart);
+        if (newline < 0) {
+            return text.size();
+        }
+        lineStart = newline + 1;
+    }
+    auto lineEnd = text.indexOf('\n', lineStart);
+    if (lineEnd < 0) {
+        lineEnd = text.size();
+    }
+    return std::min(lineStart + qsizetype(position.value("character").toInt()), lineEnd);
+}
+
+// Applies one entry of didChange's contentChanges
+void applyContentChange(QString &text, const QJsonObject &change) {
+    auto newText = change.value("text").toString();
+    if (!change.contains("range")) {
+        text = newText;
+        return;
+    }
+    auto range = change.value("range").toObject();
+    auto start = textOffset(text, range.value("start").toObject());
+    auto end = std::max(start, textOffset(text, range.value("end").toObject()));
+    text.replace(start, end - start, newText);
+}
+
+QJsonObject withVersion(QJsonObject message, int version) {
+    auto params = message["params"].toObject();
+    auto textDocument = params["textDocument"].toObject();
+    textDocument["version"] = version;
+    params["textDocument"] = textDocument;
+    message["params"] = params;
+    return message;
+}
+
+} // namespace
+
+struct MuxDaemon::Client {
+    int id = 0;
+    std::unique_ptr<MessageStream> stream;
+    QSocketNotifier *notifier = nullptr;
+    // Enabled while output is queued
+    QSocketNotifier *writeNotifier = nullptr;
+    // Set by `initialize`
+    bool initialized = false;
+    QString root;
+    // Id of the client's `initialize` while the server has not answered it yet
+    std::optional<QJsonValue> initializeId;
+    // The open documents with their text as this client has it
+    QHash<QString, QString> documents;
+};
+
+struct MuxDaemon::Server {
+    QString root;
+    std::unique_ptr<ServerProcess> process;
+    QSocketNotifier *notifier = nullptr;
+    QTimer *lingerTimer = nullptr;
+    QSet<int> clients;
+
+    // The server's answer to `initialize`, without its id
+    std::optional<QJsonObject> initializeResponse;
+    bool initializedSent = false;
+
+    int nextId = 0;
+    QHash<int, PendingRequest> pending;
+    QHash<QString, Document> documents;
+    // Set once stopped, it is killed if it has not exited by then
+    std::chrono::steady_clock::time_point exitDeadline;
+};
+
+MuxDaemon::MuxDaemon(const QString &clangdPath, const QString &socketPath, QObject *parent)
+    : QObject(parent), clangdPath(clangdPath), socketPath(socketPath) {
+    reapTimer = new QTimer(this);
+    reapTimer->setInterval(ReapIntervalMs);
+    connect(reapTimer, &QTimer::timeout, this, &MuxDaemon::reapServers);
+}
+
+MuxDaemon::~MuxDaemon() {
+    clients.clear();
+    while (!servers.empty()) {
+        stopServer(servers.begin()->first);
+    }
+    // Nobody is served any more, the servers can be waited for here
+    for (auto const &server : exitingServers) {
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+            server->exitDeadline - std::chrono::steady_clock::now());
+        if (!server->process->waitForExit(std::max(left, std::chrono::milliseconds(0)))) {
+            server->process->kill();
+        }
+    }
+    if (listenFd != -1) {
+        ::close(listenFd);
+        ::unlink(socketPath.toLocal8Bit().constData());
+    }
+}
+
+bool MuxDaemon::listen() {
+    auto path = socketPath.toLocal8Bit();
+    auto address = sockaddr_un{};
+    address.sun_family = AF_UNIX;
+    if (std::size_t(path.size()) >= sizeof(address.sun_path)) {
+        qWarning() << "Socket path is too long:" << socketPath;
+        return false;
+    }
+    std::memcpy(address.sun_path, path.constData(), path.size() + 1);
+
+    listenFd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    auto bound = ::bind(listenFd, reinterpret_cast<const sockaddr *>(&address), sizeof(address));
+    if (bound == -1 && errno == EADDRINUSE) {
+        // Left behind by a daemon that did not exit cleanly, unless somebody still answers
+        if (MessageStream::connectTo(path.toStdString())) {
+            qWarning() << "Another daemon is listening on" << socketPath;
+            return false;
+        }
+        ::unlink(path.constData());
+        bound = ::bind(listenFd, reinterpret_cast<const sockaddr *>(&address), sizeof(address));
+    }
+    // Whoever can connect can make clangd read any file we can, keep it to ourselves
+    if (bound == -1 || ::chmod(path.constData(), S_IRUSR | S_IWUSR) == -1 ||
+        ::listen(listenFd, ListenBacklog) == -1) {
+        qWarning() << "Cannot listen on" << socketPath << ":" << std::strerror(errno);
+        return false;
+    }
+
+    listenNotifier = new QSocketNotifier(listenFd, QSocketNotifier::Read, this);
+    connect(listenNotifier, &QSocketNotifier::activated, this, &MuxDaemon::acceptClients);
+    qInfo() << "Listening on" << socketPath;
+    return true;
+}
+
+void MuxDaemon::acceptClients() {
+    while (true) {
+        auto fd = ::accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        auto client = std::make_unique<Client>();
+        client->id = ++nextClientId;
+        client->stream = std::make_unique<MessageStream>(fd);
+        client->notifier = new QSocketNotifier(fd, QSocketNotifier::Read, this);
+        connect(client->notifier, &QSocketNotifier::activated, this,
+                [this, id = client->id] { readClient(id); });
+        client->writeNotifier = new QSocketNotifier(fd, QSocketNotifier::Write, this);
+        client->writeNotifier->setEnabled(false);
+        connect(client->writeNotifier, &QSocketNotifier::activated, this,
+                [this, id = client->id] { writeClient(id); });
+        clients.emplace(client->id, std::move(client));
+    }
+}
+
+void MuxDaemon::readClient(int clientId) {
+    auto it = clients.find(clientId);
+    if (it == clients.end()) {
+        return;
+    }
+    auto &client = *it->second;
+    auto open = client.stream->fill();
+    while (auto body = client.stream->takeMessageBody()) {
+        auto document = QJsonDocument::fromJson(QByteArray::fromStdString(*body));
+        if (!document.isObject()) {
+            qWarning() << "Client" << clientId << "sent a malformed message";
+            continue;
+        }
+        handleClientMessage(client, document.object());
+        // `exit` disconnects the client
+        if (!clients.contains(clientId)) {
+            return;
+        }
+    }
+    if (!open) {
+        disconnectClient(clientId);
+    }
+}
+
+void MuxDaemon::writeClient(int clientId) {
+    auto it = clients.find(clientId);
+    if (it == clients.end()) {
+        return;
+    }
+    auto &client = *it->second;
+    try {
+        client.writeNotifier->setEnabled(!client.stream->flushQueued());
+    } catch (const std::exception &) {
+        dropClient(client);
+    }
+}
+
+void MuxDaemon::handleClientMessage(Client &client, QJsonObject message) {
+    auto method = message.value("method").toString();
+    auto id = message.value("id");
+    auto isRequest = !id.isUndefined();
+    if (method.isEmpty()) {
+        // Answers to server requests, which were already answered here
+        return;
+    }
+    if (method == "initialize") {
+        initializeClient(client, message);
+        return;
+    }
+    if (method == "exit") {
+        disconnectClient(client.id);
+        return;
+    }
+
+    auto serverIt = servers.find(client.root);
+    if (!client.initialized || serverIt == servers.end()) {
+        if (isRequest) {
+            sendToClient(client, jsonrpc::errorResponse(id, jsonrpc::ServerNotInitialized,
+                                                        "Not initialized"));
+        }
+        return;
+    }
+    auto &server = *serverIt->second;
+
+    if (method == "shutdown") {
+        // The server stays up for the other clients
+        sendToClient(client, response(id, QJsonValue::Null));
+    } else if (method == "initialized") {
+        if (!server.initializedSent) {
+            server.initializedSent = true;
+            sendToServer(server, message);
+        }
+    } else if (method == "textDocument/didOpen") {
+        auto uri = documentUri(message);
+        if (client.documents.contains(uri)) {
+            return;
+        }
+        client.documents.insert(uri, message.value("params")["textDocument"]["text"].toString());
+        auto &document = server.documents[uri];
+        if (document.references++ == 0) {
+            document.lastWriter = client.id;
+            sendToServer(server, withVersion(message, ++document.version));
+        } else {
+            // Already open for another client, the newest text wins
+            syncDocument(server, client, uri);
+        }
+    } else if (method == "textDocument/didChange") {
+        auto uri = documentUri(message);
+        auto text = client.documents.find(uri);
+        if (text == client.documents.end()) {
+            return;
+        }
+        for (auto const &change : message.value("params")["contentChanges"].toArray()) {
+            applyContentChange(*text, change.toObject());
+        }
+        auto &document = server.documents[uri];
+        if (document.lastWriter == client.id) {
+            sendToServer(server, withVersion(message, ++document.version));
+        } else {
+            // The edits are to the client's text, the server has another one
+            syncDocument(server, client, uri);
+        }
+    } else if (method == "textDocument/didClose") {
+        releaseDocument(client, documentUri(message));
+    } else if (method == "$/cancelRequest") {
+        auto cancelledId = message.value("params")["id"];
+        for (auto it = server.pending.cbegin(); it != server.pending.cend(); ++it) {
+            if (it->client == client.id && it->id == cancelledId) {
+                sendToServer(server, notification(method, {{"id", it.key()}}));
+                break;
+            }
+        }
+    } else if (isRequest) {
+        auto serverId = ++server.nextId;
+        server.pending.insert(serverId, {client.id, id, false});
+        message["id"] = serverId;
+        sendToServer(server, message);
+    } else {
+        sendToServer(server, message);
+    }
+}
+
+void MuxDaemon::initializeClient(Client &client, const QJsonObject &message) {
+    auto id = message.value("id");
+    if (client.initialized) {
+        sendToClient(client, jsonrpc::errorResponse(id, jsonrpc::InvalidRequest,
+                                                    "Already initialized"));
+        return;
+    }
+    auto params = message.value("params").toObject();
+    client.root = params.value("rootUri").toString(params.value("rootPath").toString());
+
+    auto serverIt = servers.find(client.root);
+    if (serverIt == servers.end()) {
+        auto server = std::make_unique<Server>();
+        server->root = client.root;
+        try {
+            server->process = std::make_unique<ServerProcess>(clangdPath.toStdString());
+        } catch (const std::system_error &e) {
+            qWarning() << "Cannot start" << clangdPath << ":" << e.what();
+            sendToClient(client, jsonrpc::errorResponse(id, jsonrpc::InternalError,
+                                                        "Cannot start the language server"));
+            return;
+        }
+        server->notifier = new QSocketNotifier(server->process->fd(), QSocketNotifier::Read, this);
+        connect(server->notifier, &QSocketNotifier::activated, this,
+                [this, root = client.root] { readServer(root); });
+        server->lingerTimer = new QTimer(this);
+        server->lingerTimer->setSingleShot(true);
+        server->lingerTimer->setInterval(LingerMs);
+        connect(server->lingerTimer, &QTimer::timeout, this,
+                [this, root = client.root] { stopServer(root); });
+        qInfo() << "Started" << clangdPath << "for" << client.root;
+
+        auto forwarded = message;
+        forwarded["id"] = ++server->nextId;
+        server->pending.insert(server->nextId, {client.id, id, true});
+        serverIt = servers.emplace(client.root, std::move(server)).first;
+        sendToServer(*serverIt->second, forwarded);
+    }
+
+    auto &server = *serverIt->second;
+    server.lingerTimer->stop();
+    server.clients.insert(client.id);
+    client.initialized = true;
+    if (server.initializeResponse) {
+        auto answer = *server.initializeResponse;
+        answer["id"] = id;
+        sendToClient(client, answer);
+    } else {
+        client.initializeId = id;
+    }
+}
+
+void MuxDaemon::disconnectClient(int clientId) {
+    auto it = clients.find(clientId);
+    if (it == clients.end()) {
+        return;
+    }
+    auto client = std::move(it->second);
+    clients.erase(it);
+    // May be the notifier whose signal is being handled
+    client->notifier->setEnabled(false);
+    client->notifier->deleteLater();
+    client->writeNotifier->setEnabled(false);
+    client->writeNotifier->deleteLater();
+
+    auto serverIt = servers.find(client->root);
+    if (!client->initialized || serverIt == servers.end()) {
+        return;
+    }
+    auto &server = *serverIt->second;
+    for (auto const &uri : client->documents.keys()) {
+        releaseDocument(*client, uri);
+    }
+    for (auto pending = server.pending.begin(); pending != server.pending.end();) {
+        if (pending->client != clientId) {
+            ++pending;
+            continue;
+        }
+        // The server still has to answer an initialize, which is shared
+        if (!pending->initialize) {
+            sendToServer(server, notification("$/cancelRequest", {{"id", pending.key()}}));
+            pending = server.pending.erase(pending);
+        } else {
+            pending->client = 0;
+            ++pending;
+        }
+    }
+    server.clients.remove(clientId);
+    if (server.clients.isEmpty()) {
+        server.lingerTimer->start();
+    }
+}
+
+void MuxDaemon::releaseDocument(Client &client, const QString &uri) {
+    if (!client.documents.remove(uri)) {
+        return;
+    }
+    auto serverIt = servers.find(client.root);
+    if (serverIt == servers.end()) {
+        return;
+    }
+    auto &server = *serverIt->second;
+    auto document = server.documents.find(uri);
+    if (document == server.documents.end()) {
+        return;
+    }
+    if (--document->references > 0) {
+        if (document->lastWriter == client.id) {
+            // The server goes on with the text of a client that still has the document
+            document->lastWriter = 0;
+            for (auto clientId : server.clients) {
+                // The client may be disconnecting and gone from the list already
+                auto other = clients.find(clientId);
+                if (other != clients.end() && other->second->documents.contains(uri)) {
+                    syncDocument(server, *other->second, uri);
+                    break;
+                }
+            }
+        }
+        return;
+    }
+    server.documents.erase(document);
+    sendToServer(server, notification("textDocument/didClose", {{"textDocument",
+                                                                  QJsonObject{{"uri", uri}}}}));
+}
+
+void MuxDaemon::syncDocument(Server &server, Client &client, const QString &uri) {
+    auto &document = server.documents[uri];
+    if (document.lastWriter == client.id) {
+        return;
+    }
+    auto &text = client.documents[uri];
+    auto writer = clients.find(document.lastWriter);
+    auto same = writer != clients.end() && writer->second->documents.value(uri) == text;
+    document.lastWriter = client.id;
+    if (same) {
+        return;
+    }
+    auto textDocument = QJsonObject{{"uri", uri}, {"version", ++document.version}};
+    auto change = QJsonObject{{"text", text}};
+    sendToServer(server, notification("textDocument/didChange",
+                                      {{"textDocument", textDocument},
+                                       {"contentChanges", QJsonArray{change}}}));
+}
+
+void MuxDaemon::readServer(const QString &root) {
+    auto it = servers.find(root);
+    if (it == servers.end()) {
+        return;
+    }
+    auto &server = *it->second;
+    auto open = server.process->fill();
+    while (auto body = server.process->takeMessageBody()) {
+        auto document = QJsonDocument::fromJson(QByteArray::fromStdString(*body));
+        if (document.isObject()) {
+            handleServerMessage(server, document.object());
+        }
+    }
+    if (!open) {
+        qWarning() << "clangd for" << root << "exited";
+        // Clients see their connection closed and are without a server until they connect
+        // again, the daemon does not start another clangd for them
+        for (auto clientId : QSet<int>(server.clients)) {
+            disconnectClient(clientId);
+        }
+        stopServer(root);
+    }
+}
+
+void MuxDaemon::handleServerMessage(Server &server, const QJsonObject &message) {
+    auto method = message.value("method").toString();
+    auto id = message.value("id");
+    if (!method.isEmpty()) {
+        if (!id.isUndefined()) {
+            // workspace/configuration, progress tokens and the like, the defaults do
+            sendToServer(server, response(id, QJsonValue::Null));
+            return;
+        }
+        auto uri = message.value("params")["uri"].toString();
+        for (auto clientId : server.clients) {
+            auto &client = *clients.at(clientId);
+            if (method != "textDocument/publishDiagnostics" || client.documents.contains(uri)) {
+                sendToClient(client, message);
+            }
+        }
+        return;
+    }
+
+    auto pending = server.pending.take(id.toInt());
+    if (pending.initialize) {
+        auto answer = message;
+        answer.remove("id");
+        server.initializeResponse = answer;
+        for (auto clientId : server.clients) {
+            auto &client = *clients.at(clientId);
+            if (client.initializeId) {
+                answer["id"] = *client.initializeId;
+                client.initializeId.reset();
+                sendToClient(client, answer);
+            }
+        }
+        return;
+    }
+    auto client = clients.find(pending.client);
+    if (client == clients.end()) {
+        return;
+    }
+    auto answer = message;
+    answer["id"] = pending.id;
+    sendToClient(*client->second, answer);
+}
+
+void MuxDaemon::stopServer(const QString &root) {
+    auto it = servers.find(root);
+    if (it == servers.end()) {
+        return;
+    }
+    auto server = std::move(it->second);
+    servers.erase(it);
+    server->notifier->setEnabled(false);
+    server->notifier->deleteLater();
+    server->lingerTimer->deleteLater();
+    for (auto const &[clientId, client] : clients) {
+        if (client->initialized && client->root == root) {
+            client->initialized = false;
+        }
+    }
+    qInfo() << "Stopping clangd for" << root;
+    sendToServer(*server, {{"jsonrpc", "2.0"}, {"id", ++server->nextId}, {"method", "shutdown"}});
+    sendToServer(*server, {{"jsonrpc", "2.0"}, {"method", "exit"}});
+    server->process->closeInput();
+    server->exitDeadline = std::chrono::steady_clock::now() + ExitTimeout;
+    exitingServers.push_back(std::move(server));
+    reapTimer->start();
+}
+
+void MuxDaemon::reapServers() {
+    auto now = std::chrono::steady_clock::now();
+    std::erase_if(exitingServers, [now](const std::unique_ptr<Server> &server) {
+        if (server->process->waitForExit(std::chrono::milliseconds(0))) {
+            return true;
+        }
+        if (now < server->exitDeadline) {
+            return false;
+        }
+        qWarning() << "clangd for" << server->root << "did not exit, killing it";
+        server->process->kill();
+        return true;
+    });
+    if (exitingServers.empty()) {
+        reapTimer->stop();
+    }
+}
+
+void MuxDaemon::dropClient(Client &client) {
+    client.notifier->setEnabled(false);
+    client.writeNotifier->setEnabled(false);
+    QTimer::singleShot(0, this, [this, id = client.id] { disconnectClient(id); });
+}
+
+void MuxDaemon::sendToClient(Client &client, const QJsonObject &message) {
+    // Being dropped
+    if (!client.notifier->isEnabled()) {
+        return;
+    }
+    try {
+        client.stream->queueMessage(
+            QJsonDocument(message).toJson(QJsonDocument::Compact).toStdString());
+    } catch (const std::exception &) {
+        // Gone
+        dropClient(client);
+        return;
+    }
+    auto backlog = client.stream->queuedBytes();
+    if (backlog > MaxClientBacklog) {
+        qWarning() << "Client" << client.id << "does not read its messages, disconnecting it";
+        dropClient(client);
+        return;
+    }
+    client.writeNotifier->setEnabled(backlog > 0);
+}
+
+void MuxDaemon::sendToServer(Server &server, const QJsonObject &message) {
+    try {
+        server.process->writeMessage(
+            QJsonDocument(message).toJson(QJsonDocument::Compact).toStdString());
+    } catch (const std::exception &e) {
+        // Its closed output is noticed by readServer()
+        qWarning() << "Cannot write to clangd for" << server.root << ":" << e.what();
+    }
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <QJsonObject>
+#include <QJsonValue>
+#include <QObject>
+#include <QSet>
+#include <QString>
+
+#include <map>
+#include <memory>
+#include <optional>
+#include <vector>
+
+class MessageStream;
+class QSocketNotifier;
+class QTimer;
+class ServerProcess;
+
+// Shares one clangd per workspace root between several clients (Linux only).
+//
+// Clients connect to a Unix socket and speak plain LSP. The first `initialize` for a root
+// starts its clangd, later clients get the cached answer. Request ids are rewritten to
+// per server ids and mapped back for the response, notifications from the server go to
+// every client, diagnostics only to those that have the document open. Documents are
+// reference counted: the server sees one didOpen and one didClose, and one version sequence
+// however many clients edit them. The server has the text of the client that changed a
+// document last, a change from another client sends that client's whole text first.
+// Requests from the server are answered here, as there is no single client to ask.
+//
+// Nothing here waits on a client: what a client does not read yet is buffered, and a client
+// whose buffer keeps growing is disconnected. A clangd without clients is kept for a while,
+// so reopening a project is instant.
+class MuxDaemon : public QObject {
+    Q_OBJECT
+  public:
+    MuxDaemon(const QString &clangdPath, const QString &socketPath, QObject *parent = nullptr);
+    ~MuxDaemon();
+
+    // False if the socket cannot be bound or another daemon is serving it
+    bool listen();
+
+  private:
+    struct Client;
+    struct Server;
+
+    struct Document {
+        int references = 0;
+        int version = 0;
+        // The client whose text the server has, 0 if that client closed the document
+        int lastWriter = 0;
+    };
+
+    struct PendingRequest {
+        int client = 0;
+        QJsonValue id;
+        bool initialize = false;
+    };
+
+    void acceptClients();
+    void readClient(int clientId);
+    void writeClient(int clientId);
+    void handleClientMessage(Client &client, QJsonObject message);
+    void initializeClient(Client &client, const QJsonObject &message);
+    // Disconnects the client once the current message is handled
+    void dropClient(Client &client);
+    void disconnectClient(int clientId);
+    void releaseDocument(Client &client, const QString &uri);
+    // Sends the client's whole text of uri unless the server has it already
+    void syncDocument(Server &server, Client &client, const QString &uri);
+
+    void readServer(const QString &root);
+    void handleServerMessage(Server &server, const QJsonObject &message);
+    // Tells the server to exit, it is waited for by reapServers()
+    void stopServer(const QString &root);
+    void reapServers();
+
+    void sendToClient(Client &client, const QJsonObject &message);
+    void sendToServer(Server &server, const QJsonObject &message);
+
+    QString clangdPath;
+    QString socketPath;
+    int listenFd = -1;
+    QSocketNotifier *listenNotifier = nullptr;
+
+    int nextClientId = 0;
+    std::map<int, std::unique_ptr<Client>> clients;
+    std::map<QString, std::unique_ptr<Server>> servers;
+    // Stopped, until they exit or are killed
+    std::vector<std::unique_ptr<Server>> exitingServers;
+    QTimer *reapTimer = nullptr;
+};
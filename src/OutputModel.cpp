@@ -0,0 +1,52 @@
+#include "OutputModel.hpp"
+
+#include <QBrush>
+
+#include <algorithm>
+
+OutputModel::OutputModel(qsizetype maxLines, QObject *parent)
+    : QAbstractListModel(parent), maxLines(std::max<qsizetype>(maxLines, 1)) {}
+
+void OutputModel::append(const QList<OutputLine> &newLines) {
+    // Lines that would be dropped right away are never inserted
+    auto first = std::max<qsizetype>(newLines.size() - maxLines, 0);
+    auto added = newLines.size() - first;
+    if (added == 0) {
+        return;
+    }
+    auto overflow = qsizetype(lines.size()) + added - maxLines;
+    if (overflow > 0) {
+        beginRemoveRows({}, 0, int(overflow - 1));
+        lines.erase(lines.begin(), lines.begin() + overflow);
+        endRemoveRows();
+    }
+    auto size = int(lines.size());
+    beginInsertRows({}, size, size + int(added) - 1);
+    lines.insert(lines.end(), newLines.cbegin() + first, newLines.cend());
+    endInsertRows();
+}
+
+void OutputModel::clear() {
+    beginResetModel();
+    lines.clear();
+    endResetModel();
+}
+
+int OutputModel::rowCount(const QModelIndex &parent) const {
+    return parent.isValid() ? 0 : int(lines.size());
+}
+
+QVariant OutputModel::data(const QModelIndex &index, int role) const {
+    if (!index.isValid() || index.row() >= int(lines.size())) {
+        return {};
+    }
+    auto const &line = lines[std::size_t(index.row())];
+    switch (role) {
+    case Qt::DisplayRole:
+        return line.text;
+    case Qt::ForegroundRole:
+        return QBrush(line.stream == OutputLine::Stream::Stderr ? Qt::red : Qt::blue);
+    default:
+        return {};
+    }
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <QAbstractListModel>
+#include <QList>
+#include <QString>
+
+#include <deque>
+
+// One line the application wrote to stdout or stderr, without its newline
+struct OutputLine {
+    enum class Stream { Stdout, Stderr };
+
+    Stream stream = Stream::Stdout;
+    QString text;
+};
+
+// Rows of the output pane, one per line. Only the newest maxLines lines are kept, older ones
+// are dropped from the front as new ones arrive.
+class OutputModel : public QAbstractListModel {
+    Q_OBJECT
+  public:
+    explicit OutputModel(qsizetype maxLines, QObject *parent = nullptr);
+
+    void append(const QList<OutputLine> &newLines);
+    void clear();
+
+    int rowCount(const QModelIndex &parent = {}) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+
+  private:
+    qsizetype maxLines;
+    std::deque<OutputLine> lines;
+};
@@ -0,0 +1,265 @@
+#include "PathStore.hpp"
+
+#include <algorithm>
+
+namespace {
+
+inline char16_t fold(char16_t ch) {
+    if (ch < 128) {
+        return (ch >= u'A' && ch <= u'Z') ? char16_t(ch + 32) : ch;
+    }
+    return QChar(ch).toCaseFolded().unicode();
+}
+
+QString folded(QStringView text) {
+    auto result = QString(text.size(), Qt::Uninitialized);
+    auto *out = result.data();
+    for (auto ch : text) {
+        *out++ = QChar(fold(ch.unicode()));
+    }
+    return result;
+}
+
+// Compares a1 + a2 with b1 + b2 without joining them
+int compareJoined(QStringView a1, QStringView a2, QStringView b1, QStringView b2) {
+    auto common = qMin(a1.size(), b1.size());
+    if (auto cmp = a1.first(common).compare(b1.first(common)); cmp != 0) {
+        return cmp;
+    }
+    a1 = a1.sliced(common);
+    b1 = b1.sliced(common);
+    // One of the first parts is used up, the rest is compared character by character
+    auto sizeA = a1.size() + a2.size();
+    auto sizeB = b1.size() + b2.size();
+    for (auto i = qsizetype(0); i < qMin(sizeA, sizeB); ++i) {
+        auto ca = i < a1.size() ? a1[i] : a2[i - a1.size()];
+        auto cb = i < b1.size() ? b1[i] : b2[i - b1.size()];
+        if (ca != cb) {
+            return ca < cb ? -1 : 1;
+        }
+    }
+    return sizeA < sizeB ? -1 : (sizeA > sizeB ? 1 : 0);
+}
+
+} // namespace
+
+PathStore::Storage::Storage() {
+    dirTable.ensure(RootDir);
+    dirIds.insert(QString(), RootDir);
+}
+
+const PathStore::Dir &PathStore::dirAt(DirId dir) const {
+    // Stores that never had anything added have no storage, only the root
+    static const auto root = Dir();
+    return storage ? storage->dirTable[dir] : root;
+}
+
+std::unique_lock<std::mutex> PathStore::lockTip() {
+    if (!storage) {
+        storage = std::make_shared<Storage>();
+    }
+    auto lock = std::unique_lock(storage->mutex);
+    if (storage->tipFiles != files || storage->tipDirs != dirs) {
+        lock.unlock();
+        detach();
+        lock = std::unique_lock(storage->mutex);
+    }
+    return lock;
+}
+
+void PathStore::detach() {
+    // This store's part does not change anymore, it is read without the lock
+    auto copy = std::make_shared<Storage>();
+    for (auto i = qsizetype(0); i < files; ++i) {
+        copy->entries.ensure(i);
+        copy->entries[i] = storage->entries[i];
+    }
+    for (auto offset = qsizetype(0); offset < nameEnd; offset += BlockSize) {
+        auto length = qMin(BlockSize, nameEnd - offset);
+        copy->names.ensure(offset);
+        copy->foldedNames.ensure(offset);
+        std::copy_n(&storage->names[offset], length, &copy->names[offset]);
+        std::copy_n(&storage->foldedNames[offset], length, &copy->foldedNames[offset]);
+    }
+    for (auto dir = DirId(1); dir < dirs; ++dir) {
+        copy->dirTable.ensure(dir);
+        copy->dirTable[dir] = storage->dirTable[dir];
+        copy->dirIds.insert(copy->dirTable[dir].path, dir);
+    }
+    copy->tipFiles = files;
+    copy->tipDirs = dirs;
+    storage = std::move(copy);
+}
+
+PathStore::DirId PathStore::addDir(QStringView relDir) {
+    if (dirAt(lastDir).path == relDir) {
+        return lastDir;
+    }
+    if (auto id = findDir(relDir); id >= 0) {
+        lastDir = id;
+        return id;
+    }
+
+    // "a/b/" -> "a/"
+    auto parentEnd = relDir.chopped(1).lastIndexOf(u'/') + 1;
+    auto parent = addDir(relDir.first(parentEnd));
+    auto lock = lockTip();
+    auto id = DirId(dirs);
+    storage->dirTable.ensure(id);
+    storage->dirTable[id] = {parent, relDir.toString(), folded(relDir)};
+    storage->dirIds.insert(storage->dirTable[id].path, id);
+    storage->tipDirs = ++dirs;
+    lastDir = id;
+    return id;
+}
+
+PathStore::DirId PathStore::findDir(QStringView relDir) const {
+    if (!storage) {
+        return relDir.isEmpty() ? RootDir : -1;
+    }
+    auto lock = std::lock_guard(storage->mutex);
+    // Directories another store added behind this one are not in this snapshot
+    auto id = storage->dirIds.value(relDir.toString(), -1);
+    return id < dirs ? id : -1;
+}
+
+qsizetype PathStore::addFile(DirId dir, QStringView name) {
+    Q_ASSERT(name.size() <= BlockSize);
+    auto lock = lockTip();
+    auto offset = nameEnd;
+    if (offset % BlockSize + name.size() > BlockSize) {
+        offset += BlockSize - offset % BlockSize;
+    }
+    storage->names.ensure(offset);
+    storage->foldedNames.ensure(offset);
+    auto *out = &storage->names[offset];
+    auto *foldedOut = &storage->foldedNames[offset];
+    for (auto ch : name) {
+        *out++ = ch.unicode();
+        *foldedOut++ = fold(ch.unicode());
+    }
+    storage->entries.ensure(files);
+    storage->entries[files] = Entry{dir, quint32(offset), quint32(name.size())};
+    nameEnd = offset + name.size();
+    storage->tipFiles = ++files;
+    return files - 1;
+}
+
+qsizetype PathStore::addFile(QStringView relDir, QStringView name) {
+    return addFile(addDir(relDir), name);
+}
+
+qsizetype PathStore::addFile(QStringView relPath) {
+    auto nameStart = relPath.lastIndexOf(u'/') + 1;
+    return addFile(relPath.first(nameStart), relPath.sliced(nameStart));
+}
+
+void PathStore::append(const QStringList &relPaths) {
+    for (auto const &relPath : relPaths) {
+        addFile(relPath);
+    }
+}
+
+PathStore PathStore::fromList(const QStringList &relPaths) {
+    auto store = PathStore();
+    store.append(relPaths);
+    return store;
+}
+
+QStringView PathStore::nameBlock(qsizetype offset, bool folded) const {
+    Q_ASSERT(offset % BlockSize == 0);
+    auto length = qMin(BlockSize, nameEnd - offset);
+    return QStringView(folded ? &storage->foldedNames[offset] : &storage->names[offset], length);
+}
+
+bool PathStore::loadFiles(const Entry *fileEntries, qsizetype count, const char16_t *names,
+                          const char16_t *foldedNames, qsizetype arenaSize) {
+    if (files > 0 || count > qsizetype(decltype(Storage::entries)::capacity()) ||
+        arenaSize > qsizetype(decltype(Storage::names)::capacity())) {
+        return false;
+    }
+    for (auto i = qsizetype(0); i < count; ++i) {
+        auto const &entry = fileEntries[i];
+        if (entry.dir < 0 || entry.dir >= dirs || entry.nameSize > BlockSize ||
+            entry.nameOffset % BlockSize + entry.nameSize > BlockSize ||
+            qsizetype(entry.nameOffset) + entry.nameSize > arenaSize) {
+            return false;
+        }
+    }
+
+    auto lock = lockTip();
+    for (auto offset = qsizetype(0); offset < arenaSize; offset += BlockSize) {
+        auto length = qMin(BlockSize, arenaSize - offset);
+        storage->names.ensure(offset);
+        storage->foldedNames.ensure(offset);
+        std::copy_n(names + offset, length, &storage->names[offset]);
+        std::copy_n(foldedNames + offset, length, &storage->foldedNames[offset]);
+    }
+    for (auto first = qsizetype(0); first < count; first += EntryChunk) {
+        storage->entries.ensure(first);
+        std::copy_n(fileEntries + first, qMin(EntryChunk, count - first),
+                    &storage->entries[first]);
+    }
+    files = count;
+    nameEnd = arenaSize;
+    storage->tipFiles = files;
+    return true;
+}
+
+QStringList PathStore::toList() const {
+    auto list = QStringList();
+    list.reserve(size());
+    for (auto i = qsizetype(0); i < size(); ++i) {
+        list << path(i);
+    }
+    return list;
+}
+
+QStringView PathStore::name(qsizetype file) const {
+    auto const &entry = storage->entries[file];
+    return QStringView(&storage->names[entry.nameOffset], entry.nameSize);
+}
+
+QStringView PathStore::foldedName(qsizetype file) const {
+    auto const &entry = storage->entries[file];
+    return QStringView(&storage->foldedNames[entry.nameOffset], entry.nameSize);
+}
+
+qsizetype PathStore::pathSize(qsizetype file) const {
+    auto const &entry = storage->entries[file];
+    return dirPath(entry.dir).size() + entry.nameSize;
+}
+
+QString PathStore::path(qsizetype file) const {
+    auto buffer = QString();
+    path(file, buffer);
+    return buffer;
+}
+
+void PathStore::path(qsizetype file, QString &buffer) const {
+    buffer.resize(0);
+    buffer.append(dirPath(dirOf(file)));
+    buffer.append(name(file));
+}
+
+QStringView PathStore::foldedDirName(DirId dir) const {
+    if (dir == RootDir) {
+        return {};
+    }
+    auto parentSize = foldedDirPath(parentDir(dir)).size();
+    auto const &path = foldedDirPath(dir);
+    return QStringView(path).sliced(parentSize, path.size() - parentSize - 1);
+}
+
+bool PathStore::lessThan(qsizetype a, qsizetype b) const {
+    auto dirA = dirOf(a);
+    auto dirB = dirOf(b);
+    auto cmp = dirA == dirB ? foldedName(a).compare(foldedName(b))
+                            : compareJoined(foldedDirPath(dirA), foldedName(a),
+                                            foldedDirPath(dirB), foldedName(b));
+    if (cmp == 0) {
+        // Names that differ in case only
+        return compareJoined(dirPath(dirA), name(a), dirPath(dirB), name(b)) < 0;
+    }
+    return cmp < 0;
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include "ChunkedArray.hpp"
+
+#include <QHash>
+#include <QList>
+#include <QString>
+#include <QStringList>
+#include <QStringView>
+
+#include <memory>
+#include <mutex>
+
+// Compact store for the relative paths of a project.
+//
+// Every directory is interned once with its parent id and its full relative path ("a/b/",
+// "" for the root). A file is a 12 byte entry with its directory id and the offset of its
+// name in an arena of UTF-16 blocks. A second arena with the same layout keeps the case
+// folded names, and folded directory paths are kept next to the plain ones, so filters
+// and sorting never split or lower case a path again.
+//
+// Files can only be appended. Copies share one storage of chunks that never move and see
+// the files and directories that were there when they were made, so copying is cheap and a
+// copy may be read from other threads while the original keeps appending behind it. Only
+// the copy that appended last appends in place, another one copies its part first.
+class PathStore {
+  public:
+    using DirId = qint32;
+    static constexpr DirId RootDir = 0;
+    // Names never cross a block boundary, so a name is contiguous in one chunk
+    static constexpr qsizetype BlockSize = 64 * 1024;
+
+    // A file, its name is at nameOffset in the name arenas
+    struct Entry {
+        DirId dir;
+        quint32 nameOffset;
+        quint32 nameSize;
+    };
+
+    qsizetype size() const { return files; }
+    bool isEmpty() const { return files == 0; }
+
+    // Interns relDir ("a/b/") and its parents
+    DirId addDir(QStringView relDir);
+    // -1 if relDir is unknown
+    DirId findDir(QStringView relDir) const;
+    qsizetype addFile(DirId dir, QStringView name);
+    qsizetype addFile(QStringView relDir, QStringView name);
+    qsizetype addFile(QStringView relPath);
+    void append(const QStringList &relPaths);
+
+    static PathStore fromList(const QStringList &relPaths);
+    QStringList toList() const;
+
+    DirId dirOf(qsizetype file) const { return storage->entries[file].dir; }
+    QStringView name(qsizetype file) const;
+    QStringView foldedName(qsizetype file) const;
+    qsizetype pathSize(qsizetype file) const;
+    QString path(qsizetype file) const;
+    // Writes the path into buffer, reusing its allocation
+    void path(qsizetype file, QString &buffer) const;
+
+    qsizetype dirCount() const { return dirs; }
+    DirId parentDir(DirId dir) const { return dirAt(dir).parent; }
+    const QString &dirPath(DirId dir) const { return dirAt(dir).path; }
+    const QString &foldedDirPath(DirId dir) const { return dirAt(dir).foldedPath; }
+    // Last segment of the directory path, without the trailing `/`
+    QStringView foldedDirName(DirId dir) const;
+
+    // Case insensitive path order
+    bool lessThan(qsizetype a, qsizetype b) const;
+
+    // The layout in memory, which FileIndex saves as it is and loads back in whole blocks
+    const Entry &entry(qsizetype file) const { return storage->entries[file]; }
+    qsizetype nameArenaSize() const { return nameEnd; }
+    // The arena from offset, a multiple of BlockSize, to the end of its block
+    QStringView nameBlock(qsizetype offset, bool folded) const;
+    // Adds the files of a saved store to this one, which has its directories and no files
+    // yet. False if an entry refers to a directory or a name outside of what is given.
+    bool loadFiles(const Entry *fileEntries, qsizetype count, const char16_t *names,
+                   const char16_t *foldedNames, qsizetype arenaSize);
+
+    // True if both stores are the same snapshot
+    bool isSharedWith(const PathStore &other) const {
+        return storage == other.storage && files == other.files && dirs == other.dirs;
+    }
+
+  private:
+    struct Dir {
+        DirId parent = -1;
+        QString path;
+        QString foldedPath;
+    };
+
+    static constexpr qsizetype EntryChunk = 64 * 1024;
+
+    struct Storage {
+        Storage();
+
+        ChunkedArray<Entry, EntryChunk, 1024> entries;
+        ChunkedArray<char16_t, BlockSize, 4096> names;
+        ChunkedArray<char16_t, BlockSize, 4096> foldedNames;
+        ChunkedArray<Dir, 4096, 4096> dirTable;
+
+        // Guards the rest, the sizes of the store that appended last and the directory ids
+        std::mutex mutex;
+        qsizetype tipFiles = 0;
+        qsizetype tipDirs = 1;
+        QHash<QString, DirId> dirIds;
+    };
+
+    const Dir &dirAt(DirId dir) const;
+    // Locks the storage for appending, with a storage of its own if another store appended
+    // behind this one
+    std::unique_lock<std::mutex> lockTip();
+    void detach();
+
+    std::shared_ptr<Storage> storage;
+    qsizetype files = 0;
+    qsizetype dirs = 1;
+    qsizetype nameEnd = 0;
+    DirId lastDir = RootDir;
+};
@@ -0,0 +1,103 @@
+#include "ReplayServer.hpp"
+#include "JsonRpc.hpp"
+
+#include <QDebug>
+#include <QFile>
+#include <QJsonDocument>
+#include <QTimer>
+
+#include <chrono>
+
+ReplayServer::ReplayServer(bool keepTiming, QObject *parent)
+    : StdioServer(parent), keepTiming(keepTiming) {}
+
+bool ReplayServer::load(const QString &sessionPath) {
+    auto file = QFile(sessionPath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qWarning() << "Cannot read" << sessionPath;
+        return false;
+    }
+
+    struct Request {
+        QString method;
+        qsizetype index = 0;
+        qint64 time = 0;
+    };
+    // Client requests waiting for their answer, by id
+    auto requests = QHash<QString, Request>();
+    // The client message the server's own messages follow
+    auto last = std::optional<Request>();
+    auto lineNumber = 0;
+    while (!file.atEnd()) {
+        auto line = file.readLine();
+        ++lineNumber;
+        if (line.trimmed().isEmpty()) {
+            continue;
+        }
+        auto entry = QJsonDocument::fromJson(line).object();
+        auto message = entry.value("message").toObject();
+        if (message.isEmpty()) {
+            qWarning() << sessionPath << "line" << lineNumber << "is not a recorded message";
+            continue;
+        }
+        auto time = entry.value("t_us").toInteger();
+        auto method = message.value("method").toString();
+        auto id = message.value("id");
+
+        if (entry.value("dir").toString() == "send") {
+            // Answers of the client to requests of the server are not needed
+            if (method.isEmpty()) {
+                continue;
+            }
+            auto &list = occurrences[method];
+            auto request = Request{method, list.size(), time};
+            list.append(Occurrence());
+            if (!id.isUndefined()) {
+                requests.insert(jsonrpc::idKey(id), request);
+            }
+            last = request;
+        } else if (method.isEmpty()) {
+            auto request = requests.take(jsonrpc::idKey(id));
+            if (!request.method.isEmpty()) {
+                occurrences[request.method][request.index].answer =
+                    Reply{time - request.time, message};
+            }
+        } else if (last) {
+            occurrences[last->method][last->index].followUps.append(
+                Reply{time - last->time, message});
+        }
+    }
+    return true;
+}
+
+void ReplayServer::handleClientMessage(const QJsonObject &message) {
+    auto method = message.value("method").toString();
+    if (method.isEmpty()) {
+        return;
+    }
+    auto index = seen[method]++;
+    auto &list = occurrences[method];
+    auto occurrence = index < list.size() ? &list[index] : nullptr;
+
+    if (message.contains("id")) {
+        auto answer = occurrence && occurrence->answer
+                          ? *occurrence->answer
+                          : Reply{0, {{"jsonrpc", "2.0"}, {"result", QJsonValue::Null}}};
+        answer.message["id"] = message.value("id");
+        schedule(answer);
+    }
+    if (occurrence) {
+        for (auto const &followUp : std::as_const(occurrence->followUps)) {
+            schedule(followUp);
+        }
+    }
+}
+
+void ReplayServer::schedule(const Reply &reply) {
+    if (!keepTiming || reply.delayUs < 1000) {
+        send(reply.message);
+        return;
+    }
+    QTimer::singleShot(std::chrono::milliseconds(reply.delayUs / 1000), Qt::PreciseTimer, this,
+                       [this, message = reply.message] { send(message); });
+}
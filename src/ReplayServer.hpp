@@ -0,0 +1,50 @@
+#pragma once
+
+#include "StdioServer.hpp"
+
+#include <QHash>
+#include <QJsonObject>
+#include <QList>
+#include <QString>
+
+#include <optional>
+
+// Stands in for a language server by serving a session saved by SessionRecorder (Linux
+// only).
+//
+// It speaks LSP on a socket, as the client's ServerProcess connects stdin and stdout to one.
+// A request gets the answer recorded for the request of the same method at the same
+// position in the session, the third hover the third hover's answer, under the id used
+// now. What the server sent on its own, like diagnostics, follows the client message it
+// followed in the session. Both keep their recorded delays unless timing is off. Requests
+// the session has no answer for get a null result.
+class ReplayServer : public StdioServer {
+    Q_OBJECT
+  public:
+    explicit ReplayServer(bool keepTiming, QObject *parent = nullptr);
+
+    // False if the session cannot be read
+    bool load(const QString &sessionPath);
+
+  protected:
+    void handleClientMessage(const QJsonObject &message) override;
+
+  private:
+    struct Reply {
+        qint64 delayUs = 0;
+        QJsonObject message;
+    };
+
+    // One message of a method from the client in the session
+    struct Occurrence {
+        std::optional<Reply> answer;
+        QList<Reply> followUps;
+    };
+
+    void schedule(const Reply &reply);
+
+    bool keepTiming;
+    QHash<QString, QList<Occurrence>> occurrences;
+    // Messages of each method the client sent so far
+    QHash<QString, qsizetype> seen;
+};
@@ -0,0 +1,167 @@
+#include "RequestScheduler.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace {
+
+constexpr const char *ClassNames[] = {"interactive", "visible", "background"};
+
+} // namespace
+
+RequestScheduler::RequestScheduler(std::array<int, PriorityCount> limits) {
+    for (auto i = 0; i < PriorityCount; ++i) {
+        classes[i].limit = std::max(limits[i], 1);
+    }
+}
+
+RequestScheduler::Ticket RequestScheduler::submit(Priority priority, std::string key, Send send,
+                                                  Dropped dropped) {
+    auto replaced = Dropped();
+    auto ticket = Ticket(0);
+    {
+        auto lock = std::lock_guard(mutex);
+        auto &requests = classes[int(priority)];
+        ++requests.submitted;
+        ticket = ++nextTicket;
+        auto it = requests.queue.end();
+        if (!key.empty()) {
+            it = std::find_if(requests.queue.begin(), requests.queue.end(),
+                              [&](const Request &request) { return request.key == key; });
+        }
+        if (it != requests.queue.end()) {
+            ++requests.deduplicated;
+            it->ticket = ticket;
+            it->send = std::move(send);
+            replaced = std::exchange(it->dropped, std::move(dropped));
+        } else {
+            requests.queue.push_back(
+                {ticket, std::move(key), std::move(send), std::move(dropped), Clock::now()});
+        }
+    }
+    if (replaced) {
+        replaced();
+    }
+    return ticket;
+}
+
+bool RequestScheduler::cancel(Ticket ticket) {
+    auto dropped = Dropped();
+    {
+        auto lock = std::lock_guard(mutex);
+        auto found = false;
+        for (auto &requests : classes) {
+            auto it =
+                std::find_if(requests.queue.begin(), requests.queue.end(),
+                             [&](const Request &request) { return request.ticket == ticket; });
+            if (it != requests.queue.end()) {
+                dropped = std::move(it->dropped);
+                requests.queue.erase(it);
+                ++requests.cancelled;
+                found = true;
+                break;
+            }
+        }
+        if (!found) {
+            return false;
+        }
+    }
+    if (dropped) {
+        dropped();
+    }
+    return true;
+}
+
+void RequestScheduler::pump() {
+    while (true) {
+        auto request = Request();
+        auto priority = 0;
+        auto sentEpoch = std::uint64_t(0);
+        auto sent = Clock::time_point();
+        {
+            auto lock = std::lock_guard(mutex);
+            while (priority < PriorityCount &&
+                   (classes[priority].queue.empty() ||
+                    classes[priority].inFlight >= classes[priority].limit)) {
+                ++priority;
+            }
+            if (priority == PriorityCount) {
+                return;
+            }
+            auto &requests = classes[priority];
+            request = std::move(requests.queue.front());
+            requests.queue.pop_front();
+            ++requests.inFlight;
+            sent = Clock::now();
+            requests.queueDelay.record(sent - request.queued);
+            sentEpoch = epoch;
+        }
+        auto finished = std::make_shared<std::atomic_bool>(false);
+        request.send([this, priority, sent, sentEpoch, finished] {
+            if (!finished->exchange(true)) {
+                finish(priority, sent, sentEpoch);
+            }
+        });
+    }
+}
+
+void RequestScheduler::reset() {
+    auto dropped = std::vector<Dropped>();
+    {
+        auto lock = std::lock_guard(mutex);
+        for (auto &requests : classes) {
+            for (auto &request : requests.queue) {
+                if (request.dropped) {
+                    dropped.push_back(std::move(request.dropped));
+                }
+            }
+            requests.queue.clear();
+            requests.inFlight = 0;
+        }
+        ++epoch;
+    }
+    for (auto const &function : dropped) {
+        function();
+    }
+}
+
+const LatencyHistogram &RequestScheduler::queueDelay(Priority priority) const {
+    return classes[int(priority)].queueDelay;
+}
+
+const LatencyHistogram &RequestScheduler::serverTime(Priority priority) const {
+    return classes[int(priority)].serverTime;
+}
+
+std::string RequestScheduler::summary() const {
+    auto lock = std::lock_guard(mutex);
+    auto text = std::string();
+    for (auto i = 0; i < PriorityCount; ++i) {
+        auto const &requests = classes[i];
+        if (requests.submitted == 0) {
+            continue;
+        }
+        text += std::string("Requests ") + ClassNames[i] + ": " +
+                std::to_string(requests.submitted) + " submitted, " +
+                std::to_string(requests.deduplicated) + " deduplicated, " +
+                std::to_string(requests.cancelled) + " cancelled queued, " +
+                std::to_string(requests.completed) + " completed; queued " +
+                requests.queueDelay.summary() + "; server " + requests.serverTime.summary() +
+                "\n";
+    }
+    return text;
+}
+
+void RequestScheduler::finish(int priority, Clock::time_point sent, std::uint64_t sentEpoch) {
+    auto lock = std::lock_guard(mutex);
+    if (sentEpoch != epoch) {
+        return;
+    }
+    auto &requests = classes[priority];
+    --requests.inFlight;
+    ++requests.completed;
+    requests.serverTime.record(Clock::now() - sent);
+}
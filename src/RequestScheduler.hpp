@@ -0,0 +1,85 @@
+#pragma once
+
+#include "LatencyHistogram.hpp"
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+
+// Orders outgoing LSP requests by priority class.
+//
+// Requests wait in one queue per class and go out highest class first, as long as the class
+// has fewer requests in flight than its limit, so background work never keeps more than a
+// few server threads busy and interactive requests do not queue behind it. A request with
+// the same key as one still queued replaces it and takes over its place. A request that is
+// replaced, cancelled or reset away before it was sent is told so through its Dropped
+// function, so its caller is not left waiting for an answer.
+//
+// The time spent queued here and the time the server took are recorded separately per
+// class. All methods are thread safe. Requests are only sent from pump(), never from
+// submit() or a completion, so callers decide on which thread and outside which locks
+// sending happens. Dropped functions are called outside the lock by the method that dropped
+// the request.
+class RequestScheduler {
+  public:
+    enum class Priority { Interactive, Visible, Background };
+    static constexpr int PriorityCount = 3;
+
+    // Has to be called once the response or error arrived
+    using Done = std::function<void()>;
+    using Send = std::function<void(Done done)>;
+    // Called instead of Send for a request that will never be sent
+    using Dropped = std::function<void()>;
+    using Ticket = std::uint64_t;
+
+    explicit RequestScheduler(std::array<int, PriorityCount> limits = {4, 2, 1});
+
+    // An empty key never deduplicates
+    Ticket submit(Priority priority, std::string key, Send send, Dropped dropped = nullptr);
+    // Drops a request that was not sent yet, false if it is gone from the queue already
+    bool cancel(Ticket ticket);
+    // Sends what the limits allow
+    void pump();
+    // Forgets queued and in-flight requests, when the connection went away
+    void reset();
+
+    const LatencyHistogram &queueDelay(Priority priority) const;
+    const LatencyHistogram &serverTime(Priority priority) const;
+    // One line per class with counts and latencies
+    std::string summary() const;
+
+  private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Request {
+        Ticket ticket = 0;
+        std::string key;
+        Send send;
+        Dropped dropped;
+        Clock::time_point queued;
+    };
+
+    struct Class {
+        std::deque<Request> queue;
+        int limit = 1;
+        int inFlight = 0;
+        std::uint64_t submitted = 0;
+        std::uint64_t deduplicated = 0;
+        std::uint64_t cancelled = 0;
+        std::uint64_t completed = 0;
+        LatencyHistogram queueDelay;
+        LatencyHistogram serverTime;
+    };
+
+    void finish(int priority, Clock::time_point sent, std::uint64_t sentEpoch);
+
+    mutable std::mutex mutex;
+    std::array<Class, PriorityCount> classes;
+    Ticket nextTicket = 0;
+    // Completions of requests sent before a reset are ignored
+    std::uint64_t epoch = 0;
+};
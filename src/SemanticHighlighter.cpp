@@ -0,0 +1,210 @@
+#include "SemanticHighlighter.hpp"
+
+#include <QColor>
+#include <QFont>
+#include <QTextBlock>
+#include <QTextDocument>
+#include <QTimer>
+
+#include <algorithm>
+#include <utility>
+
+namespace {
+
+// Edits are collected this long before tokens are asked for
+constexpr int RequestDelayMs = 150;
+
+QTextCharFormat colored(const QColor &color, bool bold = false, bool italic = false) {
+    auto format = QTextCharFormat();
+    format.setForeground(color);
+    if (bold) {
+        format.setFontWeight(QFont::Bold);
+    }
+    format.setFontItalic(italic);
+    return format;
+}
+
+// Indexed by CppLexer::Kind
+QList<QTextCharFormat> lexerFormats() {
+    return {
+        colored(Qt::darkBlue, true),          // Keyword
+        colored(Qt::darkGreen, false, true),  // Comment
+        colored(Qt::darkRed),                 // String
+        colored(Qt::darkMagenta),             // Number
+        colored(QColor(0x80, 0x40, 0x00)),    // Preprocessor
+    };
+}
+
+// Standard LSP token types, anything else is left to the lexer
+QTextCharFormat tokenFormat(const std::string &type) {
+    if (type == "namespace") {
+        return colored(Qt::darkCyan);
+    }
+    if (type == "type" || type == "class" || type == "enum" || type == "interface" ||
+        type == "struct" || type == "typeParameter" || type == "concept") {
+        return colored(Qt::darkMagenta, true);
+    }
+    if (type == "function" || type == "method") {
+        return colored(QColor(0x00, 0x40, 0x80));
+    }
+    if (type == "macro") {
+        return colored(QColor(0x80, 0x40, 0x00));
+    }
+    if (type == "parameter") {
+        return colored(Qt::black, false, true);
+    }
+    if (type == "property") {
+        return colored(Qt::darkCyan, false, true);
+    }
+    if (type == "enumMember") {
+        return colored(Qt::darkYellow);
+    }
+    if (type == "comment") {
+        // clangd marks code disabled by the preprocessor like this
+        return colored(Qt::gray);
+    }
+    return {};
+}
+
+} // namespace
+
+SemanticHighlighter::SemanticHighlighter(QTextDocument *document)
+    : QSyntaxHighlighter(static_cast<QObject *>(document)) {
+    requestTimer = new QTimer(this);
+    requestTimer->setSingleShot(true);
+    requestTimer->setInterval(RequestDelayMs);
+    connect(requestTimer, &QTimer::timeout, this, &SemanticHighlighter::tokensWanted);
+
+    // Connected before the highlighter's own handler, so line numbers are adjusted before
+    // the edited blocks are highlighted
+    blockCount = document->blockCount();
+    connect(document, &QTextDocument::contentsChange, this,
+            &SemanticHighlighter::onContentsChange);
+    setDocument(document);
+}
+
+void SemanticHighlighter::setLegend(const SemanticTokensLegend &legend) {
+    typeFormats.clear();
+    for (auto const &type : legend.tokenTypes) {
+        typeFormats.append(tokenFormat(type));
+    }
+    deprecatedModifier = 0;
+    for (auto i = std::size_t(0); i < legend.tokenModifiers.size() && i < 32; ++i) {
+        if (legend.tokenModifiers[i] == "deprecated") {
+            deprecatedModifier = 1u << i;
+        }
+    }
+}
+
+void SemanticHighlighter::scheduleRequest() {
+    if (requestInFlight) {
+        editedMeanwhile = true;
+        return;
+    }
+    requestTimer->start();
+}
+
+const std::string &SemanticHighlighter::beginRequest() {
+    requestInFlight = true;
+    editedMeanwhile = false;
+    requestRevision = document()->revision();
+    return resultId;
+}
+
+void SemanticHighlighter::applyTokens(std::optional<SemanticTokensUpdate> &&update) {
+    requestInFlight = false;
+    if (!update) {
+        // The tokens shown stay, the next request asks for all of them
+        resultId.clear();
+    } else {
+        auto applied = update->delta ? tokens.apply(std::move(update->edits))
+                                     : tokens.replace(update->data);
+        resultId = applied ? std::move(update->resultId) : std::string();
+        tokensRevision = requestRevision;
+        if (!applied) {
+            editedMeanwhile = true;
+        }
+    }
+    if (editedMeanwhile) {
+        scheduleRequest();
+    }
+    if (tokensRevision != document()->revision()) {
+        // Shown once tokens for the current text arrive, the changes are kept until then
+        return;
+    }
+    for (auto const &range : tokens.takeChangedLines()) {
+        repaintLines(range.first, range.last);
+    }
+    auto lines = std::exchange(unpaintedLines, {});
+    std::sort(lines.begin(), lines.end());
+    lines.erase(std::unique(lines.begin(), lines.end()), lines.end());
+    for (auto line : lines) {
+        repaintLines(line, line);
+    }
+}
+
+void SemanticHighlighter::highlightBlock(const QString &text) {
+    auto state = previousBlockState() == CppLexer::InComment ? CppLexer::InComment
+                                                             : CppLexer::Normal;
+    spans.clear();
+    setCurrentBlockState(CppLexer::lexLine(text, state, spans));
+    static const auto formats = lexerFormats();
+    for (auto const &span : spans) {
+        setFormat(int(span.start), int(span.length), formats[int(span.kind)]);
+    }
+
+    if (tokens.empty()) {
+        return;
+    }
+    auto line = currentBlock().blockNumber();
+    if (tokensRevision != document()->revision()) {
+        unpaintedLines.append(line);
+        return;
+    }
+    for (auto const &token : tokens.line(line)) {
+        if (token.type >= std::uint32_t(typeFormats.size()) || token.start >= text.size()) {
+            continue;
+        }
+        auto format = typeFormats[token.type];
+        if (token.modifiers & deprecatedModifier) {
+            format.setFontStrikeOut(true);
+        }
+        if (format.propertyCount() == 0) {
+            continue;
+        }
+        auto length = std::min<qsizetype>(token.length, text.size() - token.start);
+        setFormat(int(token.start), int(length), format);
+    }
+}
+
+void SemanticHighlighter::onContentsChange(int position, int removed, int added) {
+    auto newBlockCount = document()->blockCount();
+    auto lineDelta = newBlockCount - blockCount;
+    blockCount = newBlockCount;
+    if (lineDelta != 0 && !unpaintedLines.isEmpty()) {
+        auto editLine = document()->findBlock(position).blockNumber();
+        auto it = unpaintedLines.begin();
+        while (it != unpaintedLines.end()) {
+            if (*it <= editLine) {
+                ++it;
+            } else if (*it + lineDelta <= editLine) {
+                // The line was removed
+                it = unpaintedLines.erase(it);
+            } else {
+                *it += lineDelta;
+                ++it;
+            }
+        }
+    }
+    if (removed > 0 || added > 0) {
+        scheduleRequest();
+    }
+}
+
+void SemanticHighlighter::repaintLines(int first, int last) {
+    auto block = document()->findBlockByNumber(first);
+    for (auto line = first; line <= last && block.isValid(); ++line) {
+        rehighlightBlock(block);
+        block = block.next();
+    }
+}
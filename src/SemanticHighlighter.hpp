@@ -0,0 +1,65 @@
+#pragma once
+
+#include <QList>
+#include <QSyntaxHighlighter>
+#include <QTextCharFormat>
+
+#include <optional>
+#include <string>
+
+#include "CppLexer.hpp"
+#include "LspClientImpl.hpp"
+#include "SemanticTokens.hpp"
+
+class QTimer;
+
+// Highlights an editor with the server's semantic tokens on top of a local lexer.
+//
+// The lexer colours every block as it is shown or edited, so there are colours before the
+// first tokens arrive and on lines typed since. Tokens are asked for once edits settle
+// down, updated from deltas, and only the blocks whose tokens changed are highlighted
+// again: typing costs the same in a 20k line file as in a short one.
+//
+// Tokens describe the text at the time they were asked for. A response for text that was
+// edited meanwhile is kept but not shown, the next one is asked for right away.
+class SemanticHighlighter : public QSyntaxHighlighter {
+    Q_OBJECT
+  public:
+    explicit SemanticHighlighter(QTextDocument *document);
+
+    bool hasLegend() const { return !typeFormats.isEmpty(); }
+    void setLegend(const SemanticTokensLegend &legend);
+
+    // Asks for tokens soon, through tokensWanted()
+    void scheduleRequest();
+    // Call when sending the request, returns the result id to ask for a delta against
+    const std::string &beginRequest();
+    void applyTokens(std::optional<SemanticTokensUpdate> &&update);
+
+  signals:
+    void tokensWanted();
+
+  protected:
+    void highlightBlock(const QString &text) override;
+
+  private:
+    void onContentsChange(int position, int removed, int added);
+    void repaintLines(int first, int last);
+
+    SemanticTokens tokens;
+    std::string resultId;
+    QList<QTextCharFormat> typeFormats;
+    std::uint32_t deprecatedModifier = 0;
+    QList<CppLexer::Span> spans;
+
+    // Document revisions the request in flight and the current tokens are for
+    int requestRevision = -1;
+    int tokensRevision = -1;
+    bool requestInFlight = false;
+    bool editedMeanwhile = false;
+    QTimer *requestTimer;
+
+    // Blocks highlighted while the tokens were out of date
+    QList<int> unpaintedLines;
+    int blockCount = 0;
+};
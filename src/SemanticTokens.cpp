@@ -0,0 +1,187 @@
+#include "SemanticTokens.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+// Beyond this many separate ranges they are merged into one, a few extra lines are cheaper
+// to repaint than a long list is to maintain
+constexpr std::size_t MaxChangedRanges = 64;
+
+} // namespace
+
+std::span<const SemanticTokens::Token> SemanticTokens::line(int line) const {
+    auto lineNumber = std::uint32_t(line);
+    auto begin = std::lower_bound(
+        tokens.begin(), tokens.end(), lineNumber,
+        [](const Token &token, std::uint32_t value) { return token.line < value; });
+    auto end = begin;
+    while (end != tokens.end() && end->line == lineNumber) {
+        ++end;
+    }
+    return {begin, end};
+}
+
+bool SemanticTokens::replace(const std::vector<std::uint32_t> &newData) {
+    if (newData.size() % Fields != 0) {
+        clear();
+        return false;
+    }
+    auto oldCount = data.size() / Fields;
+    auto newCount = newData.size() / Fields;
+    auto sameToken = [&](std::size_t oldIndex, std::size_t newIndex) {
+        return std::memcmp(&data[oldIndex * Fields], &newData[newIndex * Fields],
+                           Fields * sizeof(std::uint32_t)) == 0;
+    };
+    auto prefix = std::size_t(0);
+    while (prefix < oldCount && prefix < newCount && sameToken(prefix, prefix)) {
+        ++prefix;
+    }
+    auto suffix = std::size_t(0);
+    while (suffix < oldCount - prefix && suffix < newCount - prefix &&
+           sameToken(oldCount - suffix - 1, newCount - suffix - 1)) {
+        ++suffix;
+    }
+    applyEdit(prefix, oldCount - prefix - suffix, newData.data() + prefix * Fields,
+              newCount - prefix - suffix);
+    return true;
+}
+
+bool SemanticTokens::apply(std::vector<Edit> edits) {
+    // Applied back to front, so the offsets of the ones before stay valid
+    std::sort(edits.begin(), edits.end(),
+              [](const Edit &a, const Edit &b) { return a.start > b.start; });
+    auto end = data.size();
+    for (auto const &edit : edits) {
+        if (edit.start % Fields != 0 || edit.deleteCount % Fields != 0 ||
+            edit.data.size() % Fields != 0 || edit.start + edit.deleteCount > end) {
+            clear();
+            return false;
+        }
+        end = edit.start;
+    }
+    for (auto const &edit : edits) {
+        applyEdit(edit.start / Fields, edit.deleteCount / Fields, edit.data.data(),
+                  edit.data.size() / Fields);
+    }
+    return true;
+}
+
+void SemanticTokens::clear() {
+    if (!tokens.empty()) {
+        markChanged(int(tokens.front().line), int(tokens.back().line));
+    }
+    data.clear();
+    tokens.clear();
+}
+
+std::vector<SemanticTokens::LineRange> SemanticTokens::takeChangedLines() {
+    std::sort(changed.begin(), changed.end(),
+              [](const LineRange &a, const LineRange &b) { return a.first < b.first; });
+    auto merged = std::vector<LineRange>();
+    for (auto const &range : changed) {
+        if (!merged.empty() && range.first <= merged.back().last + 1) {
+            merged.back().last = std::max(merged.back().last, range.last);
+        } else {
+            merged.push_back(range);
+        }
+    }
+    changed.clear();
+    return merged;
+}
+
+void SemanticTokens::applyEdit(std::size_t first, std::size_t removed,
+                               const std::uint32_t *added, std::size_t addedCount) {
+    if (removed == 0 && addedCount == 0) {
+        return;
+    }
+    auto firstChanged = -1;
+    auto lastChanged = -1;
+    auto touch = [&](std::uint32_t line) {
+        firstChanged = firstChanged == -1 ? int(line) : std::min(firstChanged, int(line));
+        lastChanged = std::max(lastChanged, int(line));
+    };
+    for (auto i = first; i < first + removed; ++i) {
+        touch(tokens[i].line);
+    }
+
+    auto editBegin = data.begin() + std::ptrdiff_t(first * Fields);
+    if (removed == addedCount) {
+        // Retyping a token, the common case, moves nothing
+        std::copy_n(added, addedCount * Fields, editBegin);
+    } else {
+        editBegin = data.erase(editBegin, editBegin + std::ptrdiff_t(removed * Fields));
+        data.insert(editBegin, added, added + addedCount * Fields);
+    }
+
+    // Decode the new tokens relative to the one before them
+    auto line = first > 0 ? tokens[first - 1].line : 0;
+    auto start = first > 0 ? tokens[first - 1].start : 0;
+    auto decoded = std::vector<Token>(addedCount);
+    for (auto i = std::size_t(0); i < addedCount; ++i) {
+        auto fields = added + i * Fields;
+        if (fields[0] > 0) {
+            line += fields[0];
+            start = fields[1];
+        } else {
+            start += fields[1];
+        }
+        decoded[i] = {line, start, fields[2], fields[3], fields[4]};
+        touch(line);
+    }
+    auto replaced = std::min(removed, addedCount);
+    std::copy_n(decoded.begin(), replaced, tokens.begin() + std::ptrdiff_t(first));
+    auto tail = tokens.begin() + std::ptrdiff_t(first + replaced);
+    if (removed > addedCount) {
+        tokens.erase(tail, tail + std::ptrdiff_t(removed - addedCount));
+    } else {
+        tokens.insert(tail, decoded.begin() + std::ptrdiff_t(replaced), decoded.end());
+    }
+
+    // Tokens on the line the edit ended on are positioned relative to it, the first one on
+    // a later line tells how far everything behind it moved
+    auto shift = 0LL;
+    auto shiftFrom = 0LL;
+    auto i = first + addedCount;
+    for (; i < tokens.size(); ++i) {
+        auto fields = &data[i * Fields];
+        if (fields[0] > 0) {
+            shiftFrom = tokens[i].line;
+            shift = (long long)line + fields[0] - tokens[i].line;
+            break;
+        }
+        start += fields[1];
+        tokens[i].line = line;
+        tokens[i].start = start;
+        touch(line);
+    }
+    if (shift != 0) {
+        for (; i < tokens.size(); ++i) {
+            tokens[i].line = std::uint32_t(tokens[i].line + shift);
+        }
+        for (auto &range : changed) {
+            if (range.first >= shiftFrom) {
+                range.first = int(std::max(range.first + shift, 0LL));
+            }
+            if (range.last >= shiftFrom) {
+                range.last = int(std::max(range.last + shift, (long long)range.first));
+            }
+        }
+    }
+    if (lastChanged != -1) {
+        markChanged(firstChanged, lastChanged);
+    }
+}
+
+void SemanticTokens::markChanged(int first, int last) {
+    changed.push_back({first, last});
+    if (changed.size() > MaxChangedRanges) {
+        auto all = changed.front();
+        for (auto const &range : changed) {
+            all.first = std::min(all.first, range.first);
+            all.last = std::max(all.last, range.last);
+        }
+        changed.assign(1, all);
+    }
+}
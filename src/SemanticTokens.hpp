@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// The semantic tokens of one document, as last sent by the server.
+//
+// LSP sends tokens as a flat array of five integers per token, each token positioned
+// relative to the one before it, and later updates as edits to that array. The array is
+// kept as is so edits apply to it directly, next to the decoded tokens sorted by line.
+// Applying an edit only decodes the tokens it replaced and the ones sharing a line with
+// them, the tokens behind it just move by the lines the edit added or removed.
+//
+// The lines whose tokens changed are collected until the owner takes them, and are kept in
+// sync with the lines later updates add or remove. It is not thread safe.
+class SemanticTokens {
+  public:
+    struct Token {
+        std::uint32_t line = 0;
+        // Columns count UTF-16 code units
+        std::uint32_t start = 0;
+        std::uint32_t length = 0;
+        // Indices into the legend of the server, modifiers as a bit set
+        std::uint32_t type = 0;
+        std::uint32_t modifiers = 0;
+    };
+
+    struct Edit {
+        // Offsets into the integer array, not token indices
+        std::uint32_t start = 0;
+        std::uint32_t deleteCount = 0;
+        std::vector<std::uint32_t> data;
+    };
+
+    // Both lines included
+    struct LineRange {
+        int first = 0;
+        int last = 0;
+    };
+
+    bool empty() const { return tokens.empty(); }
+    std::size_t size() const { return tokens.size(); }
+    // Tokens of line, ordered by column
+    std::span<const Token> line(int line) const;
+
+    // A full update. Only the lines between the first and last token that differ from the
+    // current ones are reported as changed.
+    bool replace(const std::vector<std::uint32_t> &data);
+    // A delta update, edits refer to the array before any of them is applied. Returns false
+    // if they do not fit it, the tokens are cleared then and need a full update.
+    bool apply(std::vector<Edit> edits);
+    void clear();
+
+    // Lines changed since the last call, sorted and merged
+    std::vector<LineRange> takeChangedLines();
+
+  private:
+    static constexpr std::uint32_t Fields = 5;
+
+    void applyEdit(std::size_t first, std::size_t removed, const std::uint32_t *added,
+                   std::size_t addedCount);
+    void markChanged(int first, int last);
+
+    std::vector<std::uint32_t> data;
+    std::vector<Token> tokens;
+    std::vector<LineRange> changed;
+};
@@ -0,0 +1,98 @@
+#include "ServerProcess.hpp"
+
+#include <system_error>
+#include <thread>
+
+#if defined(__linux__)
+#include <cerrno>
+#include <csignal>
+#include <spawn.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+ServerProcess::ServerProcess(const std::string &executable,
+                             const std::vector<std::string> &arguments)
+    : ServerProcess(spawn(executable, arguments)) {}
+
+ServerProcess::ServerProcess(Spawned spawned) : MessageStream(spawned.fd), pid(spawned.pid) {}
+
+ServerProcess::~ServerProcess() { kill(); }
+
+void ServerProcess::close(std::chrono::milliseconds timeout) {
+    closeInput();
+    if (!waitForExit(timeout)) {
+        kill();
+    }
+}
+
+#if defined(__linux__)
+
+ServerProcess::Spawned ServerProcess::spawn(const std::string &executable,
+                                            const std::vector<std::string> &arguments) {
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) == -1) {
+        throw std::system_error(errno, std::generic_category(), "socketpair");
+    }
+
+    auto argv = std::vector<char *>();
+    argv.push_back(const_cast<char *>(executable.c_str()));
+    for (auto const &argument : arguments) {
+        argv.push_back(const_cast<char *>(argument.c_str()));
+    }
+    argv.push_back(nullptr);
+
+    // The child gets one end as stdin and stdout, stderr stays ours
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, fds[1], STDIN_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, fds[1], STDOUT_FILENO);
+    auto childPid = pid_t();
+    auto error =
+        posix_spawn(&childPid, executable.c_str(), &actions, nullptr, argv.data(), environ);
+    posix_spawn_file_actions_destroy(&actions);
+    ::close(fds[1]);
+    if (error != 0) {
+        ::close(fds[0]);
+        throw std::system_error(error, std::generic_category(), executable);
+    }
+    return {fds[0], childPid};
+}
+
+bool ServerProcess::waitForExit(std::chrono::milliseconds timeout) {
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (pid != -1) {
+        if (::waitpid(pid, nullptr, WNOHANG) == pid) {
+            pid = -1;
+            break;
+        }
+        if (std::chrono::steady_clock::now() >= deadline) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    return true;
+}
+
+void ServerProcess::kill() {
+    if (pid == -1) {
+        return;
+    }
+    ::kill(pid, SIGKILL);
+    ::waitpid(pid, nullptr, 0);
+    pid = -1;
+}
+
+#else
+
+ServerProcess::Spawned ServerProcess::spawn(const std::string &executable,
+                                            const std::vector<std::string> &) {
+    throw std::system_error(std::make_error_code(std::errc::not_supported), executable);
+}
+
+bool ServerProcess::waitForExit(std::chrono::milliseconds) { return true; }
+
+void ServerProcess::kill() {}
+
+#endif
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "MessageStream.hpp"
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+// A language server child process talking LSP over its stdin and stdout (Linux only).
+//
+// Both are connected to one socket, read through MessageStream, so the LSP connection is
+// only asked to read a message once all of it is buffered and never blocks the reactor
+// thread.
+class ServerProcess : public MessageStream {
+  public:
+    // Throws std::system_error if the process cannot be started
+    explicit ServerProcess(const std::string &executable,
+                           const std::vector<std::string> &arguments = {});
+    ~ServerProcess() override;
+
+    bool waitForExit(std::chrono::milliseconds timeout);
+    void kill();
+
+    // Closes the input, which makes a server that was told to exit actually quit, and kills
+    // it if it is still running after timeout
+    void close(std::chrono::milliseconds timeout) override;
+
+  private:
+    struct Spawned {
+        int fd;
+        int pid;
+    };
+    static Spawned spawn(const std::string &executable,
+                         const std::vector<std::string> &arguments);
+    explicit ServerProcess(Spawned spawned);
+
+    int pid = -1;
+};
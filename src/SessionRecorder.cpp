@@ -0,0 +1,37 @@
+#include "SessionRecorder.hpp"
+
+#include <algorithm>
+#include <filesystem>
+
+std::string SessionRecorder::sessionPath(const std::string &path, int session) {
+    if (session <= 1) {
+        return path;
+    }
+    auto numbered = std::filesystem::path(path);
+    auto name = numbered.stem().string() + "-" + std::to_string(session) +
+                numbered.extension().string();
+    return numbered.replace_filename(name).string();
+}
+
+bool SessionRecorder::open(const std::string &path) {
+    auto lock = std::lock_guard(mutex);
+    file.open(path, std::ios::out | std::ios::trunc);
+    origin = std::chrono::steady_clock::now();
+    return bool(file);
+}
+
+void SessionRecorder::record(WireTrace::Direction direction, std::string_view body) {
+    auto time = std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - origin)
+                    .count();
+    // Line breaks can only be whitespace between the tokens of a JSON message, strings have
+    // them escaped, so the message stays on one line without them
+    auto message = std::string(body);
+    std::replace_if(
+        message.begin(), message.end(), [](char c) { return c == '\n' || c == '\r'; }, ' ');
+
+    auto lock = std::lock_guard(mutex);
+    file << "{\"t_us\":" << time << ",\"dir\":\""
+         << (direction == WireTrace::Direction::Sent ? "send" : "receive")
+         << "\",\"message\":" << message << "}\n";
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <chrono>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+#include "WireTrace.hpp"
+
+// Saves every message of an LSP session with its time, for lsp_replay to serve again.
+//
+// One JSON object per line: {"t_us": microseconds since open(), "dir": "send" or "receive",
+// "message": the message as it was on the wire}. Messages can be recorded from any thread.
+class SessionRecorder {
+  public:
+    // Where the session-th recording of a client goes: path for the first, then
+    // "name-2.jsonl" and so on next to it
+    static std::string sessionPath(const std::string &path, int session);
+
+    // Truncates path, false if it cannot be written
+    bool open(const std::string &path);
+    void record(WireTrace::Direction direction, std::string_view body);
+
+  private:
+    std::mutex mutex;
+    std::ofstream file;
+    std::chrono::steady_clock::time_point origin;
+};
@@ -0,0 +1,147 @@
+#include "SpanTrace.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+
+namespace {
+
+// Spans a thread can record between two drains before further ones are dropped
+constexpr std::size_t RingEvents = 16384;
+constexpr auto DrainInterval = std::chrono::milliseconds(100);
+
+// value as a quoted JSON string
+std::string jsonString(std::string_view value) {
+    auto quoted = std::string("\"");
+    for (auto c : value) {
+        if (c == '"' || c == '\\') {
+            quoted += '\\';
+            quoted += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char escaped[8];
+            std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            quoted += escaped;
+        } else {
+            quoted += c;
+        }
+    }
+    return quoted + '"';
+}
+
+} // namespace
+
+SpanTrace &SpanTrace::instance() {
+    static auto trace = SpanTrace();
+    return trace;
+}
+
+std::string SpanTrace::defaultPath() {
+    if (auto path = std::getenv("LSP_DEMO_SPANS_FILE"); path && *path) {
+        return path;
+    }
+    auto error = std::error_code();
+    auto dir = std::filesystem::temp_directory_path(error);
+    return ((error ? std::filesystem::path(".") : dir) / "lsp-client-demo-spans.json").string();
+}
+
+SpanTrace::SpanTrace() : rings(RingEvents, DrainInterval) {}
+
+SpanTrace::~SpanTrace() { stop(); }
+
+bool SpanTrace::start(const std::string &path) {
+    stop();
+    file.open(path, std::ios::out | std::ios::trunc);
+    if (!file) {
+        return false;
+    }
+    // The JSON array format, which stays readable if the closing bracket is never written
+    file << "[";
+    wroteEvent = false;
+    namedThreads.clear();
+    rings.start([this](const ThreadRings<Event>::Buffers &buffers) { drain(buffers); });
+    active.store(true, std::memory_order_relaxed);
+    return true;
+}
+
+void SpanTrace::stop() {
+    if (!rings.isRunning()) {
+        return;
+    }
+    active.store(false, std::memory_order_relaxed);
+    rings.stop();
+    file << "\n]\n";
+    file.close();
+}
+
+bool SpanTrace::isRunning() const { return rings.isRunning(); }
+
+std::int64_t SpanTrace::now() const {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() -
+                                                                origin)
+        .count();
+}
+
+std::uint64_t SpanTrace::nextId() { return lastId.fetch_add(1, std::memory_order_relaxed) + 1; }
+
+void SpanTrace::complete(const char *name, std::int64_t start, std::int64_t end) {
+    push({name, start, end - start, 0, 'X'});
+}
+
+void SpanTrace::asyncBegin(const char *name, std::uint64_t id) {
+    push({name, now(), 0, id, 'b'});
+}
+
+void SpanTrace::asyncEnd(const char *name, std::uint64_t id) { push({name, now(), 0, id, 'e'}); }
+
+void SpanTrace::push(const Event &event) {
+    // The end of a span that began before stop()
+    if (!enabled()) {
+        return;
+    }
+    rings.push(Event(event));
+}
+
+void SpanTrace::drain(const ThreadRings<Event>::Buffers &buffers) {
+    for (auto const &buffer : buffers) {
+        if (!buffer->ring.isEmpty() && namedThreads.insert(buffer->thread).second) {
+            append("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" +
+                   std::to_string(buffer->thread) + ",\"args\":{\"name\":" +
+                   jsonString(buffer->name) + "}}");
+        }
+        while (auto event = buffer->ring.tryPop()) {
+            write(*event, buffer->thread);
+        }
+        if (auto dropped = buffer->dropped.exchange(0, std::memory_order_relaxed)) {
+            char line[160];
+            std::snprintf(line, sizeof(line),
+                          "{\"name\":\"dropped spans\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,"
+                          "\"pid\":1,\"tid\":%d,\"args\":{\"count\":%llu}}",
+                          now() / 1000.0, buffer->thread, (unsigned long long)dropped);
+            append(line);
+        }
+    }
+    file.flush();
+}
+
+void SpanTrace::write(const Event &event, int thread) {
+    // Timestamps are in microseconds, the fraction keeps the nanoseconds
+    char line[256];
+    if (event.phase == 'X') {
+        std::snprintf(line, sizeof(line),
+                      "{\"name\":\"%s\",\"cat\":\"app\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+                      "\"pid\":1,\"tid\":%d}",
+                      event.name, event.time / 1000.0, event.duration / 1000.0, thread);
+    } else {
+        std::snprintf(line, sizeof(line),
+                      "{\"name\":\"%s\",\"cat\":\"app\",\"ph\":\"%c\",\"id\":\"0x%llx\","
+                      "\"ts\":%.3f,\"pid\":1,\"tid\":%d}",
+                      event.name, event.phase, (unsigned long long)event.id, event.time / 1000.0,
+                      thread);
+    }
+    append(line);
+}
+
+void SpanTrace::append(std::string_view event) {
+    file << (wroteEvent ? ",\n" : "\n") << event;
+    wroteEvent = true;
+}
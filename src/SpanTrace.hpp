@@ -0,0 +1,99 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+
+#include "ThreadRings.hpp"
+
+// Timed spans of the app's work, written as Chrome trace events that Perfetto and
+// chrome://tracing open.
+//
+// Spans are recorded with nanosecond timestamps into a lock free ring owned by the recording
+// thread, a writer thread drains the rings into a JSON array file. Names are not copied, they
+// have to be string literals. While tracing is off a span costs the relaxed load in
+// enabled(), so the instrumentation stays in release builds.
+class SpanTrace {
+  public:
+    static SpanTrace &instance();
+
+    static bool enabled() { return active.load(std::memory_order_relaxed); }
+
+    // $LSP_DEMO_SPANS_FILE, or lsp-client-demo-spans.json in the temporary directory
+    static std::string defaultPath();
+
+    SpanTrace();
+    ~SpanTrace();
+    SpanTrace(const SpanTrace &) = delete;
+    SpanTrace &operator=(const SpanTrace &) = delete;
+
+    // Starts tracing into path, false if it cannot be written
+    bool start(const std::string &path);
+    // Writes out what was recorded so far and closes the file
+    void stop();
+    bool isRunning() const;
+
+    // Nanoseconds on the trace's clock
+    std::int64_t now() const;
+    // Identifies an async span between its begin and end
+    std::uint64_t nextId();
+
+    // A span that began and ended on the calling thread
+    void complete(const char *name, std::int64_t start, std::int64_t end);
+    // A span that may end on another thread than it began on, matched by name and id
+    void asyncBegin(const char *name, std::uint64_t id);
+    void asyncEnd(const char *name, std::uint64_t id);
+
+  private:
+    struct Event {
+        const char *name = nullptr;
+        std::int64_t time = 0;
+        // Complete spans only
+        std::int64_t duration = 0;
+        std::uint64_t id = 0;
+        char phase = 'X';
+    };
+    void push(const Event &event);
+    void drain(const ThreadRings<Event>::Buffers &buffers);
+    void write(const Event &event, int thread);
+    // Adds one element to the JSON array
+    void append(std::string_view event);
+
+    static inline std::atomic<bool> active{false};
+
+    std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now();
+    std::atomic<std::uint64_t> lastId{0};
+
+    ThreadRings<Event> rings;
+
+    // Used by the writer thread
+    std::ofstream file;
+    bool wroteEvent = false;
+    // Threads whose name is in the file
+    std::unordered_set<int> namedThreads;
+};
+
+// Records the time from its construction to its destruction as a complete span, if tracing
+// was on when it was constructed. name has to be a string literal.
+class ScopedSpan {
+  public:
+    explicit ScopedSpan(const char *name)
+        : name(SpanTrace::enabled() ? name : nullptr),
+          start(this->name ? SpanTrace::instance().now() : 0) {}
+    ~ScopedSpan() {
+        if (name) {
+            auto &trace = SpanTrace::instance();
+            trace.complete(name, start, trace.now());
+        }
+    }
+    ScopedSpan(const ScopedSpan &) = delete;
+    ScopedSpan &operator=(const ScopedSpan &) = delete;
+
+  private:
+    const char *name;
+    std::int64_t start;
+};
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <optional>
+#include <vector>
+
+// Bounded lock free queue for exactly one producer and one consumer thread.
+//
+// The capacity is rounded up to a power of two. Head and tail live on their own cache
+// lines and each side caches the other side's index, so a push or pop only touches
+// shared state when its cached view says the ring is full or empty.
+// Several producer threads may share a ring if they serialise their pushes themselves.
+template <typename T> class SpscRing {
+  public:
+    explicit SpscRing(std::size_t capacity)
+        : slots(std::bit_ceil(std::max<std::size_t>(capacity, 2))), mask(slots.size() - 1) {}
+
+    SpscRing(const SpscRing &) = delete;
+    SpscRing &operator=(const SpscRing &) = delete;
+
+    std::size_t capacity() const { return slots.size(); }
+
+    // Producer side, false if the ring is full
+    bool tryPush(T &&value) {
+        auto tail = producer.index.load(std::memory_order_relaxed);
+        if (tail - producer.cachedOther == slots.size()) {
+            producer.cachedOther = consumer.index.load(std::memory_order_acquire);
+            if (tail - producer.cachedOther == slots.size()) {
+                return false;
+            }
+        }
+        slots[tail & mask] = std::move(value);
+        producer.index.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side, empty if there is nothing to read
+    std::optional<T> tryPop() {
+        auto head = consumer.index.load(std::memory_order_relaxed);
+        if (head == consumer.cachedOther) {
+            consumer.cachedOther = producer.index.load(std::memory_order_acquire);
+            if (head == consumer.cachedOther) {
+                return std::nullopt;
+            }
+        }
+        auto value = std::optional<T>(std::move(slots[head & mask]));
+        slots[head & mask] = T();
+        consumer.index.store(head + 1, std::memory_order_release);
+        return value;
+    }
+
+    // Approximate when called from another thread than the consumer
+    bool isEmpty() const {
+        return consumer.index.load(std::memory_order_acquire) ==
+               producer.index.load(std::memory_order_acquire);
+    }
+
+  private:
+    struct alignas(64) Side {
+        std::atomic<std::size_t> index{0};
+        // Last seen index of the other side, only used by the owning thread
+        std::size_t cachedOther = 0;
+    };
+
+    std::vector<T> slots;
+    std::size_t mask;
+    Side producer;
+    Side consumer;
+};
@@ -0,0 +1,60 @@
+#include "StdioServer.hpp"
+#include "MessageStream.hpp"
+
+#include <QCoreApplication>
+#include <QDebug>
+#include <QJsonDocument>
+#include <QSocketNotifier>
+
+StdioServer::StdioServer(QObject *parent) : QObject(parent) {}
+
+StdioServer::~StdioServer() = default;
+
+void StdioServer::serve(int fd) {
+    stream = std::make_unique<MessageStream>(fd);
+    notifier = new QSocketNotifier(fd, QSocketNotifier::Read, this);
+    connect(notifier, &QSocketNotifier::activated, this, &StdioServer::readClient);
+}
+
+bool StdioServer::isServing() const {
+    return notifier && notifier->isEnabled();
+}
+
+void StdioServer::readClient() {
+    auto open = stream->fill();
+    while (auto body = stream->takeMessageBody()) {
+        auto document = QJsonDocument::fromJson(QByteArray::fromStdString(*body));
+        if (!document.isObject()) {
+            qWarning() << "The client sent a malformed message";
+            continue;
+        }
+        auto message = document.object();
+        if (message.value("method").toString() == "exit") {
+            finish();
+        } else {
+            handleClientMessage(message);
+        }
+        if (!isServing()) {
+            return;
+        }
+    }
+    if (!open) {
+        finish();
+    }
+}
+
+void StdioServer::send(const QJsonObject &message) {
+    if (!isServing()) {
+        return;
+    }
+    try {
+        stream->writeMessage(QJsonDocument(message).toJson(QJsonDocument::Compact).toStdString());
+    } catch (const std::exception &) {
+        finish();
+    }
+}
+
+void StdioServer::finish() {
+    notifier->setEnabled(false);
+    QCoreApplication::quit();
+}
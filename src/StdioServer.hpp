@@ -0,0 +1,39 @@
+#pragma once
+
+#include <QJsonObject>
+#include <QObject>
+
+#include <memory>
+
+class MessageStream;
+class QSocketNotifier;
+
+// The connection of a language server of our own to its client (Linux only), shared by
+// lsp_mock and lsp_replay.
+//
+// Reads the client's messages as they arrive and hands each to handleClientMessage(). Once
+// the client sends exit or disconnects, or a message cannot be written, it stops serving and
+// quits the application.
+class StdioServer : public QObject {
+    Q_OBJECT
+  public:
+    explicit StdioServer(QObject *parent = nullptr);
+    ~StdioServer() override;
+
+    // Serves the client on fd
+    void serve(int fd);
+
+  protected:
+    // Every message of the client but exit
+    virtual void handleClientMessage(const QJsonObject &message) = 0;
+    // Dropped once serving stopped
+    void send(const QJsonObject &message);
+    bool isServing() const;
+    virtual void finish();
+
+  private:
+    void readClient();
+
+    std::unique_ptr<MessageStream> stream;
+    QSocketNotifier *notifier = nullptr;
+};
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "SpscRing.hpp"
+
+#if defined(__linux__)
+#include <pthread.h>
+#endif
+
+// Events recorded into a lock free ring per thread and handed to a writer thread, the
+// machinery shared by WireTrace and SpanTrace.
+//
+// A thread gets its ring on the first push(). The writer calls the drain function with every
+// ring each interval and once more on stop(), so what was recorded before is still written.
+// A ring's buffer is a thread_local of the Event type: there can only be one object per
+// Event type.
+template <typename Event> class ThreadRings {
+  public:
+    struct Buffer {
+        explicit Buffer(std::size_t capacity) : ring(capacity) {}
+
+        SpscRing<Event> ring;
+        // Events the ring had no room for since the last drain
+        std::atomic<std::uint64_t> dropped{0};
+        // Numbered from 1 in the order the threads first recorded
+        int thread = 0;
+        // The name of the system thread, "thread <number>" if it has none
+        std::string name;
+    };
+    using Buffers = std::vector<std::shared_ptr<Buffer>>;
+
+    ThreadRings(std::size_t ringEvents, std::chrono::milliseconds drainInterval)
+        : ringEvents(ringEvents), drainInterval(drainInterval) {}
+    ~ThreadRings() { stop(); }
+    ThreadRings(const ThreadRings &) = delete;
+    ThreadRings &operator=(const ThreadRings &) = delete;
+
+    void start(std::function<void(const Buffers &buffers)> drainFunction) {
+        stop();
+        {
+            // Left over from the last run, the writer is not running to take them
+            auto lock = std::lock_guard(buffersMutex);
+            for (auto const &buffer : buffers) {
+                while (buffer->ring.tryPop()) {
+                }
+                buffer->dropped.store(0, std::memory_order_relaxed);
+            }
+        }
+        drain = std::move(drainFunction);
+        stopping = false;
+        writer = std::thread([this] { run(); });
+    }
+
+    void stop() {
+        if (!writer.joinable()) {
+            return;
+        }
+        {
+            auto lock = std::lock_guard(runMutex);
+            stopping = true;
+        }
+        wake.notify_one();
+        writer.join();
+    }
+
+    bool isRunning() const { return writer.joinable(); }
+
+    // Counted as dropped if the calling thread's ring is full
+    void push(Event &&event) {
+        auto &buffer = threadBuffer();
+        if (!buffer.ring.tryPush(std::move(event))) {
+            buffer.dropped.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+  private:
+    Buffer &threadBuffer() {
+        thread_local auto buffer = std::shared_ptr<Buffer>();
+        if (!buffer) {
+            buffer = std::make_shared<Buffer>(ringEvents);
+#if defined(__linux__)
+            // QThread names the system thread, other threads carry the process name
+            char name[16] = {};
+            if (pthread_getname_np(pthread_self(), name, sizeof(name)) == 0) {
+                buffer->name = name;
+            }
+#endif
+            auto lock = std::lock_guard(buffersMutex);
+            buffer->thread = nextThread++;
+            if (buffer->name.empty()) {
+                buffer->name = "thread " + std::to_string(buffer->thread);
+            }
+            buffers.push_back(buffer);
+        }
+        return *buffer;
+    }
+
+    void run() {
+        auto lock = std::unique_lock(runMutex);
+        auto done = false;
+        while (!done) {
+            done = wake.wait_for(lock, drainInterval, [this] { return stopping; });
+            lock.unlock();
+            drainBuffers();
+            lock.lock();
+        }
+    }
+
+    void drainBuffers() {
+        auto lock = std::lock_guard(buffersMutex);
+        drain(buffers);
+        // Only the list still holds the buffers of threads that ended
+        std::erase_if(buffers, [](const std::shared_ptr<Buffer> &buffer) {
+            return buffer.use_count() == 1 && buffer->ring.isEmpty();
+        });
+    }
+
+    const std::size_t ringEvents;
+    const std::chrono::milliseconds drainInterval;
+
+    std::mutex buffersMutex;
+    Buffers buffers;
+    int nextThread = 1;
+
+    // Writer thread
+    std::mutex runMutex;
+    std::condition_variable wake;
+    bool stopping = false;
+    std::thread writer;
+    std::function<void(const Buffers &buffers)> drain;
+};
@@ -0,0 +1,231 @@
+#include "WireTrace.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <limits>
+
+namespace {
+
+// Messages a thread can record between two drains before further ones are dropped
+constexpr std::size_t RingEvents = 8192;
+constexpr auto DrainInterval = std::chrono::milliseconds(100);
+// The trace moves to <path>.1 beyond this, older ones to .2 and .3
+constexpr std::uint64_t MaxFileBytes = 16 * 1024 * 1024;
+constexpr int KeptFiles = 4;
+// Requests waiting for a response, beyond this they are given up on
+constexpr std::size_t MaxPending = 4096;
+
+// Copies value into target if it fits
+template <std::size_t Size> bool copyField(std::string_view value, char (&target)[Size]) {
+    if (value.size() >= Size) {
+        target[0] = 0;
+        return false;
+    }
+    std::memcpy(target, value.data(), value.size());
+    target[value.size()] = 0;
+    return true;
+}
+
+// Position of the quote ending the string that starts at quote, or the end of json
+std::size_t stringEnd(std::string_view json, std::size_t quote) {
+    auto i = quote + 1;
+    while (i < json.size() && json[i] != '"') {
+        i += json[i] == '\\' ? 2 : 1;
+    }
+    return std::min(i, json.size());
+}
+
+// Finds the top level "method" and "id" members of a message without parsing the rest.
+// The method is copied as written between its quotes, the id as its JSON token.
+template <std::size_t MethodSize, std::size_t IdSize>
+void scanFields(std::string_view json, char (&method)[MethodSize], char (&id)[IdSize]) {
+    auto depth = 0;
+    auto expectKey = false;
+    for (auto i = std::size_t(0); i < json.size(); ++i) {
+        auto c = json[i];
+        if (c == '"') {
+            auto end = stringEnd(json, i);
+            if (depth == 1 && expectKey) {
+                expectKey = false;
+                auto key = json.substr(i + 1, end - i - 1);
+                auto value = json.find_first_not_of(" \t\r\n:", end + 1);
+                if (value == std::string_view::npos) {
+                    return;
+                }
+                if (key == "method" && json[value] == '"') {
+                    copyField(json.substr(value + 1, stringEnd(json, value) - value - 1), method);
+                } else if (key == "id") {
+                    auto valueEnd = json[value] == '"' ? stringEnd(json, value) + 1
+                                                       : json.find_first_of(",} \t\r\n", value);
+                    copyField(json.substr(value, valueEnd - value), id);
+                }
+            }
+            i = end;
+        } else if (c == '{' || c == '[') {
+            ++depth;
+            expectKey = c == '{' && depth == 1;
+        } else if (c == '}' || c == ']') {
+            --depth;
+        } else if (c == ',' && depth == 1) {
+            expectKey = true;
+        }
+    }
+}
+
+} // namespace
+
+WireTrace &WireTrace::instance() {
+    static auto trace = WireTrace();
+    return trace;
+}
+
+std::string WireTrace::defaultPath() {
+    if (auto path = std::getenv("LSP_DEMO_TRACE_FILE"); path && *path) {
+        return path;
+    }
+    auto error = std::error_code();
+    auto dir = std::filesystem::temp_directory_path(error);
+    return ((error ? std::filesystem::path(".") : dir) / "lsp-client-demo-trace.jsonl").string();
+}
+
+WireTrace::WireTrace() : rings(RingEvents, DrainInterval) {}
+
+WireTrace::~WireTrace() { stop(); }
+
+bool WireTrace::start(const std::string &path) {
+    stop();
+    file.open(path, std::ios::out | std::ios::trunc);
+    if (!file) {
+        return false;
+    }
+    filePath = path;
+    fileBytes = 0;
+    pending.clear();
+    {
+        auto lock = std::lock_guard(latenciesMutex);
+        latencies.clear();
+    }
+    rings.start([this](const ThreadRings<Event>::Buffers &buffers) { drain(buffers); });
+    active.store(true, std::memory_order_relaxed);
+    return true;
+}
+
+void WireTrace::stop() {
+    if (!rings.isRunning()) {
+        return;
+    }
+    active.store(false, std::memory_order_relaxed);
+    rings.stop();
+    file.close();
+}
+
+bool WireTrace::isRunning() const { return rings.isRunning(); }
+
+void WireTrace::record(Direction direction, std::string_view body) {
+    auto event = Event();
+    event.time = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                     std::chrono::steady_clock::now() - origin)
+                     .count();
+    event.bytes = std::uint32_t(
+        std::min<std::size_t>(body.size(), std::numeric_limits<std::uint32_t>::max()));
+    event.direction = direction;
+    scanFields(body, event.method, event.id);
+    rings.push(std::move(event));
+}
+
+std::string WireTrace::latencyTable() const {
+    auto lock = std::lock_guard(latenciesMutex);
+    if (latencies.empty()) {
+        return "No LSP round trips traced\n";
+    }
+    char line[160];
+    std::snprintf(line, sizeof(line), "%-40s %8s %10s %10s %10s\n", "LSP method", "count", "p50",
+                  "p95", "p99");
+    auto table = std::string(line);
+    auto ms = [](std::chrono::microseconds value) { return value.count() / 1000.0; };
+    for (auto const &[method, latency] : latencies) {
+        std::snprintf(line, sizeof(line), "%-40s %8llu %7.1f ms %7.1f ms %7.1f ms\n",
+                      method.c_str(), (unsigned long long)latency.count(),
+                      ms(latency.quantile(0.5)), ms(latency.quantile(0.95)),
+                      ms(latency.quantile(0.99)));
+        table += line;
+    }
+    return table;
+}
+
+void WireTrace::drain(const ThreadRings<Event>::Buffers &buffers) {
+    events.clear();
+    auto dropped = std::uint64_t(0);
+    for (auto const &buffer : buffers) {
+        while (auto event = buffer->ring.tryPop()) {
+            events.push_back(*event);
+        }
+        dropped += buffer->dropped.exchange(0, std::memory_order_relaxed);
+    }
+    // Each ring is in order, merged they are not
+    std::stable_sort(events.begin(), events.end(),
+                     [](const Event &a, const Event &b) { return a.time < b.time; });
+    for (auto &event : events) {
+        write(event);
+    }
+    if (dropped > 0) {
+        file << "{\"dropped\":" << dropped << "}\n";
+    }
+    file.flush();
+}
+
+void WireTrace::write(Event &event) {
+    auto sent = event.direction == Direction::Sent;
+    auto method = std::string(event.method);
+    auto kind = method.empty() ? "response" : event.id[0] ? "request" : "notification";
+    auto latency = std::int64_t(-1);
+    if (event.id[0]) {
+        // Requests are keyed by the side that sent them, as both number theirs
+        if (!method.empty()) {
+            if (pending.size() >= MaxPending) {
+                pending.clear();
+            }
+            pending[(sent ? "s" : "r") + std::string(event.id)] = {method, event.time};
+        } else if (auto it = pending.find((sent ? "r" : "s") + std::string(event.id));
+                   it != pending.end()) {
+            method = std::move(it->second.method);
+            latency = event.time - it->second.time;
+            pending.erase(it);
+            auto lock = std::lock_guard(latenciesMutex);
+            latencies[method].record(std::chrono::nanoseconds(latency));
+        }
+    }
+
+    auto line = "{\"time_ns\":" + std::to_string(event.time) + ",\"dir\":\"" +
+                (sent ? "send" : "receive") + "\",\"kind\":\"" + kind +
+                "\",\"bytes\":" + std::to_string(event.bytes);
+    if (!method.empty()) {
+        line += ",\"method\":\"" + method + "\"";
+    }
+    if (event.id[0]) {
+        line += ",\"id\":" + std::string(event.id);
+    }
+    if (latency >= 0) {
+        line += ",\"latency_us\":" + std::to_string(latency / 1000);
+    }
+    line += "}\n";
+    file << line;
+    fileBytes += line.size();
+    if (fileBytes > MaxFileBytes) {
+        rotate();
+    }
+}
+
+void WireTrace::rotate() {
+    file.close();
+    auto error = std::error_code();
+    for (auto i = KeptFiles - 1; i > 0; --i) {
+        auto from = i == 1 ? filePath : filePath + "." + std::to_string(i - 1);
+        std::filesystem::rename(from, filePath + "." + std::to_string(i), error);
+    }
+    file.open(filePath, std::ios::out | std::ios::trunc);
+    fileBytes = 0;
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "LatencyHistogram.hpp"
+#include "ThreadRings.hpp"
+
+// Trace of the JSON-RPC messages crossing the LSP transport.
+//
+// Every message is recorded with a monotonic timestamp, its direction, method, id and size
+// into a lock free ring owned by the recording thread. A writer thread drains the rings,
+// appends one JSON line per message to a file that is rotated by size, and pairs requests
+// with their responses for per-method latencies. While tracing is off, the transport only
+// pays for the relaxed load in enabled().
+class WireTrace {
+  public:
+    enum class Direction : std::uint8_t { Sent, Received };
+
+    static WireTrace &instance();
+
+    static bool enabled() { return active.load(std::memory_order_relaxed); }
+
+    // $LSP_DEMO_TRACE_FILE, or lsp-client-demo-trace.jsonl in the temporary directory
+    static std::string defaultPath();
+
+    WireTrace();
+    ~WireTrace();
+    WireTrace(const WireTrace &) = delete;
+    WireTrace &operator=(const WireTrace &) = delete;
+
+    // Starts tracing into path, false if it cannot be written. Latencies start over.
+    bool start(const std::string &path);
+    // Writes out what was recorded so far and stops
+    void stop();
+    bool isRunning() const;
+
+    // body is one JSON-RPC message without its header
+    void record(Direction direction, std::string_view body);
+
+    // Count, p50, p95 and p99 of each method's round trips, one line per method
+    std::string latencyTable() const;
+
+  private:
+    struct Event {
+        std::int64_t time = 0;
+        std::uint32_t bytes = 0;
+        Direction direction = Direction::Sent;
+        // Truncated, empty for responses
+        char method[55] = {};
+        // As written in the message, a number or a quoted string, empty for notifications
+        char id[24] = {};
+    };
+    struct PendingRequest {
+        std::string method;
+        std::int64_t time = 0;
+    };
+
+    void drain(const ThreadRings<Event>::Buffers &buffers);
+    void write(Event &event);
+    void rotate();
+
+    static inline std::atomic<bool> active{false};
+
+    std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now();
+
+    ThreadRings<Event> rings;
+
+    // Used by the writer thread
+    std::vector<Event> events;
+    std::string filePath;
+    std::ofstream file;
+    std::uint64_t fileBytes = 0;
+    std::unordered_map<std::string, PendingRequest> pending;
+
+    mutable std::mutex latenciesMutex;
+    std::map<std::string, LatencyHistogram> latencies;
+};
@@ -1,14 +1,20 @@
+#include <QByteArrayView>
 #include <QDir>
 #include <QDockWidget>
 #include <QFile>
 #include <QFileDialog>
 #include <QFileInfo>
+#include <QFontDatabase>
 #include <QHBoxLayout>
 #include <QKeySequence>
 #include <QLabel>
 #include <QListWidgetItem>
+#include <QPointer>
+#include <QProcess>
 #include <QRegularExpression>
+#include <QScrollBar>
 #include <QShortcut>
+#include <QSignalBlocker>
 #include <QTextStream>
 #include <QTimer>
 #include <QToolTip>
@@ -16,16 +22,48 @@
 
 #include "AppOutputRedirector.hpp"
 #include "CodeEditor.hpp"
+#include "DocumentSync.hpp"
+#include "EditorTab.hpp"
+#include "FileText.hpp"
 #include "FilesList.hpp"
+#include "SemanticHighlighter.hpp"
+#include "SpanTrace.hpp"
 #include "mainwindow.hpp"
 
+// Awake editors beyond this are hibernated, LSP_DEMO_TAB_MEMORY_MB overrides it
+constexpr int DefaultTabMemoryMb = 64;
+// Lines kept in the output pane, LSP_DEMO_OUTPUT_LINES overrides it
+constexpr int DefaultOutputLines = 10000;
+// Diagnostics published within this of the first one are shown together
+constexpr int DiagnosticsBatchMs = 100;
+// Documents beyond this are shown without highlighting
+constexpr int MaxHighlightedChars = 8 * 1024 * 1024;
+
 template <typename Func> void runOnUiThread(Func &&func) {
-    QMetaObject::invokeMethod(qApp, std::forward<Func>(func), Qt::QueuedConnection);
+    if (!SpanTrace::enabled()) {
+        QMetaObject::invokeMethod(qApp, std::forward<Func>(func), Qt::QueuedConnection);
+        return;
+    }
+    // The wait in the event queue, then the callback
+    auto id = SpanTrace::instance().nextId();
+    SpanTrace::instance().asyncBegin("UI queue", id);
+    QMetaObject::invokeMethod(
+        qApp,
+        [id, func = std::forward<Func>(func)]() mutable {
+            SpanTrace::instance().asyncEnd("UI queue", id);
+            auto span = ScopedSpan("UI callback");
+            func();
+        },
+        Qt::QueuedConnection);
 }
 
 MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent) {
     tabWidget = new QTabWidget;
     setCentralWidget(tabWidget);
+    connect(tabWidget, &QTabWidget::currentChanged, this, &MainWindow::onCurrentTabChanged);
+
+    auto budgetMb = qEnvironmentVariableIntValue("LSP_DEMO_TAB_MEMORY_MB");
+    tabMemoryBudget = qsizetype(budgetMb > 0 ? budgetMb : DefaultTabMemoryMb) * 1024 * 1024;
 
     auto *dockWidget = new QWidget;
     auto *dockLayout = new QVBoxLayout(dockWidget);
@@ -33,6 +71,20 @@ MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent) {
     dockLayout->setContentsMargins(0, 0, 0, 0);
     dockLayout->addWidget(filesList);
     connect(filesList, &FilesList::fileSelected, this, &MainWindow::openFileInTab);
+    connect(filesList, &FilesList::filesChanged, this,
+            [this](const QStringList &created, const QStringList &changed,
+                   const QStringList &deleted) {
+                auto toPaths = [this](const QStringList &files) {
+                    auto paths = std::vector<std::string>();
+                    paths.reserve(files.size());
+                    for (auto const &file : files) {
+                        paths.push_back((projectDir + file).toStdString());
+                    }
+                    return paths;
+                };
+                lspClient.didChangeWatchedFiles(toPaths(created), toPaths(changed),
+                                                toPaths(deleted));
+            });
 
     dock = new QDockWidget(tr("Project Files"), this);
     dock->setWidget(dockWidget);
@@ -47,19 +99,21 @@ MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent) {
     clearDebugAction = toolbar->addAction(tr("Clear Debug"));
     quitAction = toolbar->addAction(tr("Quit"));
 
-    outputEdit = new QTextEdit(this);
-    outputEdit->setReadOnly(true);
-    outputEdit->setAcceptRichText(false);
+    auto outputLines = qEnvironmentVariableIntValue("LSP_DEMO_OUTPUT_LINES");
+    outputModel = new OutputModel(outputLines > 0 ? outputLines : DefaultOutputLines, this);
+    outputView = new QListView(this);
+    outputView->setModel(outputModel);
+    // Every row is one line of the same font, so only the visible ones are ever measured
+    outputView->setUniformItemSizes(true);
+    outputView->setSelectionMode(QAbstractItemView::ExtendedSelection);
+    outputView->setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
 
     outputDock = new QDockWidget(tr("Output"), this);
-    outputDock->setWidget(outputEdit);
+    outputDock->setWidget(outputView);
     addDockWidget(Qt::RightDockWidgetArea, outputDock);
 
-    /*
     outputRedirector = new AppOutputRedirector(this);
-    connect(outputRedirector, &AppOutputRedirector::newStdout, this, &MainWindow::appendStdout);
-    connect(outputRedirector, &AppOutputRedirector::newStderr, this, &MainWindow::appendStderr);
-    */
+    connect(outputRedirector, &AppOutputRedirector::linesReady, this, &MainWindow::appendOutput);
 
     connect(openDirAction, &QAction::triggered, this, &MainWindow::onOpenDirClicked);
     connect(closeDirAction, &QAction::triggered, this, &MainWindow::onCloseDirClicked);
@@ -68,13 +122,40 @@ MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent) {
     connect(showDebugAction, &QAction::toggled, this, [this](bool toggled) {
         qDebug() << "Toggle debug = " << toggled;
         this->lspClient.debugIO(toggled);
+        toggleSpanTrace(toggled);
     });
     connect(clearDebugAction, &QAction::triggered, this,
-            [this](bool toggled) { this->outputEdit->clear(); });
+            [this](bool toggled) { this->outputModel->clear(); });
 
     closeTabShortcut = new QShortcut(QKeySequence(Qt::CTRL | Qt::Key_W), this);
     connect(closeTabShortcut, &QShortcut::activated, this, &MainWindow::closeCurrentTab);
 
+    diagnosticsTimer = new QTimer(this);
+    diagnosticsTimer->setSingleShot(true);
+    diagnosticsTimer->setInterval(DiagnosticsBatchMs);
+    connect(diagnosticsTimer, &QTimer::timeout, this, &MainWindow::applyDiagnostics);
+    // Called on the reader thread, once until the diagnostics are taken
+    lspClient.onDiagnostics([this] {
+        QMetaObject::invokeMethod(diagnosticsTimer, qOverload<>(&QTimer::start),
+                                  Qt::QueuedConnection);
+    });
+
+    // LSP_DEMO_SERVER="/path/to/lsp_replay --fast session.jsonl" serves a session recorded
+    // with LSP_DEMO_RECORD=session.jsonl instead of clangd
+    if (auto server = qEnvironmentVariable("LSP_DEMO_SERVER"); !server.isEmpty()) {
+        auto command = std::vector<std::string>();
+        for (auto const &part : QProcess::splitCommand(server)) {
+            command.push_back(part.toStdString());
+        }
+        lspClient.setServerCommand(std::move(command));
+    }
+    if (auto recording = qEnvironmentVariable("LSP_DEMO_RECORD"); !recording.isEmpty()) {
+        lspClient.setSessionRecording(recording.toStdString());
+    }
+    // LSP_DEMO_SPANS_FILE=spans.json traces from the start on, the first scan included
+    if (qEnvironmentVariableIsSet("LSP_DEMO_SPANS_FILE")) {
+        toggleSpanTrace(true);
+    }
     lspClient.startClangd();
     openDirectory();
 }
@@ -91,13 +172,15 @@ void MainWindow::openDirectory() {
 }
 
 void MainWindow::closeDirectory() {
-    tabWidget->clear();
+    closeAllTabs();
+    diagnostics.clear();
     projectDir.clear();
     dock->setWindowTitle(tr("Project Files"));
 }
 
 void MainWindow::loadFiles(const QString &dirPath) {
-    tabWidget->clear();
+    closeAllTabs();
+    diagnostics.clear();
     filesList->setDir(dirPath);
 }
 
@@ -125,80 +208,196 @@ void MainWindow::openFileInTab(const QString &relPath) {
     if (projectDir.isEmpty()) {
         return;
     }
-    QFile file(QDir(projectDir).filePath(relPath));
-    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+    auto span = ScopedSpan("MainWindow::openFileInTab");
+    auto filePath = projectDir + relPath;
+    for (auto i = 0; i < tabWidget->count(); ++i) {
+        auto tab = static_cast<EditorTab *>(tabWidget->widget(i));
+        if (tab->filePath() == filePath) {
+            tabWidget->setCurrentIndex(i);
+            return;
+        }
+    }
+
+    auto bytes = readFileText(filePath);
+    if (!bytes) {
         return;
     }
-    QTextStream in(&file);
-    auto text = in.readAll();
-    auto editor = new CodeEditor;
-    auto path = (projectDir + relPath).toStdString();
+    // The server gets the file's bytes as they are and can start parsing while the editor
+    // is still filling up, the editor keeps the decoded text
+    auto view = QByteArrayView(bytes->data(), qsizetype(bytes->size()));
+    auto text = QString::fromUtf8(view);
+    auto validUtf8 = view.isValidUtf8();
+    lspClient.openDocument(filePath.toStdString(),
+                           validUtf8 ? std::move(*bytes) : text.toStdString());
+
+    auto tab = new EditorTab(filePath);
+    connect(tab, &EditorTab::editorCreated, this,
+            [this, tab](CodeEditor *editor) { setupEditor(tab, editor, true); });
+    connect(tab, &EditorTab::loaded, this,
+            [this, tab](CodeEditor *editor) { setupEditor(tab, editor, false); });
+    connect(tab, &EditorTab::aboutToHibernate, this, [this, tab](CodeEditor *) {
+        lspClient.closeDocument(tab->filePath().toStdString());
+    });
+    tab->load(std::move(text));
+
+    auto tabIdx = tabWidget->addTab(tab, relPath);
+    tabWidget->setCurrentIndex(tabIdx);
+}
+
+// Wires a new editor to the server, for a new tab and for one that wakes up from hibernation.
+// A woken editor's document is opened on the server here, a new tab's was opened from the
+// file already.
+void MainWindow::setupEditor(EditorTab *tab, CodeEditor *editor, bool openDocument) {
+    auto path = tab->filePath().toStdString();
+
+    auto sync = new DocumentSync(editor->document(), editor);
+    connect(sync, &DocumentSync::edited, editor,
+            [path, this, sync](const QList<DocumentSync::Edit> &edits) {
+                if (!lspClient.incrementalSync()) {
+                    lspClient.changeDocument(path, sync->currentText().toStdString());
+                    return;
+                }
+                auto changes = std::vector<DocumentEdit>();
+                changes.reserve(edits.size());
+                for (auto const &edit : edits) {
+                    changes.push_back({edit.startLine, edit.startColumn, edit.endLine,
+                                       edit.endColumn, edit.text.toStdString()});
+                }
+                lspClient.changeDocument(path, changes);
+            });
+    connect(sync, &DocumentSync::replaced, editor, [path, this](const QString &text) {
+        lspClient.changeDocument(path, text.toStdString());
+    });
 
-    editor->setPlainText(text);
-    editor->setReadOnly(false);
     connect(
         editor, &CodeEditor::hoveredWordTooltip, editor,
-        [path, this, editor](const QString &word, int line, int column, const QPoint &globalPos) {
-            Q_UNUSED(globalPos);
-            lspClient.hover(
-                path, line, column, [line, column, word, this, globalPos, editor](auto result) {
-                    runOnUiThread([=]() {
-                        if (result.isNull()) {
-                            QToolTip::hideText();
-                            return;
-                        }
-                        auto tooltip = QString("OK - Line=%1, column=%2, word=%3")
-                                           .arg(line)
-                                           .arg(column)
-                                           .arg(word);
-                        auto &contents = result->contents;
-                        std::visit(
-                            [&](const auto &value) {
-                                using T = std::decay_t<decltype(value)>;
-
-                                if constexpr (std::is_same_v<T, lsp::MarkupContent>) {
-                                    tooltip = QString::fromStdString(value.value);
-                                } else if constexpr (std::is_same_v<T, std::string>) {
-                                    tooltip = QString::fromStdString(value);
-                                } else if constexpr (std::is_same_v<
-                                                         T, lsp::MarkedString_Language_Value>) {
-                                    tooltip = QString("[%1] %2").arg(
-                                        QString::fromStdString(value.language),
-                                        QString::fromStdString(value.value));
-                                } else if constexpr (std::is_same_v<
-                                                         T, std::vector<lsp::MarkedString>>) {
-                                    QStringList parts;
-                                    for (const auto &item : value) {
-                                        std::visit(
-                                            [&](const auto &inner) {
-                                                using InnerT = std::decay_t<decltype(inner)>;
-                                                if constexpr (std::is_same_v<InnerT, std::string>) {
-                                                    parts << QString::fromStdString(inner);
-                                                } else if constexpr (
-                                                    std::is_same_v<
-                                                        InnerT, lsp::MarkedString_Language_Value>) {
-                                                    parts << QString("[%1] %2").arg(
-                                                        QString::fromStdString(inner.language),
-                                                        QString::fromStdString(inner.value));
-                                                }
-                                            },
-                                            item);
-                                    }
-                                    tooltip = parts.join("\n");
-                                }
-                            },
-                            contents);
-
-                        QToolTip::showText(globalPos, tooltip, editor, {}, 5000);
-                    });
+        [path, this, editor, sync](const QString &word, int line, int column,
+                                   const QPoint &globalPos) {
+            if (word.isEmpty()) {
+                lspClient.cancelHover(path);
+                QToolTip::hideText();
+                return;
+            }
+            // The server has to see what is under the mouse
+            sync->flush();
+            // The editor may be hibernated or closed before the answer arrives
+            auto target = QPointer<CodeEditor>(editor);
+            lspClient.hover(path, line, column, [globalPos, target](auto tooltip) {
+                runOnUiThread([=]() {
+                    if (!target) {
+                        return;
+                    }
+                    if (tooltip.empty()) {
+                        QToolTip::hideText();
+                        return;
+                    }
+                    QToolTip::showText(globalPos, QString::fromStdString(tooltip), target, {},
+                                       5000);
                 });
+            });
         });
 
-    auto tabIdx = tabWidget->addTab(editor, relPath);
-    tabWidget->setCurrentIndex(tabIdx);
+    editor->setDiagnostics(diagnostics.find(path));
+    if (openDocument) {
+        lspClient.openDocument(path, sync->currentText().toStdString());
+    }
+    // Lexing and colouring all of a huge generated file would freeze the window
+    if (editor->document()->characterCount() > MaxHighlightedChars) {
+        return;
+    }
 
-    auto contents = text.toStdString();
-    lspClient.openDocument(path, contents);
+    auto highlighter = new SemanticHighlighter(editor->document());
+    connect(highlighter, &SemanticHighlighter::tokensWanted, editor,
+            [path, this, sync, highlighter] {
+                // Tokens are for the text the server has, it has to be the shown one
+                sync->flush();
+                auto target = QPointer<SemanticHighlighter>(highlighter);
+                lspClient.semanticTokens(
+                    path, highlighter->beginRequest(), [this, target](auto update) {
+                        runOnUiThread([this, target, update = std::move(update)]() mutable {
+                            if (!target) {
+                                return;
+                            }
+                            // The first tokens may have waited for the server to initialize
+                            if (!target->hasLegend()) {
+                                target->setLegend(lspClient.semanticTokensLegend());
+                            }
+                            target->applyTokens(std::move(update));
+                        });
+                    });
+            });
+
+    highlighter->scheduleRequest();
+}
+
+void MainWindow::applyDiagnostics() {
+    auto published = lspClient.takeDiagnostics();
+    if (published.empty()) {
+        return;
+    }
+    auto editors = QHash<QString, CodeEditor *>();
+    for (auto i = 0; i < tabWidget->count(); ++i) {
+        auto tab = static_cast<EditorTab *>(tabWidget->widget(i));
+        if (tab->editor()) {
+            editors.insert(tab->filePath(), tab->editor());
+        }
+    }
+    for (auto &item : published) {
+        if (!diagnostics.publish(item.fileName, std::move(item.diagnostics))) {
+            continue;
+        }
+        if (auto editor = editors.value(QString::fromStdString(item.fileName))) {
+            editor->setDiagnostics(diagnostics.find(item.fileName));
+        }
+    }
+}
+
+void MainWindow::onCurrentTabChanged(int index) {
+    auto tab = static_cast<EditorTab *>(tabWidget->widget(index));
+    if (!tab) {
+        return;
+    }
+    tab->wake();
+    recentTabs.removeOne(tab);
+    recentTabs.prepend(tab);
+    hibernateIdleTabs();
+}
+
+void MainWindow::hibernateIdleTabs() {
+    auto used = qsizetype(0);
+    for (auto tab : std::as_const(recentTabs)) {
+        used += tab->memoryEstimate();
+    }
+    // The current tab always stays awake
+    for (auto i = recentTabs.size() - 1; i > 0 && used > tabMemoryBudget; --i) {
+        auto tab = recentTabs[i];
+        if (tab->isHibernated()) {
+            continue;
+        }
+        used -= tab->memoryEstimate();
+        tab->hibernate();
+    }
+}
+
+void MainWindow::closeTab(int index) {
+    auto tab = static_cast<EditorTab *>(tabWidget->widget(index));
+    if (!tab) {
+        return;
+    }
+    if (!tab->isHibernated()) {
+        lspClient.closeDocument(tab->filePath().toStdString());
+    }
+    recentTabs.removeOne(tab);
+    tabWidget->removeTab(index);
+    tab->deleteLater();
+}
+
+void MainWindow::closeAllTabs() {
+    // Otherwise every tab that becomes current on the way would wake up
+    auto blocker = QSignalBlocker(tabWidget);
+    while (tabWidget->count() > 0) {
+        closeTab(tabWidget->count() - 1);
+    }
 }
 
 void MainWindow::onOpenDirClicked() { openDirectory(); }
@@ -212,22 +411,32 @@ void MainWindow::onCloseTabClicked() { closeCurrentTab(); }
 void MainWindow::closeCurrentTab() {
     auto idx = tabWidget->currentIndex();
     if (idx != -1) {
-        tabWidget->removeTab(idx);
+        closeTab(idx);
     }
 }
 
-void MainWindow::appendStdout(const QString &text) {
-    outputEdit->moveCursor(QTextCursor::End);
-    auto html = QString("<span style=\"color:blue;\">") +
-                text.toHtmlEscaped().replace("\n", "<br/>") + "</span>";
-    outputEdit->insertHtml(html);
-    outputEdit->moveCursor(QTextCursor::End);
+void MainWindow::appendOutput(const QList<OutputLine> &lines) {
+    // Follows the output only while scrolled to the end
+    auto scrollBar = outputView->verticalScrollBar();
+    auto atEnd = scrollBar->value() == scrollBar->maximum();
+    outputModel->append(lines);
+    if (atEnd) {
+        outputView->scrollToBottom();
+    }
 }
 
-void MainWindow::appendStderr(const QString &text) {
-    outputEdit->moveCursor(QTextCursor::End);
-    auto html = QString("<span style=\"color:red;\">") +
-                text.toHtmlEscaped().replace("\n", "<br/>") + "</span>";
-    outputEdit->insertHtml(html);
-    outputEdit->moveCursor(QTextCursor::End);
+// The trace opens in https://ui.perfetto.dev or chrome://tracing
+void MainWindow::toggleSpanTrace(bool enable) {
+    auto &trace = SpanTrace::instance();
+    auto path = QString::fromStdString(SpanTrace::defaultPath());
+    if (enable && !trace.isRunning()) {
+        if (trace.start(path.toStdString())) {
+            qDebug() << "Tracing spans to" << path;
+        } else {
+            qDebug() << "Cannot write spans to" << path;
+        }
+    } else if (!enable && trace.isRunning()) {
+        trace.stop();
+        qDebug() << "Spans written to" << path;
+    }
 }
@@ -10,12 +10,18 @@
 #include <QLineEdit>
 #include <QStringList>
 #include <QVBoxLayout>
-#include <QTextEdit>
+#include <QListView>
 
+#include "DiagnosticStore.hpp"
+#include "OutputModel.hpp"
 #include "LspClientImpl.hpp"
 
 class AppOutputRedirector;
+class CodeEditor;
+class EditorTab;
 class FilesList;
+class OutputModel;
+class QTimer;
 
 class MainWindow : public QMainWindow {
     Q_OBJECT
@@ -35,24 +41,39 @@ private:
     QDockWidget* dock;
     QString projectDir;
     QDockWidget* outputDock;
-    QTextEdit* outputEdit;
+    QListView* outputView;
+    OutputModel* outputModel;
 
     FilesList* filesList = nullptr;
     AppOutputRedirector* outputRedirector = nullptr;
     LspClientImpl lspClient;
+    DiagnosticStore diagnostics;
+    // Collects the publishes of a burst into one update of the editors
+    QTimer* diagnosticsTimer;
+
+    // Awake tabs beyond this estimated size are hibernated, least recently used first
+    qsizetype tabMemoryBudget;
+    // Most recently activated first
+    QList<EditorTab*> recentTabs;
 
     void openDirectory();
     void loadFiles(const QString& dirPath);
     void addFilesRecursive(const QString& baseDir, const QString& currentDir, QStringList& files);
     void openFileInTab(const QString& relPath);
+    void setupEditor(EditorTab* tab, CodeEditor* editor, bool openDocument);
+    void hibernateIdleTabs();
+    void applyDiagnostics();
+    void closeTab(int index);
+    void closeAllTabs();
     void closeDirectory();
     void closeCurrentTab();
-    void appendStdout(const QString& text);
-    void appendStderr(const QString& text);
+    void appendOutput(const QList<OutputLine>& lines);
+    void toggleSpanTrace(bool enable);
 
 private slots:
     void onOpenDirClicked();
     void onCloseDirClicked();
     void onQuitClicked();
     void onCloseTabClicked();
+    void onCurrentTabChanged(int index);
 };
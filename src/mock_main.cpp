@@ -0,0 +1,55 @@
+#include <QCommandLineParser>
+#include <QCoreApplication>
+
+#include <algorithm>
+
+#include <unistd.h>
+
+#include "MockServer.hpp"
+
+// Answers the client with synthetic data in place of clangd, see MockServer
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("lsp_mock");
+
+    auto parser = QCommandLineParser();
+    parser.setApplicationDescription("Language server with synthetic load for stress tests");
+    parser.addHelpOption();
+    auto responseOption = QCommandLineOption(
+        "response-bytes", "Size of hover and semantic tokens results.", "bytes", "256");
+    auto latencyOption =
+        QCommandLineOption("latency-ms", "Mean delay of an answer.", "ms", "0");
+    auto distributionOption = QCommandLineOption(
+        "latency", "Distribution of the delays: fixed, uniform or exponential.", "kind", "fixed");
+    auto rateOption = QCommandLineOption(
+        "notifications-per-second", "Diagnostics published per second.", "rate", "0");
+    auto diagnosticsOption = QCommandLineOption(
+        "diagnostics", "Diagnostics in each publish.", "count", "10");
+    auto errorOption = QCommandLineOption(
+        "error-rate", "Share of requests that fail, 0 to 1.", "rate", "0");
+    auto seedOption = QCommandLineOption("seed", "Seed of the delays and errors.", "n", "1");
+    parser.addOptions({responseOption, latencyOption, distributionOption, rateOption,
+                       diagnosticsOption, errorOption, seedOption});
+    parser.process(app);
+
+    auto options = MockServer::Options();
+    options.responseBytes = std::max(parser.value(responseOption).toLongLong(), 0LL);
+    options.latencyMs = parser.value(latencyOption).toDouble();
+    options.notificationsPerSecond = parser.value(rateOption).toDouble();
+    options.diagnosticsPerNotification = std::max(parser.value(diagnosticsOption).toInt(), 0);
+    options.errorRate = parser.value(errorOption).toDouble();
+    options.seed = parser.value(seedOption).toUInt();
+    auto distribution = parser.value(distributionOption);
+    if (distribution == "uniform") {
+        options.latency = MockServer::Latency::Uniform;
+    } else if (distribution == "exponential") {
+        options.latency = MockServer::Latency::Exponential;
+    } else if (distribution != "fixed") {
+        parser.showHelp(1);
+    }
+
+    auto server = MockServer(options);
+    // The client connects stdin and stdout to the same socket
+    server.serve(STDIN_FILENO);
+    return app.exec();
+}
@@ -0,0 +1,52 @@
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QSocketNotifier>
+
+#include <csignal>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "MessageStream.hpp"
+#include "MuxDaemon.hpp"
+
+namespace {
+
+int signalFds[2] = {-1, -1};
+
+void onSignal(int) {
+    char byte = 1;
+    [[maybe_unused]] auto written = ::write(signalFds[0], &byte, 1);
+}
+
+} // namespace
+
+// Shares clangd between instances of the demo, see MuxDaemon
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("clangd_mux");
+
+    auto parser = QCommandLineParser();
+    parser.setApplicationDescription("Shares one clangd per workspace between LSP clients");
+    parser.addHelpOption();
+    auto clangdOption =
+        QCommandLineOption("clangd", "clangd executable.", "path", "/usr/bin/clangd");
+    auto socketOption = QCommandLineOption("socket", "Unix socket to listen on.", "path",
+                                           QString::fromStdString(muxSocketPath()));
+    parser.addOption(clangdOption);
+    parser.addOption(socketOption);
+    parser.process(app);
+
+    auto daemon = MuxDaemon(parser.value(clangdOption), parser.value(socketOption));
+    if (!daemon.listen()) {
+        return 1;
+    }
+
+    // Quit through the event loop, so the servers get to shut down and the socket is removed
+    ::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, signalFds);
+    std::signal(SIGINT, onSignal);
+    std::signal(SIGTERM, onSignal);
+    auto signalNotifier = QSocketNotifier(signalFds[1], QSocketNotifier::Read);
+    QObject::connect(&signalNotifier, &QSocketNotifier::activated, &app, &QCoreApplication::quit);
+
+    return app.exec();
+}
@@ -0,0 +1,32 @@
+#include <QCommandLineParser>
+#include <QCoreApplication>
+
+#include <unistd.h>
+
+#include "ReplayServer.hpp"
+
+// Serves a recorded LSP session in place of clangd, see ReplayServer
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("lsp_replay");
+
+    auto parser = QCommandLineParser();
+    parser.setApplicationDescription("Replays a recorded LSP session as a language server");
+    parser.addHelpOption();
+    auto fastOption =
+        QCommandLineOption("fast", "Answer at once instead of after the recorded delays.");
+    parser.addOption(fastOption);
+    parser.addPositionalArgument("session", "Session saved with LSP_DEMO_RECORD.");
+    parser.process(app);
+    if (parser.positionalArguments().size() != 1) {
+        parser.showHelp(1);
+    }
+
+    auto server = ReplayServer(!parser.isSet(fastOption));
+    if (!server.load(parser.positionalArguments().constFirst())) {
+        return 1;
+    }
+    // The client connects stdin and stdout to the same socket
+    server.serve(STDIN_FILENO);
+    return app.exec();
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstdio>
+#include <source_location>
+
+// The unit tests are plain executables run by ctest: every failed check is printed and makes
+// the test exit with 1.
+namespace test {
+
+inline int failures = 0;
+
+inline void check(bool condition, const char *what,
+                  std::source_location where = std::source_location::current()) {
+    if (!condition) {
+        ++failures;
+        std::fprintf(stderr, "%s:%u: check failed: %s\n", where.file_name(), where.line(), what);
+    }
+}
+
+// The exit code of the test
+inline int result() {
+    if (failures > 0) {
+        std::fprintf(stderr, "%d checks failed\n", failures);
+    }
+    return failures == 0 ? 0 : 1;
+}
+
+} // namespace test
@@ -0,0 +1,70 @@
+#include "Check.hpp"
+#include "DiagnosticStore.hpp"
+
+using test::check;
+
+namespace {
+
+Diagnostic diagnostic(int startLine, int endLine, const char *message,
+                      Diagnostic::Severity severity = Diagnostic::Severity::Error) {
+    return {startLine, 0, endLine, 1, severity, message};
+}
+
+std::string messages(const std::vector<const Diagnostic *> &found) {
+    auto text = std::string();
+    for (auto const *item : found) {
+        text += item->message;
+    }
+    return text;
+}
+
+void findsDiagnosticsTouchingLines() {
+    // A long one from line 1 to 20 is found past the short ones that start after it
+    auto document = DocumentDiagnostics(
+        1, {diagnostic(10, 10, "c"), diagnostic(1, 20, "a"), diagnostic(5, 6, "b"),
+            diagnostic(30, 31, "d", Diagnostic::Severity::Warning)});
+    check(document.size() == 4, "four diagnostics");
+    check(messages(document.inLines(0, 100)) == "abcd", "all, ordered by start");
+    check(messages(document.inLines(15, 15)) == "a", "a long diagnostic reaches its end");
+    check(messages(document.inLines(6, 10)) == "abc", "both ends of the range count");
+    check(messages(document.inLines(7, 9)) == "a", "one ending before is left out");
+    check(messages(document.inLines(31, 40)) == "d", "the last line of the last one");
+    check(document.inLines(21, 29).empty(), "nothing between them");
+    check(document.count(Diagnostic::Severity::Error) == 3, "three errors");
+    check(document.count(Diagnostic::Severity::Warning) == 1, "one warning");
+}
+
+void keepsTheLatestVersion() {
+    auto store = DiagnosticStore();
+    auto second = std::make_shared<const DocumentDiagnostics>(
+        2, std::vector<Diagnostic>{diagnostic(0, 0, "new")});
+    auto first = std::make_shared<const DocumentDiagnostics>(
+        1, std::vector<Diagnostic>{diagnostic(0, 0, "old")});
+    check(store.publish("a.cpp", second), "the first publish is kept");
+    check(!store.publish("a.cpp", first), "an older version is refused");
+    check(store.find("a.cpp") == second, "the newer version stays");
+    auto unversioned = std::make_shared<const DocumentDiagnostics>(
+        std::nullopt, std::vector<Diagnostic>{diagnostic(0, 0, "any")});
+    check(store.publish("a.cpp", unversioned), "diagnostics without a version are kept");
+    check(!store.find("b.cpp"), "another document has none");
+}
+
+void emptyDiagnosticsRemoveTheDocument() {
+    auto store = DiagnosticStore();
+    store.publish("a.cpp", std::make_shared<const DocumentDiagnostics>(
+                               1, std::vector<Diagnostic>{diagnostic(0, 0, "error")}));
+    check(store.documents() == 1, "one document");
+    check(store.publish("a.cpp", std::make_shared<const DocumentDiagnostics>(
+                                     2, std::vector<Diagnostic>())),
+          "the empty publish is taken");
+    check(!store.find("a.cpp") && store.documents() == 0, "the document is gone");
+}
+
+} // namespace
+
+int main() {
+    findsDiagnosticsTouchingLines();
+    keepsTheLatestVersion();
+    emptyDiagnosticsRemoveTheDocument();
+    return test::result();
+}
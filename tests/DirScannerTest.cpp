@@ -0,0 +1,83 @@
+#include "Check.hpp"
+#include "DirScanner.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+using test::check;
+
+namespace {
+
+namespace fs = std::filesystem;
+
+void touch(const fs::path &path) { std::ofstream(path) << "x"; }
+
+std::vector<std::string> scan(const fs::path &root, DirScanner::Options options = {}) {
+    auto mutex = std::mutex();
+    auto files = std::vector<std::string>();
+    DirScanner(options).scan(root.string(), [&](std::vector<std::string> &&batch) {
+        auto lock = std::lock_guard(mutex);
+        files.insert(files.end(), batch.begin(), batch.end());
+    });
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+bool contains(const std::vector<std::string> &files, const std::string &file) {
+    return std::find(files.begin(), files.end(), file) != files.end();
+}
+
+void listsTree(const fs::path &root) {
+    auto files = scan(root);
+    check(contains(files, "a.cpp"), "a file in the root");
+    check(contains(files, "sub/b.cpp"), "a file in a sub directory");
+    check(!contains(files, ".hidden"), "hidden files are skipped");
+}
+
+// Symlinks to files are listed, symlinks to directories are not walked into
+void symlinkPolicy(const fs::path &root) {
+    auto files = scan(root);
+    check(contains(files, "file-link.cpp"), "a symlink to a file is listed");
+    check(!contains(files, "dir-link/b.cpp"), "a symlink to a directory is not followed");
+    check(!contains(files, "dangling-link"), "a dangling symlink is skipped");
+}
+
+void respectsIgnoreFiles(const fs::path &root) {
+    std::ofstream(root / ".gitignore") << "*.o\nbuild/\n";
+    auto options = DirScanner::Options();
+    options.respectIgnoreFiles = true;
+    auto files = scan(root, options);
+    check(contains(files, "a.cpp"), "files that are not ignored stay");
+    check(!contains(files, "a.o"), "ignored files are skipped");
+    check(!contains(files, "build/out.cpp"), "ignored directories are pruned");
+    fs::remove(root / ".gitignore");
+}
+
+} // namespace
+
+int main() {
+    auto root = fs::temp_directory_path() / ("DirScannerTest-" + std::to_string(::getpid()));
+    fs::create_directories(root / "sub");
+    fs::create_directories(root / "build");
+    touch(root / "a.cpp");
+    touch(root / "a.o");
+    touch(root / ".hidden");
+    touch(root / "sub" / "b.cpp");
+    touch(root / "build" / "out.cpp");
+    fs::create_symlink(root / "a.cpp", root / "file-link.cpp");
+    fs::create_directory_symlink(root / "sub", root / "dir-link");
+    fs::create_symlink(root / "missing", root / "dangling-link");
+
+    listsTree(root);
+    symlinkPolicy(root);
+    respectsIgnoreFiles(root);
+
+    fs::remove_all(root);
+    return test::result();
+}
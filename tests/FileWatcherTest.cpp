@@ -0,0 +1,116 @@
+#include "Check.hpp"
+#include "FileWatcher.hpp"
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QEventLoop>
+#include <QFile>
+#include <QTemporaryDir>
+#include <QTimer>
+
+using test::check;
+
+namespace {
+
+constexpr int ReportTimeoutMs = 3000;
+// Events of one change may be split over two windows
+constexpr int SettleMs = 300;
+
+struct Report {
+    QStringList added;
+    QStringList modified;
+    QStringList removed;
+    QStringList removedDirs;
+    QStringList listed;
+};
+
+// Collects what the watcher reports until nothing more arrives for a while
+class Recorder {
+  public:
+    explicit Recorder(FileWatcher &watcher) {
+        QObject::connect(&watcher, &FileWatcher::filesChanged,
+                         [this](const QStringList &added, const QStringList &modified,
+                                const QStringList &removed, const QStringList &removedDirs,
+                                const QStringList &listed) {
+                             report.added << added;
+                             report.modified << modified;
+                             report.removed << removed;
+                             report.removedDirs << removedDirs;
+                             report.listed << listed;
+                             loop.quit();
+                         });
+    }
+
+    Report wait() {
+        report = {};
+        auto timeout = QTimer();
+        timeout.setSingleShot(true);
+        QObject::connect(&timeout, &QTimer::timeout, &loop, &QEventLoop::quit);
+        timeout.start(ReportTimeoutMs);
+        loop.exec();
+        timeout.start(SettleMs);
+        loop.exec();
+        return report;
+    }
+
+  private:
+    QEventLoop loop;
+    Report report;
+};
+
+void writeFile(const QString &path, const QByteArray &content) {
+    QFile file(path);
+    file.open(QIODevice::WriteOnly | QIODevice::Append);
+    file.write(content);
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    QTemporaryDir root;
+    auto dir = QDir(root.path());
+    dir.mkdir("a");
+    writeFile(dir.filePath("a/old.txt"), "old");
+
+    auto watcher = FileWatcher();
+    auto recorder = Recorder(watcher);
+    watcher.setRootDir(root.path());
+    watcher.start();
+
+    // An mtime from before old.txt was created, as if the scan had missed it
+    watcher.watchDirectories({{"", 0}, {"a/", 0}});
+    auto report = recorder.wait();
+    check(report.listed.contains("a/old.txt"), "a directory changed since its scan is listed");
+
+    writeFile(dir.filePath("a/new.txt"), "new");
+    report = recorder.wait();
+    check(report.added == QStringList{"a/new.txt"}, "a created file is added");
+
+    writeFile(dir.filePath("a/old.txt"), " more");
+    report = recorder.wait();
+    check(report.modified == QStringList{"a/old.txt"}, "a written file is modified");
+
+    QFile::remove(dir.filePath("a/new.txt"));
+    report = recorder.wait();
+    check(report.removed == QStringList{"a/new.txt"}, "a deleted file is removed");
+
+    dir.mkdir("b");
+    writeFile(dir.filePath("b/inside.txt"), "inside");
+    report = recorder.wait();
+    check(report.listed.contains("b/inside.txt") || report.added.contains("b/inside.txt"),
+          "a file in a new directory is found");
+
+    QDir(dir.filePath("b")).removeRecursively();
+    report = recorder.wait();
+    check(report.removedDirs.contains("b/"), "a deleted directory is removed");
+
+    writeFile(dir.filePath("a/short.txt"), "short");
+    QFile::remove(dir.filePath("a/short.txt"));
+    writeFile(dir.filePath("a/other.txt"), "other");
+    report = recorder.wait();
+    check(!report.added.contains("a/short.txt") && !report.removed.contains("a/short.txt"),
+          "a file created and deleted within one window is not reported");
+    check(report.added.contains("a/other.txt"), "the other file of the window is added");
+    return test::result();
+}
@@ -0,0 +1,79 @@
+#include "Check.hpp"
+#include "HoverCache.hpp"
+
+using test::check;
+
+namespace {
+
+// The editor sends the start of the hovered word, the server's range ends after the word
+void rehoveringAWordHits() {
+    auto cache = HoverCache();
+    cache.insert("a.cpp", 1, {3, 4, 3, 9}, "int value");
+    cache.insert("a.cpp", 1, {5, 0, 5, 6}, "void other()");
+    check(cache.find("a.cpp", 1, 3, 4) == "int value", "hover at the start of the word");
+    check(cache.find("a.cpp", 1, 5, 0) == "void other()", "hover of another word");
+    check(cache.find("a.cpp", 1, 3, 4) == "int value", "hover of the first word again");
+    check(!cache.find("a.cpp", 1, 3, 9), "the end of the range is outside");
+    check(!cache.find("a.cpp", 2, 3, 4), "another version misses");
+    check(cache.stats().hits == 3, "three hits counted");
+}
+
+void newerVersionReplacesOlder() {
+    auto cache = HoverCache();
+    cache.insert("a.cpp", 1, {0, 0, 0, 5}, "old");
+    cache.insert("a.cpp", 2, {1, 0, 1, 5}, "new");
+    check(!cache.find("a.cpp", 1, 0, 0), "the old version is evicted");
+    check(cache.find("a.cpp", 2, 1, 0) == "new", "the new version is cached");
+    check(cache.stats().entries == 1, "one entry left");
+}
+
+// A late answer for an old version must not wipe the current version's entries
+void lateAnswerIsDropped() {
+    auto cache = HoverCache();
+    cache.insert("a.cpp", 3, {0, 0, 0, 5}, "current");
+    cache.insert("a.cpp", 2, {1, 0, 1, 5}, "late");
+    check(cache.find("a.cpp", 3, 0, 0) == "current", "the current version is kept");
+    check(!cache.find("a.cpp", 2, 1, 0), "the late answer is not cached");
+}
+
+void sameSymbolIsReplaced() {
+    auto cache = HoverCache();
+    cache.insert("a.cpp", 1, {0, 0, 0, 5}, "first");
+    cache.insert("a.cpp", 1, {0, 0, 0, 5}, "second");
+    check(cache.find("a.cpp", 1, 0, 2) == "second", "the newer text wins");
+    check(cache.stats().entries == 1, "one entry per symbol");
+}
+
+void invalidateDropsDocument() {
+    auto cache = HoverCache();
+    cache.insert("a.cpp", 1, {0, 0, 0, 5}, "a");
+    cache.insert("b.cpp", 1, {0, 0, 0, 5}, "b");
+    cache.invalidate("a.cpp");
+    check(!cache.find("a.cpp", 1, 0, 0), "the invalidated document misses");
+    check(cache.find("b.cpp", 1, 0, 0) == "b", "other documents stay");
+}
+
+void evictsLeastRecentlyUsed() {
+    // Room for about two entries
+    auto cache = HoverCache(2 * (sizeof(std::string) * 2 + 200));
+    auto text = std::string(100, 'x');
+    cache.insert("a.cpp", 1, {0, 0, 0, 5}, text);
+    cache.insert("b.cpp", 1, {0, 0, 0, 5}, text);
+    check(cache.find("a.cpp", 1, 0, 0).has_value(), "a is used, b becomes the oldest");
+    cache.insert("c.cpp", 1, {0, 0, 0, 5}, text);
+    check(cache.find("a.cpp", 1, 0, 0).has_value(), "the recently used entry stays");
+    check(!cache.find("b.cpp", 1, 0, 0), "the least recently used entry is evicted");
+    check(cache.stats().evictions >= 1, "the eviction is counted");
+}
+
+} // namespace
+
+int main() {
+    rehoveringAWordHits();
+    newerVersionReplacesOlder();
+    lateAnswerIsDropped();
+    sameSymbolIsReplaced();
+    invalidateDropsDocument();
+    evictsLeastRecentlyUsed();
+    return test::result();
+}
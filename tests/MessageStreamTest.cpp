@@ -0,0 +1,132 @@
+#include "Check.hpp"
+#include "MessageStream.hpp"
+
+#include <string_view>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+using test::check;
+
+namespace {
+
+// A stream on one end of a socket pair, the test writes the raw bytes to the other end
+struct Connection {
+    Connection() {
+        int fds[2] = {-1, -1};
+        ::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds);
+        stream = std::make_unique<MessageStream>(fds[0]);
+        peer = fds[1];
+    }
+    ~Connection() {
+        if (peer != -1) {
+            ::close(peer);
+        }
+    }
+
+    void send(std::string_view bytes) { ::send(peer, bytes.data(), bytes.size(), MSG_NOSIGNAL); }
+
+    std::unique_ptr<MessageStream> stream;
+    int peer = -1;
+};
+
+std::string framed(std::string_view body) {
+    return "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n" + std::string(body);
+}
+
+void waitsForTheWholeMessage() {
+    auto connection = Connection();
+    auto &stream = *connection.stream;
+    connection.send("Content-Len");
+    check(stream.fill() && !stream.takeMessageBody(), "half a header is no message");
+    connection.send("gth: 7\r\n\r");
+    check(stream.fill() && !stream.takeMessageBody(), "nor is a header without its end");
+    connection.send("\n{\"a\":");
+    check(stream.fill() && !stream.takeMessageBody(), "nor is half a body");
+    connection.send("1}");
+    check(stream.fill(), "still connected");
+    check(stream.takeMessageBody() == "{\"a\":1}", "the body once it is complete");
+    check(!stream.takeMessageBody(), "only once");
+}
+
+void splitsMessagesOfOneRead() {
+    auto connection = Connection();
+    auto &stream = *connection.stream;
+    connection.send(framed("{}") + framed("[1,2]") + "Content-Length: 3\r\n\r\nnu");
+    stream.fill();
+    check(stream.takeMessageBody() == "{}", "the first message");
+    check(stream.takeMessageBody() == "[1,2]", "the second message");
+    check(!stream.takeMessageBody(), "the third is not complete");
+    connection.send("l");
+    stream.fill();
+    check(stream.takeMessageBody() == "nul", "the third once it is");
+}
+
+void readsHeadersInAnyCase() {
+    auto connection = Connection();
+    auto &stream = *connection.stream;
+    connection.send("content-type: application/vscode-jsonrpc; charset=utf-8\r\n"
+                    "CONTENT-LENGTH:2\r\n\r\n{}");
+    stream.fill();
+    check(stream.takeMessageBody() == "{}", "another header first and no space");
+}
+
+// An lsp::Connection reads the header and body itself once a message was taken
+void readsMessagesForAConnection() {
+    auto connection = Connection();
+    auto &stream = *connection.stream;
+    auto message = framed("{\"id\":1}");
+    connection.send(message + "Content-Length: 2");
+    stream.fill();
+    check(stream.takeMessage(), "one message is complete");
+    check(!stream.takeMessage(), "the second is not");
+    auto read = std::string(message.size(), '\0');
+    stream.read(read.data(), read.size());
+    check(read == message, "read() hands out the message as it came");
+}
+
+void reportsTheClosedConnection() {
+    auto connection = Connection();
+    auto &stream = *connection.stream;
+    connection.send(framed("{}"));
+    ::close(connection.peer);
+    connection.peer = -1;
+    check(!stream.fill(), "the other side closed its end");
+    check(stream.takeMessageBody() == "{}", "what came before is still there");
+}
+
+void queuesWhatTheSocketDoesNotTake() {
+    auto connection = Connection();
+    auto &stream = *connection.stream;
+    // Far more than the socket buffers, the rest has to wait
+    auto body = std::string(8 * 1024 * 1024, 'x');
+    stream.queueMessage(body);
+    check(stream.queuedBytes() > 0, "the rest is queued instead of blocking");
+    stream.queueMessage("{}");
+
+    auto expected = framed(body) + framed("{}");
+    auto received = std::string();
+    char chunk[64 * 1024];
+    while (received.size() < expected.size()) {
+        auto count = ::recv(connection.peer, chunk, sizeof(chunk), 0);
+        if (count <= 0) {
+            break;
+        }
+        received.append(chunk, std::size_t(count));
+        stream.flushQueued();
+    }
+    check(stream.queuedBytes() == 0, "all of it is written");
+    check(received == expected, "in order and framed");
+}
+
+} // namespace
+
+int main() {
+    waitsForTheWholeMessage();
+    splitsMessagesOfOneRead();
+    readsHeadersInAnyCase();
+    readsMessagesForAConnection();
+    reportsTheClosedConnection();
+    queuesWhatTheSocketDoesNotTake();
+    return test::result();
+}
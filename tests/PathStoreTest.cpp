@@ -0,0 +1,135 @@
+#include "Check.hpp"
+#include "PathStore.hpp"
+
+using test::check;
+
+namespace {
+
+void storesPaths() {
+    auto store = PathStore::fromList({"main.cpp", "src/a.cpp", "src/sub/B.cpp", "src/c.cpp"});
+    check(store.size() == 4, "four files");
+    check(store.path(2) == "src/sub/B.cpp", "the path is directory and name");
+    check(store.name(2) == u"B.cpp", "the name");
+    check(store.foldedName(2) == u"b.cpp", "the folded name");
+    check(store.dirOf(1) == store.dirOf(3), "files of a directory share its id");
+    check(store.dirCount() == 3, "root, src/ and src/sub/");
+    check(store.parentDir(store.dirOf(2)) == store.dirOf(1), "src/ is the parent of src/sub/");
+    check(store.foldedDirName(store.dirOf(2)) == u"sub", "the last segment of src/sub/");
+    check(store.findDir(u"src/") == store.dirOf(1), "known directory");
+    check(store.findDir(u"lib/") == -1, "unknown directory");
+    check(store.toList() ==
+              QStringList({"main.cpp", "src/a.cpp", "src/sub/B.cpp", "src/c.cpp"}),
+          "the list comes back in order");
+}
+
+void emptyStoreHasRoot() {
+    auto store = PathStore();
+    check(store.isEmpty(), "no files");
+    check(store.dirCount() == 1, "only the root");
+    check(store.dirPath(PathStore::RootDir).isEmpty(), "the root path is empty");
+    check(store.findDir(u"") == PathStore::RootDir, "the root is found");
+}
+
+// Names that do not fit the rest of a block start the next one
+void namesSpanBlocks() {
+    auto store = PathStore();
+    auto name = QString(1000, u'x');
+    for (auto i = 0; i < 200; ++i) {
+        store.addFile(u"dir/", name + QString::number(i));
+    }
+    auto intact = true;
+    for (auto i = 0; i < 200; ++i) {
+        intact = intact && store.name(i) == name + QString::number(i);
+    }
+    check(intact, "every name is intact across blocks");
+}
+
+// The original keeps appending while a snapshot is read
+void snapshotsStayWhileAppending() {
+    auto store = PathStore();
+    store.addFile(u"a/one.cpp");
+    auto snapshot = store;
+    check(snapshot.isSharedWith(store), "a copy is the same snapshot");
+    for (auto i = 0; i < 100000; ++i) {
+        store.addFile(QString("b/%1.cpp").arg(i));
+    }
+    check(!snapshot.isSharedWith(store), "the original moved on");
+    check(snapshot.size() == 1 && snapshot.dirCount() == 2, "the snapshot keeps its size");
+    check(snapshot.path(0) == "a/one.cpp", "the snapshot reads its files");
+    check(snapshot.findDir(u"b/") == -1, "directories added later are not in the snapshot");
+    check(store.size() == 100001, "the original has every file");
+    check(store.path(100000) == "b/99999.cpp", "the last file");
+}
+
+// A copy that fell behind gets a storage of its own on its first append
+void appendingToOlderCopyDetaches() {
+    auto store = PathStore::fromList({"a/one.cpp"});
+    auto older = store;
+    store.addFile(u"b/two.cpp");
+    older.addFile(u"c/three.cpp");
+    check(store.size() == 2 && store.path(1) == "b/two.cpp", "the original is unchanged");
+    check(older.size() == 2 && older.path(1) == "c/three.cpp", "the copy has its own file");
+    check(older.findDir(u"b/") == -1 && store.findDir(u"c/") == -1,
+          "directories stay with their store");
+    older.addFile(u"b/four.cpp");
+    check(older.path(2) == "b/four.cpp", "the copy interns b/ on its own");
+}
+
+// What FileIndex saves and loads back
+void loadsSavedLayout() {
+    auto saved = PathStore();
+    auto name = QString(3000, u'n');
+    for (auto i = 0; i < 100; ++i) {
+        saved.addFile(QString("d%1/").arg(i % 3), name + QString::number(i));
+    }
+    auto entries = QList<PathStore::Entry>();
+    for (auto i = qsizetype(0); i < saved.size(); ++i) {
+        entries << saved.entry(i);
+    }
+    auto names = QString();
+    auto foldedNames = QString();
+    for (auto offset = qsizetype(0); offset < saved.nameArenaSize();
+         offset += PathStore::BlockSize) {
+        names += saved.nameBlock(offset, false);
+        foldedNames += saved.nameBlock(offset, true);
+    }
+
+    // QString::utf16() is ushort
+    auto nameData = reinterpret_cast<const char16_t *>(names.constData());
+    auto foldedData = reinterpret_cast<const char16_t *>(foldedNames.constData());
+
+    auto loaded = PathStore();
+    for (auto dir = PathStore::DirId(1); dir < saved.dirCount(); ++dir) {
+        loaded.addDir(saved.dirPath(dir));
+    }
+    check(loaded.loadFiles(entries.constData(), entries.size(), nameData, foldedData,
+                           names.size()),
+          "the saved files load");
+    check(loaded.toList() == saved.toList(), "the loaded store has the same paths");
+    check(loaded.foldedName(99) == saved.foldedName(99), "folded names are loaded");
+
+    auto broken = PathStore();
+    check(!broken.loadFiles(entries.constData(), entries.size(), nameData, foldedData,
+                            names.size()),
+          "entries of unknown directories are refused");
+}
+
+void sortsCaseInsensitive() {
+    auto store = PathStore::fromList({"b/x.cpp", "A/y.cpp", "a.cpp", "B/a.cpp"});
+    check(store.lessThan(1, 0), "A/y.cpp before b/x.cpp");
+    check(store.lessThan(2, 1), "a.cpp before A/y.cpp");
+    check(store.lessThan(3, 0), "B/a.cpp before b/x.cpp");
+}
+
+} // namespace
+
+int main() {
+    storesPaths();
+    emptyStoreHasRoot();
+    namesSpanBlocks();
+    snapshotsStayWhileAppending();
+    appendingToOlderCopyDetaches();
+    loadsSavedLayout();
+    sortsCaseInsensitive();
+    return test::result();
+}
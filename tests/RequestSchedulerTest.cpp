@@ -0,0 +1,150 @@
+#include "Check.hpp"
+#include "RequestScheduler.hpp"
+
+#include <vector>
+
+using test::check;
+
+namespace {
+
+using Priority = RequestScheduler::Priority;
+
+// Records the order requests go out in and keeps their completions for the test to call,
+// and the requests that were dropped instead
+struct Sent {
+    std::string order;
+    std::vector<RequestScheduler::Done> done;
+    std::string dropped;
+
+    // Adds name in upper case to dropped if the request is never sent
+    RequestScheduler::Dropped drop(char name) {
+        return [this, name] { dropped += char(name - 'a' + 'A'); };
+    }
+
+    RequestScheduler::Send request(char name) {
+        return [this, name](RequestScheduler::Done finish) {
+            order += name;
+            done.push_back(std::move(finish));
+        };
+    }
+};
+
+void sendsHighestClassFirst() {
+    auto scheduler = RequestScheduler();
+    auto sent = Sent();
+    scheduler.submit(Priority::Background, "", sent.request('b'));
+    scheduler.submit(Priority::Visible, "", sent.request('v'));
+    scheduler.submit(Priority::Interactive, "", sent.request('i'));
+    check(sent.order.empty(), "nothing is sent on submit");
+    scheduler.pump();
+    check(sent.order == "ivb", "interactive, visible, background");
+}
+
+void keepsToTheLimits() {
+    auto scheduler = RequestScheduler({1, 1, 1});
+    auto sent = Sent();
+    scheduler.submit(Priority::Background, "", sent.request('a'));
+    scheduler.submit(Priority::Background, "", sent.request('b'));
+    scheduler.submit(Priority::Interactive, "", sent.request('i'));
+    scheduler.pump();
+    check(sent.order == "ia", "one per class in flight");
+    sent.done[0]();
+    scheduler.pump();
+    check(sent.order == "ia", "another class finishing sends nothing");
+    sent.done[1]();
+    sent.done[1]();
+    scheduler.pump();
+    check(sent.order == "iab", "the next one goes out once the first is done");
+    scheduler.submit(Priority::Background, "", sent.request('c'));
+    scheduler.pump();
+    check(sent.order == "iab", "done twice counts once");
+    check(scheduler.serverTime(Priority::Background).count() == 1, "one background completed");
+}
+
+void replacesQueuedRequestWithSameKey() {
+    auto scheduler = RequestScheduler({1, 1, 1});
+    auto sent = Sent();
+    scheduler.submit(Priority::Visible, "x", sent.request('1'));
+    scheduler.pump();
+    scheduler.submit(Priority::Visible, "a.cpp", sent.request('a'));
+    scheduler.submit(Priority::Visible, "b.cpp", sent.request('b'));
+    auto ticket = scheduler.submit(Priority::Visible, "a.cpp", sent.request('A'));
+    scheduler.submit(Priority::Visible, "x", sent.request('2'));
+    sent.done[0]();
+    scheduler.pump();
+    check(sent.order == "1A", "the replacement keeps the first one's place");
+    check(!scheduler.cancel(ticket), "a sent request cannot be cancelled");
+    sent.done[1]();
+    scheduler.pump();
+    check(sent.order == "1Ab", "then the next key");
+    sent.done[2]();
+    scheduler.pump();
+    check(sent.order == "1Ab2", "a key in flight does not deduplicate");
+}
+
+void cancelsQueuedRequests() {
+    auto scheduler = RequestScheduler();
+    auto sent = Sent();
+    auto first = scheduler.submit(Priority::Background, "", sent.request('a'));
+    auto replaced = scheduler.submit(Priority::Interactive, "k", sent.request('b'));
+    auto replacement = scheduler.submit(Priority::Interactive, "k", sent.request('c'));
+    check(scheduler.cancel(first), "a queued request is cancelled");
+    check(!scheduler.cancel(first), "only once");
+    check(!scheduler.cancel(replaced), "the replaced ticket is gone");
+    check(scheduler.cancel(replacement), "the replacement's ticket cancels it");
+    scheduler.pump();
+    check(sent.order.empty(), "nothing left to send");
+}
+
+void tellsDroppedRequests() {
+    auto scheduler = RequestScheduler({1, 1, 1});
+    auto sent = Sent();
+    scheduler.submit(Priority::Visible, "k", sent.request('a'), sent.drop('a'));
+    scheduler.pump();
+    scheduler.submit(Priority::Visible, "k", sent.request('b'), sent.drop('b'));
+    scheduler.submit(Priority::Visible, "k", sent.request('c'), sent.drop('c'));
+    check(sent.dropped == "B", "the replaced request is told");
+    auto ticket = scheduler.submit(Priority::Background, "", sent.request('d'), sent.drop('d'));
+    scheduler.submit(Priority::Background, "", sent.request('e'), sent.drop('e'));
+    scheduler.submit(Priority::Interactive, "", sent.request('f'));
+    check(scheduler.cancel(ticket), "d is cancelled");
+    check(sent.dropped == "BD", "the cancelled request is told");
+    scheduler.submit(Priority::Background, "", sent.request('g'), sent.drop('g'));
+    scheduler.pump();
+    check(sent.order == "afe", "c waits for a, g for e");
+    scheduler.reset();
+    check(sent.dropped == "BDCG", "the queued requests are told on reset, the sent ones not");
+    sent.done[0]();
+    check(sent.dropped == "BDCG", "completing a sent request drops nothing");
+}
+
+void resetForgetsInFlightRequests() {
+    auto scheduler = RequestScheduler({1, 1, 1});
+    auto sent = Sent();
+    scheduler.submit(Priority::Interactive, "", sent.request('a'));
+    scheduler.submit(Priority::Interactive, "", sent.request('b'));
+    scheduler.pump();
+    scheduler.reset();
+    scheduler.submit(Priority::Interactive, "", sent.request('c'));
+    scheduler.submit(Priority::Interactive, "", sent.request('d'));
+    scheduler.pump();
+    check(sent.order == "ac", "the queue is dropped and the limit is free again");
+    sent.done[0]();
+    scheduler.pump();
+    check(sent.order == "ac", "a completion from before the reset frees nothing");
+    sent.done[1]();
+    scheduler.pump();
+    check(sent.order == "acd", "one from after the reset does");
+}
+
+} // namespace
+
+int main() {
+    sendsHighestClassFirst();
+    keepsToTheLimits();
+    replacesQueuedRequestWithSameKey();
+    cancelsQueuedRequests();
+    tellsDroppedRequests();
+    resetForgetsInFlightRequests();
+    return test::result();
+}
@@ -0,0 +1,97 @@
+#include "Check.hpp"
+#include "SemanticTokens.hpp"
+
+using test::check;
+
+namespace {
+
+// Two tokens on line 0 and one on line 2
+const auto Initial = std::vector<std::uint32_t>{0, 4, 3, 1, 0, 0, 6, 2, 2, 0, 2, 0, 5, 3, 0};
+
+bool changedLinesAre(SemanticTokens &tokens, int first, int last) {
+    auto changed = tokens.takeChangedLines();
+    return changed.size() == 1 && changed[0].first == first && changed[0].last == last;
+}
+
+void decodesTokens() {
+    auto tokens = SemanticTokens();
+    check(tokens.replace(Initial), "the tokens are taken");
+    check(tokens.size() == 3, "three tokens");
+    check(tokens.line(0).size() == 2, "two tokens on line 0");
+    check(tokens.line(0)[1].start == 10 && tokens.line(0)[1].length == 2,
+          "columns are relative to the token before on the same line");
+    check(tokens.line(1).empty(), "none on line 1");
+    check(tokens.line(2).size() == 1 && tokens.line(2)[0].type == 3, "one on line 2");
+    check(changedLinesAre(tokens, 0, 2), "all lines with tokens changed");
+}
+
+void deltaChangesOneLine() {
+    auto tokens = SemanticTokens();
+    tokens.replace(Initial);
+    tokens.takeChangedLines();
+    check(tokens.apply({{5, 5, {0, 6, 2, 7, 0}}}), "the edit fits");
+    check(tokens.line(0)[1].type == 7, "the second token has the new type");
+    check(tokens.line(2)[0].type == 3, "the token behind is kept");
+    check(changedLinesAre(tokens, 0, 0), "only line 0 changed");
+}
+
+// A line break typed before line 2 adds a token on the new line and moves the one behind
+void insertedLineMovesTokensBehind() {
+    auto tokens = SemanticTokens();
+    tokens.replace(Initial);
+    tokens.takeChangedLines();
+    check(tokens.apply({{10, 0, {1, 0, 1, 4, 0}}}), "the insertion fits");
+    check(tokens.size() == 4, "four tokens");
+    check(tokens.line(1).size() == 1 && tokens.line(1)[0].type == 4, "the new token");
+    check(tokens.line(2).empty(), "line 2 moved");
+    check(tokens.line(3).size() == 1 && tokens.line(3)[0].type == 3, "to line 3");
+    auto changed = tokens.takeChangedLines();
+    check(!changed.empty() && changed[0].first <= 1 && 1 <= changed[0].last,
+          "the new line is reported");
+}
+
+void editsReferToTheArrayBeforeThem() {
+    auto tokens = SemanticTokens();
+    tokens.replace(Initial);
+    check(tokens.apply({{0, 5, {0, 4, 3, 9, 0}}, {10, 5, {}}}), "both edits fit");
+    check(tokens.size() == 2, "the last token is deleted");
+    check(tokens.line(0)[0].type == 9 && tokens.line(0)[1].type == 2,
+          "the first token is replaced, the second kept");
+    check(tokens.line(2).empty(), "nothing left on line 2");
+}
+
+void misfittingEditClears() {
+    auto tokens = SemanticTokens();
+    tokens.replace(Initial);
+    tokens.takeChangedLines();
+    check(!tokens.apply({{3, 5, {}}}), "an edit inside a token is refused");
+    check(tokens.empty(), "the tokens are cleared");
+    check(changedLinesAre(tokens, 0, 2), "the lines that had tokens changed");
+    tokens.replace(Initial);
+    check(!tokens.apply({{10, 10, {}}}), "an edit past the end is refused");
+}
+
+void fullUpdateReportsDifferingLines() {
+    auto tokens = SemanticTokens();
+    tokens.replace(Initial);
+    tokens.takeChangedLines();
+    auto next = Initial;
+    next[13] = 5;
+    check(tokens.replace(next), "the update is taken");
+    check(tokens.line(2)[0].type == 5, "the type is updated");
+    check(changedLinesAre(tokens, 2, 2), "only line 2 changed");
+    check(tokens.replace(next) && tokens.takeChangedLines().empty(),
+          "the same tokens change nothing");
+}
+
+} // namespace
+
+int main() {
+    decodesTokens();
+    deltaChangesOneLine();
+    insertedLineMovesTokensBehind();
+    editsReferToTheArrayBeforeThem();
+    misfittingEditClears();
+    fullUpdateReportsDifferingLines();
+    return test::result();
+}